@@ -0,0 +1,115 @@
+#include "AllocStats.hpp"
+
+#ifdef MWM_ALLOC_STATS
+
+#include <u/log.hpp>
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+thread_local uint64_t t_allocs = 0;
+thread_local unsigned t_exempt = 0; // Nesting depth of AllocScope::Exempt
+
+/// Fixed table, bookkeeping must not allocate inside the scopes it measures
+struct HandlerStats
+{
+  const char* name;
+  bool hot;
+  uint64_t calls;
+  uint64_t allocatingCalls;
+  uint64_t allocs;
+};
+
+constexpr size_t MAX_HANDLERS = 128;
+HandlerStats g_stats[MAX_HANDLERS];
+size_t g_numStats = 0;
+
+HandlerStats* Lookup(const char* name, bool hot)
+{
+  for (size_t i = 0; i < g_numStats; ++i)
+    if (g_stats[i].name == name)
+      return &g_stats[i];
+  if (g_numStats == MAX_HANDLERS)
+    return nullptr;
+  g_stats[g_numStats] = { name, hot, 0, 0, 0 };
+  return &g_stats[g_numStats++];
+}
+
+void Count()
+{
+  if (t_exempt == 0)
+    ++t_allocs;
+}
+
+void* Allocate(size_t n)
+{
+  Count();
+  if (void* p = malloc(n ? n : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+} // namespace
+
+void* operator new(size_t n) { return Allocate(n); }
+void* operator new[](size_t n) { return Allocate(n); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept { Count(); return malloc(n ? n : 1); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { Count(); return malloc(n ? n : 1); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+AllocScope::AllocScope(const char* name, bool hot)
+  : _name(name), _hot(hot), _start(t_allocs)
+{
+}
+
+AllocScope::~AllocScope()
+{
+  const uint64_t allocs = t_allocs - _start;
+  HandlerStats* s = Lookup(_name, _hot);
+  if (s == nullptr)
+    return;
+
+  // The first call may size scratch space, later ones must reuse it
+  const bool warm = s->calls > 0;
+  s->calls++;
+  if (allocs == 0)
+    return;
+  s->allocatingCalls++;
+  s->allocs += allocs;
+
+  if (_hot && warm) {
+    LOG(ERROR) << "hot path allocated handler=" << _name << " allocs=" << allocs;
+    static const bool strict = getenv("MWM_ALLOC_STRICT") != nullptr;
+    if (strict)
+      abort();
+  }
+}
+
+AllocScope::Exempt::Exempt()
+{
+  ++t_exempt;
+}
+
+AllocScope::Exempt::~Exempt()
+{
+  --t_exempt;
+}
+
+void AllocScope::report()
+{
+  for (size_t i = 0; i < g_numStats; ++i) {
+    const auto& s = g_stats[i];
+    LOG(INFO) << "alloc stats handler=" << s.name
+              << " hot=" << s.hot
+              << " calls=" << s.calls
+              << " allocatingCalls=" << s.allocatingCalls
+              << " allocs=" << s.allocs;
+  }
+}
+
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+/// Heap allocation accounting per event handler, only compiled in with
+/// MWM_ALLOC_STATS (cmake -DMWM_ALLOC_STATS=ON). Global operator new is
+/// counted per thread, a scope charges what its thread allocated in between.
+///
+/// Hot handlers must not allocate once warmed up: after its first call, an
+/// allocating hot scope is logged, and aborts when MWM_ALLOC_STRICT is set so
+/// a benchmark or test run fails loudly. Without the flag a scope is empty.
+class AllocScope
+{
+  public:
+
+#ifdef MWM_ALLOC_STATS
+    AllocScope(const char* name, bool hot);
+    ~AllocScope();
+
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+
+    /// Logs calls and allocations per handler
+    static void report();
+
+  private:
+
+    const char* _name; // A literal or static table entry, compared by address
+    bool _hot;
+    uint64_t _start;
+#else
+    AllocScope(const char*, bool) {}
+    static void report() {}
+#endif
+
+  public:
+
+    /// Allocations on this thread go uncounted while one is alive, for work
+    /// inside a hot scope that isn't the handler's own
+    class Exempt
+    {
+      public:
+
+#ifdef MWM_ALLOC_STATS
+        Exempt();
+        ~Exempt();
+
+        Exempt(const Exempt&) = delete;
+        Exempt& operator=(const Exempt&) = delete;
+#else
+        Exempt() {}
+#endif
+
+        bool done = false; // Ends HOT_LOG's single pass
+    };
+};
+
+/// LOG from code a hot scope covers. The log line's own buffers are the
+/// logger's business, strict mode only trips on what the handler allocates.
+#define HOT_LOG(level) \
+  for (AllocScope::Exempt allocExempt_; !allocExempt_.done; allocExempt_.done = true) LOG(level)
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <X11/Xlib.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+/// Every atom mwm uses. The leading underscore of the _NET_* names is dropped
+/// from the enumerators, the real names live in XAtomName().
+enum class XA
+{
+  WM_PROTOCOLS,
+  WM_DELETE_WINDOW,
+  UTF8_STRING,
+  NET_SUPPORTED,
+  NET_SUPPORTING_WM_CHECK,
+  NET_CLIENT_LIST,
+  NET_ACTIVE_WINDOW,
+  NET_CLOSE_WINDOW,
+  NET_WM_NAME,
+  NET_WM_PID,
+  NET_WM_STATE,
+  NET_WM_STATE_FULLSCREEN,
+  NET_WM_SYNC_REQUEST,
+  NET_WM_SYNC_REQUEST_COUNTER,
+  LAST
+};
+
+constexpr static inline const char* XAtomName(XA a)
+{
+  constexpr const char* const X_ATOM_NAMES[] = {
+    "WM_PROTOCOLS",
+    "WM_DELETE_WINDOW",
+    "UTF8_STRING",
+    "_NET_SUPPORTED",
+    "_NET_SUPPORTING_WM_CHECK",
+    "_NET_CLIENT_LIST",
+    "_NET_ACTIVE_WINDOW",
+    "_NET_CLOSE_WINDOW",
+    "_NET_WM_NAME",
+    "_NET_WM_PID",
+    "_NET_WM_STATE",
+    "_NET_WM_STATE_FULLSCREEN",
+    "_NET_WM_SYNC_REQUEST",
+    "_NET_WM_SYNC_REQUEST_COUNTER",
+  };
+  static_assert(sizeof(X_ATOM_NAMES) / sizeof(const char*) == size_t(XA::LAST));
+
+  if (a >= XA::LAST)
+    return "Undefined";
+  return X_ATOM_NAMES[size_t(a)];
+}
+
+/// Atom registry, interned once at startup with a single round trip
+class Atoms
+{
+  public:
+
+    bool init(Display* disp)
+    {
+      char* names[size_t(XA::LAST)];
+      for (size_t i = 0; i < size_t(XA::LAST); ++i)
+        names[i] = const_cast<char*>(XAtomName(XA(i)));
+      if (XInternAtoms(disp, names, int(XA::LAST), false, _atoms) == 0)
+        return false;
+
+      _rev.clear();
+      for (size_t i = 0; i < size_t(XA::LAST); ++i)
+        _rev.emplace_back(_atoms[i], XA(i));
+      std::sort(begin(_rev), end(_rev));
+      return true;
+    }
+
+    Atom operator[](XA a) const { return _atoms[size_t(a)]; }
+
+    /// Reverse lookup, XA::LAST if the atom is not one of ours
+    XA lookup(Atom atom) const
+    {
+      auto it = std::lower_bound(begin(_rev), end(_rev), std::make_pair(atom, XA(0)));
+      if (it == end(_rev) || it->first != atom)
+        return XA::LAST;
+      return it->second;
+    }
+
+    /// Name without a server round trip, "Undefined" for foreign atoms
+    const char* name(Atom atom) const { return XAtomName(lookup(atom)); }
+
+  private:
+
+    Atom _atoms[size_t(XA::LAST)] = {};
+    std::vector<std::pair<Atom, XA>> _rev;
+};
@@ -0,0 +1,161 @@
+#include "Bar.hpp"
+
+#include <u/log.hpp>
+
+#include <algorithm>
+
+namespace {
+
+/// Base names of font sets, tried in order, "fixed" is always there
+const char* const FONTS[] = {
+  "-misc-fixed-medium-r-normal--13-*-*-*-*-*-*-*",
+  "fixed",
+};
+
+/// Bytes in the UTF-8 sequence starting at s[i], a stray byte counts as one
+size_t Utf8Len(const std::string& s, size_t i)
+{
+  const auto c = (unsigned char) s[i];
+  size_t len = (c >= 0xF0) ? 4 : (c >= 0xE0) ? 3 : (c >= 0xC0) ? 2 : 1;
+  size_t n = 1;
+  while (n < len && i + n < s.size() && ((unsigned char) s[i + n] & 0xC0) == 0x80)
+    ++n;
+  return n;
+}
+
+/// Slot widths in characters, the title gets the rest
+constexpr int SLOT_CHARS[] = { 12, 6, 8 };
+
+} // namespace
+
+bool Bar::open(Display* disp, int screen, const Rect& mon, const Colors& colors)
+{
+  if (isOpen())
+    close();
+
+  _disp = disp;
+  _colors = colors;
+  for (const char* name : FONTS) {
+    char** missing = nullptr;
+    int numMissing = 0;
+    char* defString = nullptr;
+    _font = XCreateFontSet(_disp, name, &missing, &numMissing, &defString);
+    if (missing != nullptr)
+      XFreeStringList(missing);
+    if (_font != nullptr) {
+      if (numMissing > 0)
+        LOG(WARN) << "bar font set incomplete base=(" << name << ") missing=" << numMissing;
+      break;
+    }
+  }
+  if (_font == nullptr) {
+    LOG(ERROR) << "bar has no font";
+    return false;
+  }
+
+  int widest = 0;
+  for (unsigned c = 0; c < 128; ++c) {
+    const char ch = char(c);
+    _advance[c] = Xutf8TextEscapement(_font, &ch, 1);
+    widest = std::max(widest, _advance[c]);
+  }
+
+  const XFontSetExtents* ext = XExtentsOfFontSet(_font);
+  _ascent = -ext->max_logical_extent.y;
+  _width = mon.w;
+  _height = ext->max_logical_extent.height + 4;
+  int x = 0;
+  for (size_t i = 0; i < size_t(Seg::LAST); ++i) {
+    Slot& s = _slots[i];
+    s.x = x;
+    s.w = (i < std::size(SLOT_CHARS)) ? SLOT_CHARS[i] * widest + 2 * PAD : std::max(0, _width - x);
+    s.text.clear();
+    s.text.reserve(TEXT_RESERVED);
+    s.accent = false;
+    s.dirty = true;
+    x += s.w;
+  }
+
+  XSetWindowAttributes wa;
+  wa.override_redirect = True;
+  wa.background_pixmap = None; // Expose repaints from the buffer, no clear first
+  wa.event_mask = ExposureMask;
+  _win = XCreateWindow(_disp, RootWindow(_disp, screen), mon.o.x, mon.o.y, unsigned(_width), unsigned(_height), 0,
+                       CopyFromParent, InputOutput, CopyFromParent,
+                       CWOverrideRedirect | CWBackPixmap | CWEventMask, &wa);
+  _buf = XCreatePixmap(_disp, _win, unsigned(_width), unsigned(_height),
+                       unsigned(DefaultDepth(_disp, screen)));
+  XGCValues gcv;
+  gcv.graphics_exposures = False;
+  _gc = XCreateGC(_disp, _win, GCGraphicsExposures, &gcv);
+  XSetForeground(_disp, _gc, _colors.bg);
+  XFillRectangle(_disp, _buf, _gc, 0, 0, unsigned(_width), unsigned(_height));
+
+  XMapRaised(_disp, _win);
+  LOG(INFO) << "bar opened width=" << _width << " height=" << _height;
+  return true;
+}
+
+void Bar::close()
+{
+  if (!isOpen())
+    return;
+  XFreeGC(_disp, _gc);
+  XFreePixmap(_disp, _buf);
+  XDestroyWindow(_disp, _win);
+  XFreeFontSet(_disp, _font);
+  _win = None;
+  _buf = None;
+  _gc = None;
+  _font = nullptr;
+}
+
+void Bar::set(Seg seg, std::string_view text, bool accent)
+{
+  Slot& s = _slots[size_t(seg)];
+  if (s.text == text && s.accent == accent)
+    return;
+  s.text.assign(text);
+  s.accent = accent;
+  s.dirty = true;
+}
+
+void Bar::flush()
+{
+  if (!isOpen())
+    return;
+
+  bool drawn = false;
+  for (auto& s : _slots) {
+    if (!s.dirty || s.w == 0)
+      continue;
+    s.dirty = false;
+    drawn = true;
+
+    XSetForeground(_disp, _gc, _colors.bg);
+    XFillRectangle(_disp, _buf, _gc, s.x, 0, unsigned(s.w), unsigned(_height));
+
+    // Whatever fits, cut at a character
+    const int room = s.w - 2 * PAD;
+    size_t n = 0;
+    for (int used = 0; n < s.text.size();) {
+      const auto c = (unsigned char) s.text[n];
+      const size_t len = (c < 0x80) ? 1 : Utf8Len(s.text, n);
+      used += (c < 0x80) ? _advance[c] : Xutf8TextEscapement(_font, s.text.data() + n, int(len));
+      if (used > room)
+        break;
+      n += len;
+    }
+    XSetForeground(_disp, _gc, s.accent ? _colors.accent : _colors.fg);
+    Xutf8DrawString(_disp, _buf, _font, _gc, s.x + PAD, 2 + _ascent, s.text.data(), int(n));
+    XCopyArea(_disp, _buf, _win, _gc, s.x, 0, unsigned(s.w), unsigned(_height), s.x, 0);
+  }
+  if (drawn)
+    XFlush(_disp);
+}
+
+void Bar::expose(const XExposeEvent& e)
+{
+  if (isOpen())
+    XCopyArea(_disp, _buf, _win, _gc, e.x, e.y, unsigned(e.width), unsigned(e.height), e.x, e.y);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Geometry.hpp"
+
+#include <X11/Xlib.h>
+
+#include <string>
+#include <string_view>
+
+/// Status line along the top of one monitor, fed from the manager's own state
+/// so nothing has to poll X for it. Segments sit in fixed slots: setting one
+/// only marks it changed when its text or highlight differs, and flush() draws
+/// just the changed slots into the back buffer and copies just those out.
+/// Nothing is drawn, and nothing wakes up, while the state stays put.
+class Bar
+{
+  public:
+
+    enum class Seg
+    {
+      Monitor, // Config name
+      Layout,
+      Grid,    // Highlighted while grid mode is on
+      Title,   // Focused window, highlighted when it is on this monitor
+      LAST
+    };
+
+    struct Colors
+    {
+      unsigned long bg;
+      unsigned long fg;
+      unsigned long accent;
+    };
+
+    static constexpr size_t TEXT_RESERVED = 256; // Text this long never allocates
+
+    bool isOpen() const { return _win != None; }
+    Window window() const { return _win; }
+
+    /// Strip taken off the top of the monitor, 0 when closed
+    int height() const { return isOpen() ? _height : 0; }
+
+    /// mon is in the screen's root coordinates. Text is UTF-8, which needs
+    /// LC_CTYPE set to a UTF-8 locale for the font set to cover it.
+    bool open(Display* disp, int screen, const Rect& mon, const Colors& colors);
+    void close();
+
+    void set(Seg s, std::string_view text, bool accent = false);
+
+    /// Draws and copies out whatever changed since the last flush
+    void flush();
+
+    /// Repaints the exposed part from the back buffer
+    void expose(const XExposeEvent& e);
+
+  private:
+
+    struct Slot
+    {
+      int x = 0, w = 0; // Fixed at open, the last one takes what is left
+      std::string text;
+      bool accent = false;
+      bool dirty = true;
+    };
+
+    static constexpr int PAD = 6;
+
+    Display* _disp = nullptr;
+    Window _win = None;
+    Pixmap _buf = None;
+    GC _gc = None;
+    XFontSet _font = nullptr;
+    int _ascent = 0;
+    Colors _colors = {};
+    int _width = 0, _height = 0;
+
+    // Advance of each ASCII character, looked up once at open instead of per
+    // draw. The rest are measured as they come.
+    int _advance[128] = {};
+
+    Slot _slots[size_t(Seg::LAST)];
+};
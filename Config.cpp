@@ -0,0 +1,332 @@
+#include "Config.hpp"
+
+#include <u/log.hpp>
+
+#include <X11/XF86keysym.h>
+#include <X11/Xutil.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <string_view>
+
+#define NUMLOCK (Mod2Mask)
+
+namespace {
+
+constexpr const char* const ACTION_NAMES[] = {
+  "terminal",
+  "close",
+  "maximize",
+  "unmaximize",
+  "grid",
+  "snap-grid",
+  "lock",
+  "launcher",
+  "screenshot",
+  "screenshot-monitor",
+  "screenshot-window",
+  "volume-up",
+  "volume-down",
+  "volume-mute",
+  "focus",
+  "grid-move",
+  "grid-size",
+  "monitor",
+  "restart",
+  "layout",
+  "record-dump",
+};
+static_assert(sizeof(ACTION_NAMES) / sizeof(const char*) == size_t(Action::LAST));
+
+bool isDirectional(Action a)
+{
+  return a == Action::MoveFocus || a == Action::MoveGridLoc ||
+         a == Action::MoveGridSize || a == Action::MoveMonitor;
+}
+
+/// Splits a line on whitespace without allocating
+size_t tokenize(std::string_view line, std::string_view* toks, size_t max)
+{
+  size_t n = 0;
+  size_t i = 0;
+  while (n < max) {
+    while (i < line.size() && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r'))
+      ++i;
+    if (i >= line.size() || line[i] == '#')
+      break;
+    size_t j = i;
+    while (j < line.size() && line[j] != ' ' && line[j] != '\t' && line[j] != '\r')
+      ++j;
+    toks[n++] = line.substr(i, j - i);
+    i = j;
+  }
+  return n;
+}
+
+bool parseUnsigned(std::string_view s, unsigned long& out, int base = 10)
+{
+  if (s.empty())
+    return false;
+  std::string tmp(s);
+  char* end = nullptr;
+  errno = 0;
+  out = strtoul(tmp.c_str(), &end, base);
+  return errno == 0 && end != nullptr && *end == '\0';
+}
+
+bool parseMods(std::string_view s, unsigned& mods)
+{
+  mods = 0;
+  if (s == "any") {
+    mods = AnyModifier;
+    return true;
+  }
+  while (!s.empty()) {
+    auto plus = s.find('+');
+    auto mod = s.substr(0, plus);
+    if (mod == "numlock")                       mods |= NUMLOCK;
+    else if (mod == "shift")                    mods |= ShiftMask;
+    else if (mod == "ctrl" || mod == "control") mods |= ControlMask;
+    else if (mod == "alt" || mod == "mod1")     mods |= Mod1Mask;
+    else if (mod == "super" || mod == "mod4")   mods |= Mod4Mask;
+    else if (mod != "none")                     return false;
+    s = (plus == std::string_view::npos) ? std::string_view() : s.substr(plus + 1);
+  }
+  return true;
+}
+
+bool parseDir(std::string_view s, DIR& dir)
+{
+  if (s == "left")       dir = DIR::Left;
+  else if (s == "right") dir = DIR::Right;
+  else if (s == "up")    dir = DIR::Up;
+  else if (s == "down")  dir = DIR::Down;
+  else                   return false;
+  return true;
+}
+
+bool parseLine(std::string_view line, Config& cfg, bool& haveBindings)
+{
+  std::string_view t[8];
+  size_t n = tokenize(line, t, 8);
+  if (n == 0)
+    return true;
+
+  unsigned long a, b;
+  if (t[0] == "monitor" && (n == 4 || n == 6)) {
+    MonitorCfg m;
+    m.name = t[1];
+    m.connector = t[3];
+    if (!parseUnsigned(t[2], a))
+      return false;
+    m.screen = int(a);
+    if (n == 6) {
+      if (!parseUnsigned(t[4], a) || !parseUnsigned(t[5], b) || a == 0 || b == 0)
+        return false;
+      m.gridX = unsigned(a);
+      m.gridY = unsigned(b);
+    }
+    return cfg.monitors.emplace(m.name, m).second;
+  }
+  if (t[0] == "grid" && n == 3) {
+    if (!parseUnsigned(t[1], a) || !parseUnsigned(t[2], b) || a == 0 || b == 0)
+      return false;
+    cfg.gridX = unsigned(a);
+    cfg.gridY = unsigned(b);
+    return true;
+  }
+  if (t[0] == "border" && n == 2) {
+    if (!parseUnsigned(t[1], a))
+      return false;
+    cfg.borderThick = int(a);
+    return true;
+  }
+  if (t[0] == "drag" && n == 2) {
+    if (t[1] != "opaque" && t[1] != "outline")
+      return false;
+    cfg.dragOutline = t[1] == "outline";
+    return true;
+  }
+  if (t[0] == "focus" && (n == 2 || n == 3)) {
+    if (t[1] != "click" && t[1] != "mouse")
+      return false;
+    if (n == 3) {
+      if (!parseUnsigned(t[2], a) || a > 1000)
+        return false;
+      cfg.focusDelayMs = unsigned(a);
+    }
+    cfg.focusMouse = t[1] == "mouse";
+    return true;
+  }
+  if (t[0] == "bar" && n == 2) {
+    if (t[1] != "on" && t[1] != "off")
+      return false;
+    cfg.bar = t[1] == "on";
+    return true;
+  }
+  if (t[0] == "snap" && n == 2) {
+    if (!parseUnsigned(t[1], a))
+      return false;
+    cfg.snapDist = int(a);
+    return true;
+  }
+  if (t[0] == "layout" && (n == 2 || n == 3)) {
+    Layout l = Layout::LAST;
+    for (size_t i = 0; i < size_t(Layout::LAST); ++i)
+      if (t[1] == LayoutToString(Layout(i)))
+        l = Layout(i);
+    if (l == Layout::LAST)
+      return false;
+    if (n == 2) {
+      cfg.layout = l;
+      return true;
+    }
+    auto it = cfg.monitors.find(std::string(t[2]));
+    if (it == cfg.monitors.end())
+      return false;
+    it->second.layout = l;
+    return true;
+  }
+  if (t[0] == "record" && n == 4) {
+    unsigned long c;
+    if (!parseUnsigned(t[1], a) || !parseUnsigned(t[2], b) || !parseUnsigned(t[3], c) ||
+        a > 60 || b == 0 || c == 0)
+      return false;
+    cfg.recordFps = unsigned(a);
+    cfg.recordSecs = unsigned(b);
+    cfg.recordMegabytes = unsigned(c);
+    return true;
+  }
+  if (t[0] == "watchdog" && n == 2) {
+    if (!parseUnsigned(t[1], a))
+      return false;
+    cfg.watchdogMs = unsigned(a);
+    return true;
+  }
+  if (t[0] == "color" && n == 3) {
+    if (!parseUnsigned(t[2], a, 16))
+      return false;
+    if (t[1] == "background")           cfg.background = a;
+    else if (t[1] == "border-focus")    cfg.borderFocus = a;
+    else if (t[1] == "border-unfocus")  cfg.borderUnfocus = a;
+    else if (t[1] == "grid")            cfg.gridColor = a;
+    else if (t[1] == "grid-inactive")   cfg.gridInact = a;
+    else if (t[1] == "grid-background") cfg.gridBg = a;
+    else if (t[1] == "bar-background")  cfg.barBg = a;
+    else if (t[1] == "bar-foreground")  cfg.barFg = a;
+    else                                return false;
+    return true;
+  }
+  if (t[0] == "bind" && (n == 4 || n == 5)) {
+    if (!haveBindings) {
+      cfg.bindings.clear();
+      haveBindings = true;
+    }
+    Binding bind;
+    if (!parseMods(t[1], bind.mods))
+      return false;
+    bind.sym = XStringToKeysym(std::string(t[2]).c_str());
+    if (bind.sym == NoSymbol)
+      return false;
+    bind.action = Action::LAST;
+    for (size_t i = 0; i < size_t(Action::LAST); ++i)
+      if (t[3] == ACTION_NAMES[i])
+        bind.action = Action(i);
+    if (bind.action == Action::LAST)
+      return false;
+    if (isDirectional(bind.action) != (n == 5))
+      return false;
+    if (n == 5 && !parseDir(t[4], bind.dir))
+      return false;
+    cfg.bindings.push_back(bind);
+    return true;
+  }
+  return false;
+}
+
+} // namespace
+
+bool LoadConfig(const std::string& path, Config& cfg)
+{
+  Config next;
+  next.bindings = DefaultBindings();
+
+  FILE* f = fopen(path.c_str(), "r");
+  if (f == nullptr) {
+    LOG(WARN) << "no config file, using defaults path=(" << path << ")";
+    cfg = std::move(next);
+    return true;
+  }
+
+  std::string buf;
+  char chunk[4096];
+  size_t num;
+  while ((num = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    buf.append(chunk, num);
+  fclose(f);
+
+  bool haveBindings = false;
+  std::string_view rest(buf);
+  for (unsigned lineNo = 1; !rest.empty(); ++lineNo) {
+    auto nl = rest.find('\n');
+    auto line = rest.substr(0, nl);
+    rest = (nl == std::string_view::npos) ? std::string_view() : rest.substr(nl + 1);
+
+    if (!parseLine(line, next, haveBindings)) {
+      LOG(ERROR) << "invalid config path=(" << path << ") line=" << lineNo
+                 << " text=(" << line << ")";
+      return false;
+    }
+  }
+
+  LOG(INFO) << "loaded config path=(" << path << ")"
+            << " monitors=" << next.monitors.size()
+            << " bindings=" << next.bindings.size();
+  cfg = std::move(next);
+  return true;
+}
+
+std::vector<Binding> DefaultBindings()
+{
+  std::vector<Binding> b = {
+    { XK_D, NUMLOCK, Action::Close },
+    { XK_T, NUMLOCK, Action::Terminal },
+    { XK_M, NUMLOCK, Action::Maximize },
+    { XK_N, NUMLOCK, Action::Unmaximize },
+    { XK_G, NUMLOCK, Action::Grid },
+    { XK_S, NUMLOCK, Action::SnapGrid },
+    { XK_P, NUMLOCK, Action::Lock },
+    { XK_A, NUMLOCK, Action::Launcher },
+    { XK_O, NUMLOCK,               Action::Screenshot },
+    { XK_O, NUMLOCK | ShiftMask,   Action::ScreenshotMonitor },
+    { XK_O, NUMLOCK | ControlMask, Action::ScreenshotWindow },
+    { XK_Q, NUMLOCK, Action::VolumeUp },
+    { XK_W, NUMLOCK, Action::VolumeDown },
+    { XK_E, NUMLOCK, Action::VolumeMute },
+    { XK_R, NUMLOCK, Action::Restart },
+    { XK_Y, NUMLOCK, Action::CycleLayout },
+    { XK_R, NUMLOCK | ShiftMask, Action::RecordDump },
+
+    { XF86XK_AudioMute,        AnyModifier, Action::VolumeMute },
+    { XF86XK_AudioRaiseVolume, AnyModifier, Action::VolumeUp },
+    { XF86XK_AudioLowerVolume, AnyModifier, Action::VolumeDown },
+  };
+
+  const std::pair<KeySym, DIR> MOV_KEYS[] = {
+    { XK_H, DIR::Left }, { XK_J, DIR::Down }, { XK_K, DIR::Up }, { XK_L, DIR::Right },
+  };
+  for (const auto& [sym, dir] : MOV_KEYS) {
+    b.push_back({ sym, NUMLOCK,               Action::MoveFocus,    dir });
+    b.push_back({ sym, NUMLOCK | ShiftMask,   Action::MoveGridLoc,  dir });
+    b.push_back({ sym, NUMLOCK | ControlMask, Action::MoveGridSize, dir });
+    b.push_back({ sym, NUMLOCK | Mod1Mask,    Action::MoveMonitor,  dir });
+  }
+  return b;
+}
+
+const char* ActionToString(Action a)
+{
+  if (a >= Action::LAST)
+    return "Undefined";
+  return ACTION_NAMES[size_t(a)];
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "Geometry.hpp"
+#include "Layout.hpp"
+
+#include <X11/Xlib.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Config File
+///
+/// One directive per line, '#' starts a comment. Colors are hex (0xRRGGBB).
+///
+/// monitor <name> <screen> <connector> [gridX gridY]
+/// grid <x> <y>                          | Default grid for monitors without one
+/// color <what> <0xRRGGBB>               | background, border-focus, border-unfocus,
+///                                       | grid, grid-inactive, grid-background,
+///                                       | bar-background, bar-foreground
+/// border <px>
+/// drag <opaque|outline>                 | outline only moves the window on release
+/// snap <px>                             | Dragged edges jump to edges this close, 0 is off
+/// bar <on|off>                          | Status bar along the top of every monitor
+/// focus <click|mouse> [ms]              | mouse focuses what the pointer settles on for ms
+/// layout <float|tile|bsp> [monitor]     | Default layout, or one monitor's (declared above)
+/// record <fps> <seconds> <megabytes>    | Keep the last seconds of every monitor in memory
+/// watchdog <ms>                         | Log the stack of any event taking longer, 0 is off
+/// bind <mods> <keysym> <action> [dir]   | mods: numlock+shift+ctrl+alt+super or any
+///                                       | dir:  left, right, up, down
+///
+/// Any 'bind' line replaces the whole default binding table.
+
+enum class Action
+{
+  Terminal,
+  Close,
+  Maximize,
+  Unmaximize,
+  Grid,
+  SnapGrid,
+  Lock,
+  Launcher,
+  Screenshot,
+  ScreenshotMonitor,
+  ScreenshotWindow,
+  VolumeUp,
+  VolumeDown,
+  VolumeMute,
+  MoveFocus,
+  MoveGridLoc,
+  MoveGridSize,
+  MoveMonitor,
+  Restart,
+  CycleLayout,
+  RecordDump,
+  LAST
+};
+
+struct MonitorCfg
+{
+  std::string name;
+  int screen;
+  std::string connector;
+  unsigned gridX = 0; // 0 means use Config::gridX
+  unsigned gridY = 0;
+  Layout layout = Layout::LAST; // LAST means use Config::layout
+
+  bool sameOutput(const MonitorCfg& o) const
+  {
+    return name == o.name && screen == o.screen && connector == o.connector;
+  }
+};
+
+struct Binding
+{
+  KeySym sym;
+  unsigned mods;
+  Action action;
+  DIR dir = DIR::LAST;
+
+  bool operator==(const Binding& o) const
+  {
+    return sym == o.sym && mods == o.mods && action == o.action && dir == o.dir;
+  }
+};
+
+struct Config
+{
+  std::map<std::string, MonitorCfg> monitors;
+  std::vector<Binding> bindings;
+
+  unsigned long background    = 0x604020;
+  unsigned long borderFocus   = 0x005F87;
+  unsigned long borderUnfocus = 0x0C0C0C;
+  unsigned long gridColor     = 0x005F87;
+  unsigned long gridInact     = 0x880000;
+  unsigned long gridBg        = 0x181818;
+  unsigned long barBg         = 0x181818;
+  unsigned long barFg         = 0xB0B0B0;
+
+  int borderThick = 5;
+  int gridThick = 1;
+
+  unsigned gridX = 1;
+  unsigned gridY = 1;
+
+  bool dragOutline = false;
+  int snapDist = 12;
+
+  bool bar = false;
+
+  bool focusMouse = false;
+  unsigned focusDelayMs = 40;
+
+  Layout layout = Layout::Float;
+
+  unsigned recordFps = 0; // 0 means the recorder is off
+  unsigned recordSecs = 60;
+  unsigned recordMegabytes = 256;
+
+  unsigned watchdogMs = 500;
+
+  unsigned gridXFor(const MonitorCfg& m) const { return m.gridX ? m.gridX : gridX; }
+  unsigned gridYFor(const MonitorCfg& m) const { return m.gridY ? m.gridY : gridY; }
+  Layout layoutFor(const MonitorCfg& m) const { return m.layout != Layout::LAST ? m.layout : layout; }
+};
+
+/// Parses the config file at path into cfg, which is left untouched on failure.
+/// A missing file is not an error and yields the defaults.
+bool LoadConfig(const std::string& path, Config& cfg);
+
+/// Bindings used when the config file does not have any
+std::vector<Binding> DefaultBindings();
+
+const char* ActionToString(Action a);
@@ -0,0 +1,512 @@
+#include "DesktopIndex.hpp"
+
+#include <u/log.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// On-disk layout: Header, DirRec[numDirs], EntryRec[numEntries], then the
+/// string blob. Strings are offsets into the blob, entries are sorted by
+/// lowercased name so ties in match() come out alphabetical.
+struct DesktopIndex::Header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t numDirs;
+  uint32_t numEntries;
+  uint64_t stringBytes;
+};
+
+struct DesktopIndex::DirRec
+{
+  uint32_t path, pathLen;
+  int64_t mtime;
+};
+
+struct DesktopIndex::EntryRec
+{
+  uint32_t id, idLen;
+  uint32_t name, nameLen;
+  uint32_t lower, lowerLen;
+  uint32_t exec, execLen;
+  int64_t mtime;
+  uint32_t dir;
+  uint32_t terminal;
+};
+
+namespace {
+
+constexpr uint32_t INDEX_MAGIC = 0x6d776d44; // "mwmD"
+constexpr uint32_t INDEX_VERSION = 1;
+
+constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM;
+
+/// Nanoseconds, -1 when the path does not exist
+int64_t MTime(const std::string& path)
+{
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return -1;
+  return int64_t(st.st_mtim.tv_sec) * 1000000000 + int64_t(st.st_mtim.tv_nsec);
+}
+
+bool IsDesktopFile(std::string_view name)
+{
+  static constexpr std::string_view EXT = ".desktop";
+  return name.size() > EXT.size() && name.substr(name.size() - EXT.size()) == EXT;
+}
+
+std::string Lower(std::string_view s)
+{
+  std::string out(s);
+  for (auto& c : out)
+    c = char(tolower((unsigned char) c));
+  return out;
+}
+
+std::string_view Trim(std::string_view s)
+{
+  while (!s.empty() && isspace((unsigned char) s.front()))
+    s.remove_prefix(1);
+  while (!s.empty() && isspace((unsigned char) s.back()))
+    s.remove_suffix(1);
+  return s;
+}
+
+/// Drops the field codes (%f, %U, ...), nothing is ever passed to launch with
+std::string CleanExec(std::string_view exec)
+{
+  std::string out;
+  for (size_t i = 0; i < exec.size(); ++i) {
+    if (exec[i] != '%' || i + 1 == exec.size()) {
+      out += exec[i];
+      continue;
+    }
+    if (exec[++i] == '%')
+      out += '%';
+  }
+  return std::string(Trim(out));
+}
+
+/// $XDG_DATA_HOME then $XDG_DATA_DIRS, each with /applications
+std::vector<std::string> AppDirs()
+{
+  std::vector<std::string> dirs;
+  const char* home = getenv("HOME");
+  const char* dataHome = getenv("XDG_DATA_HOME");
+  if (dataHome != nullptr && *dataHome != '\0')
+    dirs.push_back(std::string(dataHome) + "/applications");
+  else if (home != nullptr)
+    dirs.push_back(std::string(home) + "/.local/share/applications");
+
+  const char* dataDirs = getenv("XDG_DATA_DIRS");
+  std::string_view rest = (dataDirs != nullptr && *dataDirs != '\0') ? dataDirs : "/usr/local/share:/usr/share";
+  while (!rest.empty()) {
+    size_t colon = rest.find(':');
+    std::string_view d = rest.substr(0, colon);
+    if (!d.empty() && std::find(begin(dirs), end(dirs), std::string(d) + "/applications") == end(dirs))
+      dirs.push_back(std::string(d) + "/applications");
+    rest = (colon == std::string_view::npos) ? std::string_view() : rest.substr(colon + 1);
+  }
+  return dirs;
+}
+
+} // namespace
+
+/// The [Desktop Entry] group only. False when the file should not be listed,
+/// which still shadows the same id in later directories.
+bool DesktopIndex::parse(const std::string& path, Parsed& p)
+{
+  std::ifstream in(path);
+  if (!in)
+    return false;
+
+  bool group = false, app = false, hidden = false;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    if (line[0] == '[') {
+      if (group)
+        break;
+      group = Trim(line) == "[Desktop Entry]";
+      continue;
+    }
+    size_t eq = line.find('=');
+    if (!group || eq == std::string::npos)
+      continue;
+
+    // Localized keys (Name[de]=...) never compare equal and are skipped
+    std::string_view key = Trim(std::string_view(line).substr(0, eq));
+    std::string_view val = Trim(std::string_view(line).substr(eq + 1));
+    if (key == "Type")
+      app = val == "Application";
+    else if (key == "Name")
+      p.name = val;
+    else if (key == "Exec")
+      p.exec = CleanExec(val);
+    else if (key == "Terminal")
+      p.terminal = val == "true";
+    else if (key == "NoDisplay" || key == "Hidden")
+      hidden |= val == "true";
+  }
+  return app && !hidden && !p.name.empty() && !p.exec.empty();
+}
+
+namespace {
+
+/// Higher is better, 0 is no match. q is already lowercase.
+int Score(std::string_view s, std::string_view q)
+{
+  if (q.empty())
+    return 1;
+
+  size_t pos = s.find(q);
+  if (pos == 0)
+    return 4000 - int(std::min<size_t>(s.size(), 999));
+  if (pos != std::string_view::npos) {
+    for (size_t p = pos; p != std::string_view::npos; p = s.find(q, p + 1))
+      if (!isalnum((unsigned char) s[p - 1]))
+        return 3000 - int(std::min<size_t>(p, 999));
+    return 2000 - int(std::min<size_t>(pos, 999));
+  }
+
+  // Every query character in order, tighter spans first
+  size_t j = 0, first = 0, last = 0;
+  for (size_t i = 0; i < s.size() && j < q.size(); ++i) {
+    if (s[i] != q[j])
+      continue;
+    if (j++ == 0)
+      first = i;
+    last = i;
+  }
+  if (j < q.size())
+    return 0;
+  return 1000 - int(std::min<size_t>(last - first, 999));
+}
+
+} // namespace
+
+DesktopIndex::~DesktopIndex()
+{
+  unmap();
+  if (_inotify >= 0)
+    close(_inotify);
+}
+
+std::string DesktopIndex::DefaultPath()
+{
+  const char* cache = getenv("XDG_CACHE_HOME");
+  if (cache != nullptr && *cache != '\0')
+    return std::string(cache) + "/mwm/desktop.idx";
+  const char* home = getenv("HOME");
+  return std::string(home ? home : "/tmp") + "/.cache/mwm/desktop.idx";
+}
+
+bool DesktopIndex::open(const std::string& path)
+{
+  auto start = std::chrono::steady_clock::now();
+  _path = path;
+  _dirs = AppDirs();
+
+  // Missing directories are not watched, creating one needs a restart
+  _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  for (size_t i = 0; i < _dirs.size() && _inotify >= 0; ++i)
+    inotify_add_watch(_inotify, _dirs[i].c_str(), WATCH_MASK);
+
+  Entries entries;
+  std::vector<bool> changed(_dirs.size(), true);
+  bool cached = map() && _numDirs == _dirs.size();
+  for (size_t i = 0; cached && i < _numDirs; ++i)
+    cached = str(_dirRecs[i].path, _dirRecs[i].pathLen) == _dirs[i];
+  if (cached) {
+    load(entries);
+    for (size_t i = 0; i < _dirs.size(); ++i)
+      changed[i] = MTime(_dirs[i]) != _dirRecs[i].mtime;
+  }
+
+  size_t numChanged = size_t(std::count(begin(changed), end(changed), true));
+  if (numChanged > 0) {
+    rescanDirs(changed, entries);
+    if (!write(entries))
+      return false;
+  }
+
+  LOG(INFO) << "desktop index ready path=(" << _path << ")"
+            << " entries=" << _numEntries
+            << " cached=" << cached
+            << " rescannedDirs=" << numChanged
+            << " ms=" << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return true;
+}
+
+void DesktopIndex::onChanged()
+{
+  alignas(inotify_event) char buf[4096];
+  std::set<std::string> ids;
+  bool overflow = false;
+  ssize_t len;
+  while ((len = read(_inotify, buf, sizeof(buf))) > 0) {
+    for (char* p = buf; p < buf + len; ) {
+      auto* ev = (inotify_event*) p;
+      if (ev->mask & IN_Q_OVERFLOW)
+        overflow = true;
+      else if (ev->len > 0 && IsDesktopFile(ev->name))
+        ids.insert(ev->name);
+      p += sizeof(inotify_event) + ev->len;
+    }
+  }
+  if (ids.empty() && !overflow)
+    return;
+
+  Entries entries;
+  load(entries);
+  if (overflow) {
+    rescanDirs(std::vector<bool>(_dirs.size(), true), entries);
+  } else {
+    for (const auto& id : ids)
+      resolve(id, entries);
+  }
+  write(entries);
+
+  LOG(INFO) << "desktop index updated files=" << ids.size()
+            << " overflow=" << overflow
+            << " entries=" << _numEntries;
+}
+
+DesktopIndex::Entry DesktopIndex::get(size_t i) const
+{
+  const EntryRec& e = _entries[i];
+  return Entry{str(e.name, e.nameLen), str(e.exec, e.execLen), e.terminal != 0};
+}
+
+void DesktopIndex::match(std::string_view query, size_t max, std::vector<uint32_t>& out) const
+{
+  const std::string q = Lower(Trim(query));
+  std::vector<std::pair<int, uint32_t>> hits;
+  for (size_t i = 0; i < _numEntries; ++i) {
+    int s = Score(str(_entries[i].lower, _entries[i].lowerLen), q);
+    if (s > 0)
+      hits.emplace_back(-s, uint32_t(i));
+  }
+
+  const size_t n = std::min(max, hits.size());
+  std::partial_sort(begin(hits), begin(hits) + long(n), end(hits));
+  out.clear();
+  for (size_t i = 0; i < n; ++i)
+    out.push_back(hits[i].second);
+}
+
+void DesktopIndex::load(Entries& entries) const
+{
+  for (size_t i = 0; i < _numEntries; ++i) {
+    const EntryRec& e = _entries[i];
+    Parsed p;
+    p.name = str(e.name, e.nameLen);
+    p.exec = str(e.exec, e.execLen);
+    p.terminal = e.terminal != 0;
+    p.dir = e.dir;
+    p.mtime = e.mtime;
+    entries.emplace(str(e.id, e.idLen), std::move(p));
+  }
+}
+
+void DesktopIndex::resolve(const std::string& id, Entries& entries) const
+{
+  // The first directory holding the id decides, listed or not
+  for (size_t d = 0; d < _dirs.size(); ++d) {
+    const std::string path = _dirs[d] + "/" + id;
+    int64_t mtime = MTime(path);
+    if (mtime < 0)
+      continue;
+
+    auto it = entries.find(id);
+    if (it != end(entries) && it->second.dir == d && it->second.mtime == mtime)
+      return;
+
+    Parsed p;
+    if (parse(path, p)) {
+      p.dir = uint32_t(d);
+      p.mtime = mtime;
+      entries[id] = std::move(p);
+    } else {
+      entries.erase(id);
+    }
+    return;
+  }
+  entries.erase(id);
+}
+
+void DesktopIndex::rescanDirs(const std::vector<bool>& changed, Entries& entries) const
+{
+  std::set<std::string> ids;
+  for (size_t d = 0; d < _dirs.size(); ++d) {
+    if (!changed[d])
+      continue;
+    if (DIR* dir = opendir(_dirs[d].c_str()); dir != nullptr) {
+      while (dirent* de = readdir(dir))
+        if (IsDesktopFile(de->d_name))
+          ids.insert(de->d_name);
+      closedir(dir);
+    }
+    // Removed files only show up as entries that came from this directory
+    for (const auto& [id, p] : entries)
+      if (p.dir == d)
+        ids.insert(id);
+  }
+  for (const auto& id : ids)
+    resolve(id, entries);
+}
+
+bool DesktopIndex::write(const Entries& entries)
+{
+  std::string strings;
+  auto add = [&] (std::string_view s, uint32_t& off, uint32_t& len) {
+    off = uint32_t(strings.size());
+    len = uint32_t(s.size());
+    strings.append(s);
+    strings += '\0';
+  };
+
+  std::vector<DirRec> dirs(_dirs.size());
+  for (size_t i = 0; i < _dirs.size(); ++i) {
+    add(_dirs[i], dirs[i].path, dirs[i].pathLen);
+    dirs[i].mtime = MTime(_dirs[i]);
+  }
+
+  std::vector<std::pair<std::string, const Entries::value_type*>> sorted;
+  for (const auto& e : entries)
+    sorted.emplace_back(Lower(e.second.name), &e);
+  std::sort(begin(sorted), end(sorted));
+
+  std::vector<EntryRec> recs(sorted.size());
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    const auto& [id, p] = *sorted[i].second;
+    EntryRec& r = recs[i];
+    add(id, r.id, r.idLen);
+    add(p.name, r.name, r.nameLen);
+    add(sorted[i].first, r.lower, r.lowerLen);
+    add(p.exec, r.exec, r.execLen);
+    r.mtime = p.mtime;
+    r.dir = p.dir;
+    r.terminal = p.terminal;
+  }
+
+  Header h{INDEX_MAGIC, INDEX_VERSION, uint32_t(dirs.size()), uint32_t(recs.size()), strings.size()};
+  std::string buf;
+  buf.append(reinterpret_cast<const char*>(&h), sizeof(h));
+  buf.append(reinterpret_cast<const char*>(dirs.data()), dirs.size() * sizeof(DirRec));
+  buf.append(reinterpret_cast<const char*>(recs.data()), recs.size() * sizeof(EntryRec));
+  buf.append(strings);
+
+  // Written aside and renamed, a crash never leaves a torn index behind
+  std::string dir = _path.substr(0, _path.rfind('/'));
+  mkdir(dir.substr(0, dir.rfind('/')).c_str(), 0700);
+  mkdir(dir.c_str(), 0700);
+  const std::string tmp = _path + ".tmp";
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  bool ok = fd >= 0 && ::write(fd, buf.data(), buf.size()) == ssize_t(buf.size());
+  if (fd >= 0)
+    close(fd);
+  ok = ok && rename(tmp.c_str(), _path.c_str()) == 0;
+
+  if (ok && map())
+    return true;
+
+  LOG(ERROR) << "unable to write desktop index path=(" << _path << ") errno=" << errno;
+  unmap();
+  _fallback = std::move(buf);
+  _map = _fallback.data();
+  _mapSize = _fallback.size();
+  _numDirs = dirs.size();
+  _numEntries = recs.size();
+  _dirRecs = reinterpret_cast<const DirRec*>(_map + sizeof(Header));
+  _entries = reinterpret_cast<const EntryRec*>(_dirRecs + _numDirs);
+  _strings = reinterpret_cast<const char*>(_entries + _numEntries);
+  _stringBytes = strings.size();
+  return true;
+}
+
+bool DesktopIndex::map()
+{
+  unmap();
+
+  int fd = ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+    close(fd);
+    return false;
+  }
+  const size_t size = size_t(st.st_size);
+  void* m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (m == MAP_FAILED)
+    return false;
+
+  Header h;
+  ::memcpy(&h, m, sizeof(h));
+  const size_t recBytes = size_t(h.numDirs) * sizeof(DirRec) + size_t(h.numEntries) * sizeof(EntryRec);
+  if (h.magic != INDEX_MAGIC || h.version != INDEX_VERSION ||
+      size != sizeof(Header) + recBytes + h.stringBytes) {
+    LOG(WARN) << "discarding stale desktop index path=(" << _path << ") version=" << h.version;
+    munmap(m, size);
+    return false;
+  }
+
+  _map = static_cast<const char*>(m);
+  _mapSize = size;
+  _numDirs = h.numDirs;
+  _numEntries = h.numEntries;
+  _dirRecs = reinterpret_cast<const DirRec*>(_map + sizeof(Header));
+  _entries = reinterpret_cast<const EntryRec*>(_dirRecs + _numDirs);
+  _strings = reinterpret_cast<const char*>(_entries + _numEntries);
+  _stringBytes = size_t(h.stringBytes);
+
+  // Checked once here so lookups can trust every offset
+  auto inBlob = [&] (uint32_t off, uint32_t len) { return size_t(off) + len < _stringBytes; };
+  bool valid = true;
+  for (size_t i = 0; i < _numDirs; ++i)
+    valid = valid && inBlob(_dirRecs[i].path, _dirRecs[i].pathLen);
+  for (size_t i = 0; i < _numEntries; ++i) {
+    const EntryRec& e = _entries[i];
+    valid = valid && inBlob(e.id, e.idLen) && inBlob(e.name, e.nameLen) &&
+            inBlob(e.lower, e.lowerLen) && inBlob(e.exec, e.execLen) && e.dir < _numDirs;
+  }
+  if (!valid) {
+    LOG(WARN) << "discarding corrupt desktop index path=(" << _path << ")";
+    unmap();
+  }
+  return valid;
+}
+
+void DesktopIndex::unmap()
+{
+  if (_map != nullptr && _map != _fallback.data())
+    munmap(const_cast<char*>(_map), _mapSize);
+  _fallback.clear();
+  _map = nullptr;
+  _mapSize = 0;
+  _dirRecs = nullptr;
+  _entries = nullptr;
+  _strings = nullptr;
+  _numDirs = _numEntries = _stringBytes = 0;
+}
+
+std::string_view DesktopIndex::str(uint32_t off, uint32_t len) const
+{
+  return std::string_view(_strings + off, len);
+}
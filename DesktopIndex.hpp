@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Applications from the XDG .desktop files, cached on disk as a binary
+/// index that is memory-mapped and queried in place.
+///
+/// Only files that changed are parsed again: at startup the directory mtimes
+/// stored in the index pick which directories to look at, afterwards inotify
+/// names the files. Package managers install by rename, which is what bumps
+/// a directory's mtime. Subdirectories of applications/ are not scanned.
+class DesktopIndex
+{
+  public:
+
+    struct Entry
+    {
+      std::string_view name;
+      std::string_view exec; // Field codes already removed
+      bool terminal;
+    };
+
+    DesktopIndex() = default;
+    ~DesktopIndex();
+    DesktopIndex(const DesktopIndex&) = delete;
+    DesktopIndex& operator=(const DesktopIndex&) = delete;
+
+    /// $XDG_CACHE_HOME/mwm/desktop.idx, or the ~/.cache equivalent
+    static std::string DefaultPath();
+
+    /// Maps the index at path, rescanning whatever changed since it was written
+    bool open(const std::string& path);
+
+    /// inotify descriptor to poll, call onChanged() when it is readable
+    int fd() const { return _inotify; }
+    void onChanged();
+
+    size_t size() const { return _numEntries; }
+    Entry get(size_t i) const;
+
+    /// Up to max entry indices matching query, best first. Name prefixes beat
+    /// word prefixes, then substrings, then fuzzy subsequences.
+    void match(std::string_view query, size_t max, std::vector<uint32_t>& out) const;
+
+  private:
+
+    struct Header;
+    struct DirRec;
+    struct EntryRec;
+
+    struct Parsed
+    {
+      std::string name;
+      std::string exec;
+      bool terminal = false;
+      uint32_t dir = 0;
+      int64_t mtime = 0;
+    };
+    using Entries = std::map<std::string, Parsed>; // By desktop file id
+
+    static bool parse(const std::string& path, Parsed& p);
+    void load(Entries& entries) const;
+    void resolve(const std::string& id, Entries& entries) const;
+    void rescanDirs(const std::vector<bool>& changed, Entries& entries) const;
+    bool write(const Entries& entries);
+    bool map();
+    void unmap();
+    std::string_view str(uint32_t off, uint32_t len) const;
+
+    std::string _path;
+    std::vector<std::string> _dirs; // Search order, earlier dirs shadow later ones
+    int _inotify = -1;
+
+    const char* _map = nullptr;
+    size_t _mapSize = 0;
+    std::string _fallback;          // Holds the index when it could not be written
+    const DirRec* _dirRecs = nullptr;
+    const EntryRec* _entries = nullptr;
+    size_t _numDirs = 0;
+    size_t _numEntries = 0;
+    const char* _strings = nullptr;
+    size_t _stringBytes = 0;
+};
@@ -0,0 +1,87 @@
+#include "ErrorLog.hpp"
+
+#include "AllocStats.hpp"
+#include "Geometry.hpp"
+#include "XUtils.hpp"
+
+#include <u/log.hpp>
+
+void ErrorLog::install(Display* disp)
+{
+  _disp = disp;
+  XSetErrorHandler(&ErrorLog::onError);
+}
+
+void ErrorLog::mark(const char* what)
+{
+  if (_disp == nullptr)
+    return;
+  // Consecutive marks with nothing sent in between collapse into one
+  Mark& last = _marks[(_nextMark - 1) & (MARKS - 1)];
+  const unsigned long serial = NextRequest(_disp);
+  if (_nextMark > 0 && last.serial == serial) {
+    last.what = what;
+    return;
+  }
+  _marks[_nextMark++ & (MARKS - 1)] = { serial, what };
+}
+
+const char* ErrorLog::owner(unsigned long serial)
+{
+  // Newest mark at or before the serial, if it's still in the ring
+  for (size_t i = 0; i < MARKS && i < _nextMark; ++i) {
+    const Mark& m = _marks[(_nextMark - 1 - i) & (MARKS - 1)];
+    if (m.serial <= serial)
+      return m.what;
+  }
+  return "unknown";
+}
+
+int ErrorLog::onError(Display* disp, XErrorEvent* e)
+{
+  // Marks belong to the event thread, only its connection can use them
+  const char* what = (disp == _disp) ? owner(e->serial) : "other-connection";
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (size_t i = 0; i < _numCounts; ++i) {
+    Count& c = _counts[i];
+    if (c.what == what && c.code == e->error_code && c.request == e->request_code && c.minor == e->minor_code) {
+      c.count++;
+      return 0;
+    }
+  }
+  if (_numCounts == COUNTS) {
+    _uncounted++;
+    return 0;
+  }
+  _counts[_numCounts++] = { what, e->error_code, e->request_code, e->minor_code, 1 };
+
+  // First of its kind, the only one formatted
+  char buf[256];
+  XGetErrorText(disp, e->error_code, buf, sizeof(buf));
+  HOT_LOG(ERROR) << "X ERROR"
+             << " display=" << DisplayString(disp)
+             << " handler=" << what
+             << " serial=" << e->serial
+             << " resource=" << e->resourceid
+             << " majorOpcode=" << XOpcodeToString(e->request_code)
+             << " minorOpcode=" << (int) e->minor_code
+             << " what=(" << buf << ")"
+             << " (repeats are only counted)";
+  return 0;
+}
+
+void ErrorLog::report()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (size_t i = 0; i < _numCounts; ++i) {
+    const Count& c = _counts[i];
+    LOG(INFO) << "X errors handler=" << c.what
+              << " code=" << (int) c.code
+              << " majorOpcode=" << XOpcodeToString(c.request)
+              << " minorOpcode=" << (int) c.minor
+              << " count=" << c.count;
+  }
+  if (_uncounted > 0)
+    LOG(INFO) << "X errors uncounted=" << _uncounted;
+}
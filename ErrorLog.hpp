@@ -0,0 +1,58 @@
+#pragma once
+
+#include <X11/Xlib.h>
+
+#include <cstdint>
+#include <mutex>
+
+/// X errors, matched by serial to the handler whose request failed. Each
+/// handler, error code and request combination is formatted and logged the
+/// first time only, after that it is just counted. report() logs the totals.
+///
+/// Handlers mark where their requests start, marks are only ever made from
+/// the event thread on the event connection.
+class ErrorLog
+{
+  public:
+
+    /// Becomes the Xlib error handler, disp is the event connection
+    static void install(Display* disp);
+
+    /// Requests from the next one on belong to what, a literal or static
+    /// table entry
+    static void mark(const char* what);
+
+    static void report();
+
+  private:
+
+    static int onError(Display* disp, XErrorEvent* e);
+    static const char* owner(unsigned long serial);
+
+    struct Mark
+    {
+      unsigned long serial;
+      const char* what;
+    };
+
+    struct Count
+    {
+      const char* what;
+      unsigned char code;
+      unsigned char request;
+      unsigned char minor;
+      uint64_t count;
+    };
+
+    static constexpr size_t MARKS = 64;  // Power of two
+    static constexpr size_t COUNTS = 64;
+
+    inline static Display* _disp = nullptr;
+    inline static Mark _marks[MARKS] = {};
+    inline static size_t _nextMark = 0;
+
+    inline static std::mutex _mutex; // Other connections report from their own threads
+    inline static Count _counts[COUNTS] = {};
+    inline static size_t _numCounts = 0;
+    inline static uint64_t _uncounted = 0; // Past COUNTS kinds
+};
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Flat Map
+///
+/// Values live contiguously in one vector, so iterating is a linear scan.
+/// Lookups go through an open-addressing table of indices (linear probing,
+/// backward-shift deletion, no tombstones), keys are hashed by Fibonacci
+/// multiplication which spreads the sequential ids X hands out.
+///
+/// Erasing moves the last element into the hole: iterators, pointers and
+/// references are invalidated by any insert or erase, as is the order. A
+/// Handle stays valid until its own element is erased.
+///
+/// Enough of the std::map interface for it to be a drop-in where ordering
+/// doesn't matter.
+
+template<typename K, typename V>
+class FlatMap
+{
+  public:
+
+    using value_type = std::pair<K, V>;
+    using iterator = typename std::vector<value_type>::iterator;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+    /// Generation-checked reference to one element
+    struct Handle
+    {
+      uint32_t slot = NPOS;
+      uint32_t gen = 0;
+    };
+
+    iterator begin() { return _dense.begin(); }
+    iterator end() { return _dense.end(); }
+    const_iterator begin() const { return _dense.begin(); }
+    const_iterator end() const { return _dense.end(); }
+
+    // Found by ADL, so end(m) reads the same as it does for std::map
+    friend iterator begin(FlatMap& m) { return m.begin(); }
+    friend iterator end(FlatMap& m) { return m.end(); }
+    friend const_iterator begin(const FlatMap& m) { return m.begin(); }
+    friend const_iterator end(const FlatMap& m) { return m.end(); }
+
+    size_t size() const { return _dense.size(); }
+    bool empty() const { return _dense.empty(); }
+
+    void clear()
+    {
+      for (uint32_t slot : _denseSlot) {
+        _slots[slot].gen++;
+        _free.push_back(slot);
+      }
+      _dense.clear();
+      _denseSlot.clear();
+      _table.assign(_table.size(), NPOS);
+    }
+
+    /// Room for n elements without reallocating or rehashing
+    void reserve(size_t n)
+    {
+      _dense.reserve(n);
+      _denseSlot.reserve(n);
+      _slots.reserve(n);
+      _free.reserve(n);
+      size_t capacity = 16;
+      while (capacity < n * 2)
+        capacity *= 2;
+      if (capacity > _table.size())
+        rehash(capacity);
+    }
+
+    iterator find(const K& k)
+    {
+      uint32_t i = lookup(k);
+      return (i == NPOS) ? end() : begin() + i;
+    }
+
+    const_iterator find(const K& k) const
+    {
+      uint32_t i = lookup(k);
+      return (i == NPOS) ? end() : begin() + i;
+    }
+
+    size_t count(const K& k) const { return lookup(k) != NPOS; }
+
+    V& at(const K& k)
+    {
+      uint32_t i = lookup(k);
+      if (i == NPOS)
+        throw std::out_of_range("FlatMap::at");
+      return _dense[i].second;
+    }
+
+    const V& at(const K& k) const
+    {
+      uint32_t i = lookup(k);
+      if (i == NPOS)
+        throw std::out_of_range("FlatMap::at");
+      return _dense[i].second;
+    }
+
+    /// Like std::map, an existing key is left alone and returned
+    std::pair<iterator, bool> insert(value_type v)
+    {
+      if (uint32_t i = lookup(v.first); i != NPOS)
+        return { begin() + i, false };
+
+      if ((_dense.size() + 1) * 2 > _table.size())
+        rehash(_table.empty() ? 16 : _table.size() * 2);
+
+      const uint32_t idx = uint32_t(_dense.size());
+      uint32_t slot;
+      if (_free.empty()) {
+        slot = uint32_t(_slots.size());
+        _slots.push_back({idx, 0});
+      } else {
+        slot = _free.back();
+        _free.pop_back();
+        _slots[slot].dense = idx;
+      }
+      _denseSlot.push_back(slot);
+      _dense.push_back(std::move(v));
+      place(idx);
+      return { begin() + idx, true };
+    }
+
+    iterator erase(iterator it)
+    {
+      const uint32_t idx = uint32_t(it - begin());
+      unlink(probe(it->first));
+
+      _slots[_denseSlot[idx]].gen++;
+      _free.push_back(_denseSlot[idx]);
+
+      // The last element fills the hole, its table entry follows it
+      const uint32_t last = uint32_t(_dense.size() - 1);
+      if (idx != last) {
+        _table[probe(_dense[last].first)] = idx;
+        _dense[idx] = std::move(_dense[last]);
+        _denseSlot[idx] = _denseSlot[last];
+        _slots[_denseSlot[idx]].dense = idx;
+      }
+      _dense.pop_back();
+      _denseSlot.pop_back();
+      return begin() + idx;
+    }
+
+    size_t erase(const K& k)
+    {
+      auto it = find(k);
+      if (it == end())
+        return 0;
+      erase(it);
+      return 1;
+    }
+
+    Handle handle(const_iterator it) const
+    {
+      uint32_t slot = _denseSlot[size_t(it - begin())];
+      return { slot, _slots[slot].gen };
+    }
+
+    /// nullptr once the element is gone
+    V* get(Handle h)
+    {
+      if (h.slot >= _slots.size() || _slots[h.slot].gen != h.gen)
+        return nullptr;
+      return &_dense[_slots[h.slot].dense].second;
+    }
+
+    const V* get(Handle h) const
+    {
+      if (h.slot >= _slots.size() || _slots[h.slot].gen != h.gen)
+        return nullptr;
+      return &_dense[_slots[h.slot].dense].second;
+    }
+
+    /// Empty handle, get() gives nullptr, when k is absent
+    Handle handle(const K& k) const
+    {
+      uint32_t i = lookup(k);
+      return (i == NPOS) ? Handle() : Handle{ _denseSlot[i], _slots[_denseSlot[i]].gen };
+    }
+
+  private:
+
+    static constexpr uint32_t NPOS = UINT32_MAX;
+
+    struct Slot
+    {
+      uint32_t dense;
+      uint32_t gen;
+    };
+
+    size_t home(const K& k) const
+    {
+      return size_t((uint64_t(k) * 0x9E3779B97F4A7C15ull) >> 32) & (_table.size() - 1);
+    }
+
+    /// Dense index of k, NPOS when absent
+    uint32_t lookup(const K& k) const
+    {
+      if (_table.empty())
+        return NPOS;
+      for (size_t h = home(k); _table[h] != NPOS; h = (h + 1) & (_table.size() - 1))
+        if (_dense[_table[h]].first == k)
+          return _table[h];
+      return NPOS;
+    }
+
+    /// Table position of a key that is present
+    size_t probe(const K& k) const
+    {
+      size_t h = home(k);
+      while (_dense[_table[h]].first != k)
+        h = (h + 1) & (_table.size() - 1);
+      return h;
+    }
+
+    void place(uint32_t idx)
+    {
+      size_t h = home(_dense[idx].first);
+      while (_table[h] != NPOS)
+        h = (h + 1) & (_table.size() - 1);
+      _table[h] = idx;
+    }
+
+    /// Backward-shift deletion, later entries of the run move up so lookups
+    /// never need tombstones
+    void unlink(size_t hole)
+    {
+      const size_t mask = _table.size() - 1;
+      _table[hole] = NPOS;
+      for (size_t h = (hole + 1) & mask; _table[h] != NPOS; h = (h + 1) & mask) {
+        size_t want = home(_dense[_table[h]].first);
+        // Stays put if its home lies cyclically in (hole, h]
+        bool stays = (hole < h) ? (hole < want && want <= h) : (hole < want || want <= h);
+        if (stays)
+          continue;
+        _table[hole] = _table[h];
+        _table[h] = NPOS;
+        hole = h;
+      }
+    }
+
+    void rehash(size_t capacity)
+    {
+      _table.assign(capacity, NPOS);
+      for (uint32_t i = 0; i < _dense.size(); ++i)
+        place(i);
+    }
+
+    std::vector<value_type> _dense;
+    std::vector<uint32_t> _denseSlot; // Parallel to _dense
+    std::vector<Slot> _slots;         // Handle slot -> dense index
+    std::vector<uint32_t> _free;      // Unused slots
+    std::vector<uint32_t> _table;     // Dense indices, NPOS when empty
+};
@@ -1,11 +1,20 @@
 #pragma once
 
+#include "FlatMap.hpp"
+
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
 #include <climits>
+#include <cstddef>
 #include <stdexcept>
 #include <vector>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MWM_GEOM_X86 1
+#endif
+
 enum class DIR
 {
   Up,
@@ -46,6 +55,18 @@ struct Rect
   bool  operator==(const Rect& o) const;
 };
 
+/// Client size constraints, as given by WM_NORMAL_HINTS
+struct SizeHints
+{
+  int baseW = 0, baseH = 0;
+  int incW = 1, incH = 1;
+  int minW = 1, minH = 1;
+  int maxW = INT_MAX, maxH = INT_MAX;
+  bool userPos = false; // USPosition, the user picked where it goes
+
+  void constrain(int& w, int& h) const;
+};
+
 /// Point //////////////////////////////////////////////////////////////////////
 
 inline double Point::getDist(const Point& o) const
@@ -120,53 +141,826 @@ inline bool Rect::operator==(const Rect& b) const
   return o == b.o && w == b.w && h == b.h;
 }
 
-/// Misc ///////////////////////////////////////////////////////////////////////
+/// SizeHints //////////////////////////////////////////////////////////////////
 
-template<typename T>
-inline T closestRectFromPoint(const Point& p, const std::vector<std::pair<Rect, T>>& rects)
-{
-  const T* closest = nullptr;
-  double minDist = DBL_MAX;
-  for (const auto& r : rects) {
-    Point o = r.first.getCenter();
-    int vertDist = std::min(p.getDist(o, DIR::Up),   p.getDist(o, DIR::Down));
-    int horzDist = std::min(p.getDist(o, DIR::Left), p.getDist(o, DIR::Right));
-    auto dist = sqrt((vertDist*vertDist) + (horzDist*horzDist));
-    if (dist < minDist) {
-      minDist = dist;
-      closest = &(r.second);
+inline void SizeHints::constrain(int& w, int& h) const
+{
+  w = std::min(std::max(w, minW), maxW);
+  h = std::min(std::max(h, minH), maxH);
+
+  // Snap down to a whole number of increments above the base size
+  if (incW > 1 && w > baseW)
+    w = baseW + ((w - baseW) / incW) * incW;
+  if (incH > 1 && h > baseH)
+    h = baseH + ((h - baseH) / incH) * incH;
+
+  w = std::max(w, minW);
+  h = std::max(h, minH);
+}
+
+/// Grid Snapping //////////////////////////////////////////////////////////////
+
+/// Where a rect lands when snapped to a monitor's grid. The size is the outer
+/// size (border included), full means it covers every cell.
+struct GridSnap
+{
+  Point center;
+  int w, h;
+  bool full;
+};
+
+/// Rounds r's size to whole cells and moves its center to the nearest cell
+/// boundary that fits that many cells
+inline GridSnap SnapToGrid(const Rect& mon, unsigned gridX, unsigned gridY, const Rect& r)
+{
+  Point c = r.getCenter();
+  double gridW = double(mon.w) / gridX;
+  double gridH = double(mon.h) / gridY;
+  auto xNum = std::min(gridX, std::max(1u, (unsigned) round(double(r.w) / gridW)));
+  auto yNum = std::min(gridY, std::max(1u, (unsigned) round(double(r.h) / gridH)));
+
+  GridSnap snap;
+  snap.w = int(xNum * gridW);
+  snap.h = int(yNum * gridH);
+  snap.full = xNum == gridX && yNum == gridY;
+
+  // Candidate centers are k half-cells in, k stepping over odd/even with the span
+  auto closest = [] (int origin, int p, double cell, unsigned num, unsigned grid) {
+    int best = origin;
+    int minDist = INT_MAX;
+    for (unsigned j = 1, k = num; j <= (grid - num) + 1; ++j, k += 2) {
+      auto gridCen = origin + int(k*(cell/2));
+      auto dist = abs(p - gridCen);
+      if (dist < minDist) {
+        minDist = dist;
+        best = gridCen;
+      }
+    }
+    return best;
+  };
+  snap.center = Point(closest(mon.o.x, c.x, gridW, xNum, gridX),
+                      closest(mon.o.y, c.y, gridH, yNum, gridY));
+  return snap;
+}
+
+/// Free Space /////////////////////////////////////////////////////////////////
+
+/// Finds the largest empty rect in an area around a set of used rects. A sweep
+/// down the used rects' top and bottom edges keeps candidates: x spans that
+/// have been free since some top. A used rect starting across a candidate ends
+/// it there and splits it around the rect, a used rect ending opens the free
+/// run it leaves behind. Every maximal empty rect is contained in one of the
+/// rects ended this way, and candidates narrower than asked for are dropped,
+/// so the work follows the free space rather than the square of the windows.
+/// Coverage per column lives in a segment tree. Buffers keep their capacity
+/// from one call to the next, reserve() sizes them up front.
+class FreeSpace
+{
+  public:
+
+    /// Room for this many used rects without allocating
+    void reserve(size_t rects);
+
+    /// Largest empty rect in area at least minW x minH, false if none fits.
+    /// Ties go to the one ending highest, then leftmost.
+    bool largest(const Rect& area, const std::vector<Rect>& used, int minW, int minH, Rect& out);
+
+  private:
+
+    struct Event
+    {
+      int y;
+      int x0, x1; // Edges, then columns once the edges are compressed
+      bool start;
+      bool operator<(const Event& o) const { return y < o.y; }
+    };
+
+    /// Columns l..r-1 have been free since top
+    struct Cand
+    {
+      size_t l, r;
+      int top;
+    };
+
+    void addCand(std::vector<Cand>& cands, size_t l, size_t r, int top, int minW);
+    void openRuns(size_t l, size_t r, int top, int minW);
+
+    // Coverage count per column, padding past the last column counts as used.
+    // A node's min and max include its own pending add, not its ancestors'.
+    void resetCover(size_t cols);
+    void addCover(size_t node, size_t lo, size_t hi, size_t l, size_t r, int v);
+    size_t firstFree(size_t node, size_t lo, size_t hi, size_t p, int acc) const;
+    size_t firstUsed(size_t node, size_t lo, size_t hi, size_t p, int acc) const;
+    size_t lastUsed(size_t node, size_t lo, size_t hi, size_t p, int acc) const;
+
+    static constexpr size_t NONE = size_t(-1);
+
+    std::vector<int> _xs;         // Distinct edges inside the area, sorted
+    std::vector<Event> _events;   // Clipped used rects' top and bottom edges
+    std::vector<Cand> _cands, _next;
+    size_t _size = 0;             // Leaves, a power of two
+    std::vector<int> _min, _max, _add;
+};
+
+inline void FreeSpace::reserve(size_t rects)
+{
+  size_t leaves = 1;
+  while (leaves < 2 * rects + 2)
+    leaves *= 2;
+  _xs.reserve(2 * rects + 2);
+  _events.reserve(2 * rects);
+  _cands.reserve(4 * rects + 4);
+  _next.reserve(4 * rects + 4);
+  _min.reserve(2 * leaves);
+  _max.reserve(2 * leaves);
+  _add.reserve(2 * leaves);
+}
+
+inline bool FreeSpace::largest(const Rect& area, const std::vector<Rect>& used, int minW, int minH, Rect& out)
+{
+  const int ax0 = area.o.x, ay0 = area.o.y, ax1 = area.o.x + area.w, ay1 = area.o.y + area.h;
+  _xs.clear();
+  _xs.push_back(ax0);
+  _xs.push_back(ax1);
+  _events.clear();
+  for (const auto& r : used) {
+    if (r.o.x >= ax1 || r.o.y >= ay1 || r.o.x + r.w <= ax0 || r.o.y + r.h <= ay0)
+      continue;
+    const int x0 = std::max(r.o.x, ax0), x1 = std::min(r.o.x + r.w, ax1);
+    _xs.push_back(x0);
+    _xs.push_back(x1);
+    _events.push_back({ std::max(r.o.y, ay0), x0, x1, true });
+    _events.push_back({ std::min(r.o.y + r.h, ay1), x0, x1, false });
+  }
+  std::sort(_xs.begin(), _xs.end());
+  _xs.erase(std::unique(_xs.begin(), _xs.end()), _xs.end());
+  for (auto& e : _events) {
+    e.x0 = int(std::lower_bound(_xs.begin(), _xs.end(), e.x0) - _xs.begin());
+    e.x1 = int(std::lower_bound(_xs.begin(), _xs.end(), e.x1) - _xs.begin());
+  }
+  std::sort(_events.begin(), _events.end());
+
+  const size_t cols = _xs.size() - 1;
+
+  long bestArea = 0;
+  auto close = [&] (const Cand& c, int bottom) {
+    const int x = _xs[c.l], w = _xs[c.r] - x, h = bottom - c.top;
+    const long a = long(w) * h;
+    if (w < minW || h < minH || a == 0 || a < bestArea)
+      return;
+    if (a == bestArea && (bottom > out.o.y + out.h || (bottom == out.o.y + out.h && x >= out.o.x)))
+      return;
+    bestArea = a;
+    out = Rect(x, c.top, w, h);
+  };
+
+  resetCover(cols);
+  _cands.clear();
+  if (_events.empty() || _events.front().y > ay0)
+    addCand(_cands, 0, cols, ay0, minW);
+
+  for (size_t i = 0; i < _events.size() && _events[i].y < ay1; ) {
+    const int y = _events[i].y;
+    size_t j = i;
+    for (; j < _events.size() && _events[j].y == y; ++j) {
+      const Event& e = _events[j];
+      if (!e.start)
+        continue;
+
+      // Candidates reaching into the new rect end on its top
+      const size_t x0 = size_t(e.x0), x1 = size_t(e.x1);
+      _next.clear();
+      for (const Cand& c : _cands) {
+        if (c.r <= x0 || c.l >= x1) {
+          _next.push_back(c);
+          continue;
+        }
+        close(c, y);
+        if (c.l < x0)
+          addCand(_next, c.l, x0, c.top, minW);
+        if (c.r > x1)
+          addCand(_next, x1, c.r, c.top, minW);
+      }
+      _cands.swap(_next);
     }
+
+    for (size_t k = i; k < j; ++k)
+      addCover(1, 0, _size, size_t(_events[k].x0), size_t(_events[k].x1), _events[k].start ? 1 : -1);
+
+    // What the ended rects leave free opens from here, with the area's own
+    // top when something starts right on it
+    if (y == ay0)
+      openRuns(0, cols, y, minW);
+    for (size_t k = i; k < j; ++k)
+      if (!_events[k].start)
+        openRuns(size_t(_events[k].x0), size_t(_events[k].x1), y, minW);
+    i = j;
   }
-  return closest ? *closest : T();
+
+  for (const Cand& c : _cands)
+    close(c, ay1);
+  return bestArea > 0;
 }
 
-template<typename T>
-inline T getNextPointInDir(DIR dir, const Point& c, const std::vector<std::pair<Point, T>>& points)
+inline void FreeSpace::addCand(std::vector<Cand>& cands, size_t l, size_t r, int top, int minW)
 {
-  if (dir == DIR::LAST)
-    return 0;
+  if (_xs[r] - _xs[l] < minW)
+    return;
+  // The same span free since earlier holds anything the later one would
+  for (Cand& c : cands) {
+    if (c.l == l && c.r == r) {
+      c.top = std::min(c.top, top);
+      return;
+    }
+  }
+  cands.push_back({ l, r, top });
+}
+
+inline void FreeSpace::openRuns(size_t l, size_t r, int top, int minW)
+{
+  // Each free run touching l..r-1, widened to where coverage starts again
+  for (size_t p = firstFree(1, 0, _size, l, 0); p < r; p = firstFree(1, 0, _size, p, 0)) {
+    const size_t before = (p == 0) ? NONE : lastUsed(1, 0, _size, p, 0);
+    const size_t runL = (before == NONE) ? 0 : before + 1;
+    p = firstUsed(1, 0, _size, p, 0);
+    addCand(_cands, runL, p, top, minW);
+  }
+}
+
+inline void FreeSpace::resetCover(size_t cols)
+{
+  // One padding leaf at least, so every free run ends on a used column
+  _size = 1;
+  while (_size < cols + 1)
+    _size *= 2;
+  _min.assign(2 * _size, 0);
+  _max.assign(2 * _size, 0);
+  _add.assign(2 * _size, 0);
+  for (size_t i = cols; i < _size; ++i)
+    _min[_size + i] = _max[_size + i] = _add[_size + i] = 1;
+  for (size_t n = _size - 1; n > 0; --n) {
+    _min[n] = std::min(_min[2 * n], _min[2 * n + 1]);
+    _max[n] = std::max(_max[2 * n], _max[2 * n + 1]);
+  }
+}
+
+inline void FreeSpace::addCover(size_t node, size_t lo, size_t hi, size_t l, size_t r, int v)
+{
+  if (r <= lo || hi <= l)
+    return;
+  if (l <= lo && hi <= r) {
+    _add[node] += v;
+    _min[node] += v;
+    _max[node] += v;
+    return;
+  }
+  const size_t mid = (lo + hi) / 2;
+  addCover(2 * node, lo, mid, l, r, v);
+  addCover(2 * node + 1, mid, hi, l, r, v);
+  _min[node] = _add[node] + std::min(_min[2 * node], _min[2 * node + 1]);
+  _max[node] = _add[node] + std::max(_max[2 * node], _max[2 * node + 1]);
+}
+
+inline size_t FreeSpace::firstFree(size_t node, size_t lo, size_t hi, size_t p, int acc) const
+{
+  if (hi <= p || _min[node] + acc > 0)
+    return NONE;
+  if (hi - lo == 1)
+    return lo;
+  const size_t mid = (lo + hi) / 2;
+  acc += _add[node];
+  const size_t found = firstFree(2 * node, lo, mid, p, acc);
+  return found != NONE ? found : firstFree(2 * node + 1, mid, hi, p, acc);
+}
+
+inline size_t FreeSpace::firstUsed(size_t node, size_t lo, size_t hi, size_t p, int acc) const
+{
+  if (hi <= p || _max[node] + acc <= 0)
+    return NONE;
+  if (hi - lo == 1)
+    return lo;
+  const size_t mid = (lo + hi) / 2;
+  acc += _add[node];
+  const size_t found = firstUsed(2 * node, lo, mid, p, acc);
+  return found != NONE ? found : firstUsed(2 * node + 1, mid, hi, p, acc);
+}
+
+inline size_t FreeSpace::lastUsed(size_t node, size_t lo, size_t hi, size_t p, int acc) const
+{
+  if (lo >= p || _max[node] + acc <= 0)
+    return NONE;
+  if (hi - lo == 1)
+    return lo;
+  const size_t mid = (lo + hi) / 2;
+  acc += _add[node];
+  const size_t found = lastUsed(2 * node + 1, mid, hi, p, acc);
+  return found != NONE ? found : lastUsed(2 * node, lo, mid, p, acc);
+}
+
+/// Edge Snapping //////////////////////////////////////////////////////////////
+
+/// Sorted x and y edges to snap to. Filled with add() then sort(), after that
+/// each lookup is a binary search.
+class EdgeIndex
+{
+  public:
+
+    void clear() { _xs.clear(); _ys.clear(); }
+    void reserve(size_t rects) { _xs.reserve(2 * rects); _ys.reserve(2 * rects); }
+
+    /// All four edges of r
+    void add(const Rect& r);
+    void sort();
+
+    /// Offset from v to the closest edge within dist, false if there is none
+    bool snapX(int v, int dist, int& delta) const { return snap(_xs, v, dist, delta); }
+    bool snapY(int v, int dist, int& delta) const { return snap(_ys, v, dist, delta); }
+
+  private:
+
+    static bool snap(const std::vector<int>& edges, int v, int dist, int& delta);
+
+    std::vector<int> _xs, _ys;
+};
+
+inline void EdgeIndex::add(const Rect& r)
+{
+  _xs.push_back(r.o.x);
+  _xs.push_back(r.o.x + r.w);
+  _ys.push_back(r.o.y);
+  _ys.push_back(r.o.y + r.h);
+}
+
+inline void EdgeIndex::sort()
+{
+  std::sort(_xs.begin(), _xs.end());
+  _xs.erase(std::unique(_xs.begin(), _xs.end()), _xs.end());
+  std::sort(_ys.begin(), _ys.end());
+  _ys.erase(std::unique(_ys.begin(), _ys.end()), _ys.end());
+}
+
+inline bool EdgeIndex::snap(const std::vector<int>& edges, int v, int dist, int& delta)
+{
+  auto it = std::lower_bound(edges.begin(), edges.end(), v);
+  int best = INT_MAX;
+  if (it != edges.end())
+    best = *it - v;
+  if (it != edges.begin() && v - *(it - 1) < std::abs(best))
+    best = *(it - 1) - v;
+  if (best == INT_MAX || std::abs(best) > dist)
+    return false;
+  delta = best;
+  return true;
+}
+
+/// Geometry Kernels ///////////////////////////////////////////////////////////
+///
+/// Batch queries over structure-of-arrays coordinates. Every variant returns
+/// the same index as the scalar one: distances are computed exactly in double
+/// and the first candidate wins ties. NPOS means nothing matched.
+
+constexpr size_t GEOM_NPOS = size_t(-1);
+
+enum class SimdLevel
+{
+  Scalar,
+  SSE2,
+  AVX2,
+  LAST
+};
+
+struct GeomKernels
+{
+  /// Closest (cx[i], cy[i]) to (px, py) by euclidean distance, skipping index skip
+  size_t (*nearest)(const int* cx, const int* cy, size_t n, int px, int py, size_t skip);
+
+  /// Closest candidate strictly ahead along the 'along' axis, where ahead means
+  /// sign * (along[i] - ca) > 0. Distance is (int) sqrt(ahead^2 + 4 * across^2).
+  size_t (*inDir)(const int* along, const int* across, size_t n, int ca, int cx, int sign, size_t skip);
+
+  /// First rect with x0 <= px <= x1 and y0 <= py <= y1
+  size_t (*containing)(const int* x0, const int* y0, const int* x1, const int* y1, size_t n, int px, int py);
+};
 
-  T closest = 0;
-  int minDist = INT_MAX;
+namespace geom_detail {
 
-  for (auto& p : points) {
-    int plelDist = c.getDist(p.first, dir);
-    if (plelDist == INT_MAX || plelDist == 0)
+inline size_t NearestScalar(const int* cx, const int* cy, size_t n, int px, int py, size_t skip)
+{
+  size_t best = GEOM_NPOS;
+  double bestD = DBL_MAX;
+  for (size_t i = 0; i < n; ++i) {
+    if (i == skip)
       continue;
-    int perpDist;
-    if (dir == DIR::Up || dir == DIR::Down)
-      perpDist = std::min(c.getDist(p.first, DIR::Left), c.getDist(p.first, DIR::Right));
-    else
-      perpDist = std::min(c.getDist(p.first, DIR::Up), c.getDist(p.first, DIR::Down));
-    if (perpDist == INT_MAX)
+    double dx = double(cx[i]) - px;
+    double dy = double(cy[i]) - py;
+    double d = dx*dx + dy*dy;
+    if (d < bestD) {
+      bestD = d;
+      best = i;
+    }
+  }
+  return best;
+}
+
+inline size_t InDirScalar(const int* along, const int* across, size_t n, int ca, int cx, int sign, size_t skip)
+{
+  size_t best = GEOM_NPOS;
+  double bestD = DBL_MAX;
+  for (size_t i = 0; i < n; ++i) {
+    double plel = sign * (double(along[i]) - ca);
+    if (i == skip || plel <= 0)
       continue;
+    double perp = double(across[i]) - cx;
+    double d = double(int(sqrt(plel*plel + 4*perp*perp)));
+    if (d < bestD) {
+      bestD = d;
+      best = i;
+    }
+  }
+  return best;
+}
+
+inline size_t ContainingScalar(const int* x0, const int* y0, const int* x1, const int* y1, size_t n, int px, int py)
+{
+  for (size_t i = 0; i < n; ++i)
+    if (px >= x0[i] && px <= x1[i] && py >= y0[i] && py <= y1[i])
+      return i;
+  return GEOM_NPOS;
+}
+
+#ifdef MWM_GEOM_X86
+
+/// Lanes hold the best distance and index seen so far. Each lane visits its
+/// indices in increasing order, so taking the smallest index among equal
+/// lane minimums preserves first-wins.
+inline size_t ReduceLanes(const double* d, const double* idx, size_t lanes, double& bestD)
+{
+  size_t best = GEOM_NPOS;
+  bestD = DBL_MAX;
+  for (size_t l = 0; l < lanes; ++l) {
+    if (d[l] < bestD || (d[l] == bestD && d[l] != DBL_MAX && size_t(idx[l]) < best)) {
+      bestD = d[l];
+      best = size_t(idx[l]);
+    }
+  }
+  return best;
+}
+
+inline size_t NearestSSE2(const int* cx, const int* cy, size_t n, int px, int py, size_t skip)
+{
+  const __m128d vpx = _mm_set1_pd(px), vpy = _mm_set1_pd(py);
+  const __m128d vskip = _mm_set1_pd(double(skip == GEOM_NPOS ? -1.0 : double(skip)));
+  const __m128d step = _mm_set1_pd(2);
+  __m128d bestD = _mm_set1_pd(DBL_MAX), bestI = _mm_set1_pd(-1);
+  __m128d idx = _mm_set_pd(1, 0);
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d dx = _mm_sub_pd(_mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*) (cx + i))), vpx);
+    __m128d dy = _mm_sub_pd(_mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*) (cy + i))), vpy);
+    __m128d d = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+    __m128d lt = _mm_andnot_pd(_mm_cmpeq_pd(idx, vskip), _mm_cmplt_pd(d, bestD));
+    bestD = _mm_or_pd(_mm_and_pd(lt, d), _mm_andnot_pd(lt, bestD));
+    bestI = _mm_or_pd(_mm_and_pd(lt, idx), _mm_andnot_pd(lt, bestI));
+    idx = _mm_add_pd(idx, step);
+  }
+  double ld[2], li[2], best;
+  _mm_storeu_pd(ld, bestD);
+  _mm_storeu_pd(li, bestI);
+  size_t r = ReduceLanes(ld, li, 2, best);
+  if (i < n) {
+    size_t t = NearestScalar(cx + i, cy + i, n - i, px, py, skip >= i ? skip - i : GEOM_NPOS);
+    if (t != GEOM_NPOS) {
+      double dx = double(cx[i + t]) - px, dy = double(cy[i + t]) - py;
+      if (dx*dx + dy*dy < best)
+        r = i + t;
+    }
+  }
+  return r;
+}
+
+__attribute__((target("avx2")))
+inline size_t NearestAVX2(const int* cx, const int* cy, size_t n, int px, int py, size_t skip)
+{
+  const __m256d vpx = _mm256_set1_pd(px), vpy = _mm256_set1_pd(py);
+  const __m256d vskip = _mm256_set1_pd(double(skip == GEOM_NPOS ? -1.0 : double(skip)));
+  const __m256d step = _mm256_set1_pd(4);
+  __m256d bestD = _mm256_set1_pd(DBL_MAX), bestI = _mm256_set1_pd(-1);
+  __m256d idx = _mm256_set_pd(3, 2, 1, 0);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d dx = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*) (cx + i))), vpx);
+    __m256d dy = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*) (cy + i))), vpy);
+    __m256d d = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+    __m256d lt = _mm256_andnot_pd(_mm256_cmp_pd(idx, vskip, _CMP_EQ_OQ), _mm256_cmp_pd(d, bestD, _CMP_LT_OQ));
+    bestD = _mm256_blendv_pd(bestD, d, lt);
+    bestI = _mm256_blendv_pd(bestI, idx, lt);
+    idx = _mm256_add_pd(idx, step);
+  }
+  double ld[4], li[4], best;
+  _mm256_storeu_pd(ld, bestD);
+  _mm256_storeu_pd(li, bestI);
+  size_t r = ReduceLanes(ld, li, 4, best);
+  if (i < n) {
+    size_t t = NearestScalar(cx + i, cy + i, n - i, px, py, skip >= i ? skip - i : GEOM_NPOS);
+    if (t != GEOM_NPOS) {
+      double dx = double(cx[i + t]) - px, dy = double(cy[i + t]) - py;
+      if (dx*dx + dy*dy < best)
+        r = i + t;
+    }
+  }
+  return r;
+}
+
+inline size_t InDirSSE2(const int* along, const int* across, size_t n, int ca, int cx, int sign, size_t skip)
+{
+  const __m128d vca = _mm_set1_pd(ca), vcx = _mm_set1_pd(cx), vsign = _mm_set1_pd(sign);
+  const __m128d vskip = _mm_set1_pd(double(skip == GEOM_NPOS ? -1.0 : double(skip)));
+  const __m128d zero = _mm_setzero_pd(), four = _mm_set1_pd(4), step = _mm_set1_pd(2);
+  __m128d bestD = _mm_set1_pd(DBL_MAX), bestI = _mm_set1_pd(-1);
+  __m128d idx = _mm_set_pd(1, 0);
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d plel = _mm_mul_pd(vsign, _mm_sub_pd(_mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*) (along + i))), vca));
+    __m128d perp = _mm_sub_pd(_mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*) (across + i))), vcx);
+    __m128d s = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(plel, plel), _mm_mul_pd(four, _mm_mul_pd(perp, perp))));
+    __m128d d = _mm_cvtepi32_pd(_mm_cvttpd_epi32(s));
+    __m128d ok = _mm_andnot_pd(_mm_cmpeq_pd(idx, vskip), _mm_cmpgt_pd(plel, zero));
+    __m128d lt = _mm_and_pd(ok, _mm_cmplt_pd(d, bestD));
+    bestD = _mm_or_pd(_mm_and_pd(lt, d), _mm_andnot_pd(lt, bestD));
+    bestI = _mm_or_pd(_mm_and_pd(lt, idx), _mm_andnot_pd(lt, bestI));
+    idx = _mm_add_pd(idx, step);
+  }
+  double ld[2], li[2], best;
+  _mm_storeu_pd(ld, bestD);
+  _mm_storeu_pd(li, bestI);
+  size_t r = ReduceLanes(ld, li, 2, best);
+  if (i < n) {
+    size_t t = InDirScalar(along + i, across + i, n - i, ca, cx, sign, skip >= i ? skip - i : GEOM_NPOS);
+    if (t != GEOM_NPOS) {
+      double plel = sign * (double(along[i + t]) - ca), perp = double(across[i + t]) - cx;
+      if (double(int(sqrt(plel*plel + 4*perp*perp))) < best)
+        r = i + t;
+    }
+  }
+  return r;
+}
 
-    int dist = (int) sqrt((plelDist*plelDist) + 4*(perpDist*perpDist));
-    if (dist < minDist) {
-      minDist = dist;
-      closest = p.second;
+__attribute__((target("avx2")))
+inline size_t InDirAVX2(const int* along, const int* across, size_t n, int ca, int cx, int sign, size_t skip)
+{
+  const __m256d vca = _mm256_set1_pd(ca), vcx = _mm256_set1_pd(cx), vsign = _mm256_set1_pd(sign);
+  const __m256d vskip = _mm256_set1_pd(double(skip == GEOM_NPOS ? -1.0 : double(skip)));
+  const __m256d zero = _mm256_setzero_pd(), four = _mm256_set1_pd(4), step = _mm256_set1_pd(4);
+  __m256d bestD = _mm256_set1_pd(DBL_MAX), bestI = _mm256_set1_pd(-1);
+  __m256d idx = _mm256_set_pd(3, 2, 1, 0);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d plel = _mm256_mul_pd(vsign, _mm256_sub_pd(_mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*) (along + i))), vca));
+    __m256d perp = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*) (across + i))), vcx);
+    __m256d s = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(plel, plel), _mm256_mul_pd(four, _mm256_mul_pd(perp, perp))));
+    __m256d d = _mm256_round_pd(s, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m256d ok = _mm256_andnot_pd(_mm256_cmp_pd(idx, vskip, _CMP_EQ_OQ), _mm256_cmp_pd(plel, zero, _CMP_GT_OQ));
+    __m256d lt = _mm256_and_pd(ok, _mm256_cmp_pd(d, bestD, _CMP_LT_OQ));
+    bestD = _mm256_blendv_pd(bestD, d, lt);
+    bestI = _mm256_blendv_pd(bestI, idx, lt);
+    idx = _mm256_add_pd(idx, step);
+  }
+  double ld[4], li[4], best;
+  _mm256_storeu_pd(ld, bestD);
+  _mm256_storeu_pd(li, bestI);
+  size_t r = ReduceLanes(ld, li, 4, best);
+  if (i < n) {
+    size_t t = InDirScalar(along + i, across + i, n - i, ca, cx, sign, skip >= i ? skip - i : GEOM_NPOS);
+    if (t != GEOM_NPOS) {
+      double plel = sign * (double(along[i + t]) - ca), perp = double(across[i + t]) - cx;
+      if (double(int(sqrt(plel*plel + 4*perp*perp))) < best)
+        r = i + t;
     }
   }
+  return r;
+}
 
-  return closest;
+inline size_t ContainingSSE2(const int* x0, const int* y0, const int* x1, const int* y1, size_t n, int px, int py)
+{
+  const __m128i vpx = _mm_set1_epi32(px), vpy = _mm_set1_epi32(py);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    // Outside if x0 > px, px > x1, y0 > py or py > y1
+    __m128i out = _mm_or_si128(
+        _mm_or_si128(_mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*) (x0 + i)), vpx),
+                     _mm_cmpgt_epi32(vpx, _mm_loadu_si128((const __m128i*) (x1 + i)))),
+        _mm_or_si128(_mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*) (y0 + i)), vpy),
+                     _mm_cmpgt_epi32(vpy, _mm_loadu_si128((const __m128i*) (y1 + i)))));
+    int in = ~_mm_movemask_ps(_mm_castsi128_ps(out)) & 0xF;
+    if (in != 0)
+      return i + size_t(__builtin_ctz(unsigned(in)));
+  }
+  size_t t = ContainingScalar(x0 + i, y0 + i, x1 + i, y1 + i, n - i, px, py);
+  return t == GEOM_NPOS ? t : i + t;
+}
+
+__attribute__((target("avx2")))
+inline size_t ContainingAVX2(const int* x0, const int* y0, const int* x1, const int* y1, size_t n, int px, int py)
+{
+  const __m256i vpx = _mm256_set1_epi32(px), vpy = _mm256_set1_epi32(py);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i out = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*) (x0 + i)), vpx),
+                        _mm256_cmpgt_epi32(vpx, _mm256_loadu_si256((const __m256i*) (x1 + i)))),
+        _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*) (y0 + i)), vpy),
+                        _mm256_cmpgt_epi32(vpy, _mm256_loadu_si256((const __m256i*) (y1 + i)))));
+    int in = ~_mm256_movemask_ps(_mm256_castsi256_ps(out)) & 0xFF;
+    if (in != 0)
+      return i + size_t(__builtin_ctz(unsigned(in)));
+  }
+  size_t t = ContainingSSE2(x0 + i, y0 + i, x1 + i, y1 + i, n - i, px, py);
+  return t == GEOM_NPOS ? t : i + t;
+}
+
+#endif // MWM_GEOM_X86
+
+} // namespace geom_detail
+
+/// Kernels for a given level, falling back to scalar where it is not compiled in
+inline const GeomKernels& GetGeomKernels(SimdLevel level)
+{
+  using namespace geom_detail;
+  static const GeomKernels SCALAR = { NearestScalar, InDirScalar, ContainingScalar };
+#ifdef MWM_GEOM_X86
+  static const GeomKernels SSE2 = { NearestSSE2, InDirSSE2, ContainingSSE2 };
+  static const GeomKernels AVX2 = { NearestAVX2, InDirAVX2, ContainingAVX2 };
+  if (level == SimdLevel::AVX2)
+    return AVX2;
+  if (level == SimdLevel::SSE2)
+    return SSE2;
+#endif
+  (void) level;
+  return SCALAR;
+}
+
+/// Best level the running CPU supports, picked once
+inline SimdLevel BestSimdLevel()
+{
+  static const SimdLevel level = [] {
+#ifdef MWM_GEOM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse2"))
+      return SimdLevel::SSE2;
+#endif
+    return SimdLevel::Scalar;
+  }();
+  return level;
+}
+
+/// RectSet ////////////////////////////////////////////////////////////////////
+
+/// Persistent set of rects keyed by value, stored as structure-of-arrays so the
+/// queries run over contiguous coordinates. Values are unique, order is
+/// insertion order (erase swaps the last entry in). Values are looked up
+/// through a hash index, T has to convert to an integer.
+template<typename T>
+class RectSet
+{
+  public:
+
+    void clear();
+    void reserve(size_t n);
+    size_t size() const { return _vals.size(); }
+    bool empty() const { return _vals.empty(); }
+
+    /// Inserts v or moves it to r
+    void set(const T& v, const Rect& r);
+    bool erase(const T& v);
+    const Rect* get(const T& v) const;
+
+    /// Value whose center is closest to p, ignoring skip
+    const T* nearest(const Point& p, const T* skip = nullptr) const;
+
+    /// Value whose center is next from c in dir, ignoring skip. Distance along
+    /// the direction counts half as much as distance across it.
+    const T* nextInDir(DIR dir, const Point& c, const T* skip = nullptr) const;
+
+    /// First value whose rect contains p (edges included)
+    const T* containing(const Point& p) const;
+
+  private:
+
+    size_t indexOf(const T* v) const;
+
+    std::vector<int> _x0, _y0, _x1, _y1; // Edges
+    std::vector<int> _cx, _cy;           // Centers
+    std::vector<Rect> _rects;
+    std::vector<T> _vals;
+    FlatMap<T, size_t> _index; // Value -> position in the vectors
+};
+
+template<typename T>
+inline void RectSet<T>::clear()
+{
+  _x0.clear(); _y0.clear(); _x1.clear(); _y1.clear();
+  _cx.clear(); _cy.clear();
+  _rects.clear();
+  _vals.clear();
+  _index.clear();
+}
+
+template<typename T>
+inline void RectSet<T>::reserve(size_t n)
+{
+  _x0.reserve(n); _y0.reserve(n); _x1.reserve(n); _y1.reserve(n);
+  _cx.reserve(n); _cy.reserve(n);
+  _rects.reserve(n);
+  _vals.reserve(n);
+  _index.reserve(n);
+}
+
+template<typename T>
+inline void RectSet<T>::set(const T& v, const Rect& r)
+{
+  size_t i = indexOf(&v);
+  if (i == GEOM_NPOS) {
+    i = _vals.size();
+    _x0.push_back(0); _y0.push_back(0); _x1.push_back(0); _y1.push_back(0);
+    _cx.push_back(0); _cy.push_back(0);
+    _rects.push_back(r);
+    _vals.push_back(v);
+    _index.insert({v, i});
+  }
+  Point c = r.getCenter();
+  _x0[i] = r.o.x;
+  _y0[i] = r.o.y;
+  _x1[i] = r.o.x + r.w;
+  _y1[i] = r.o.y + r.h;
+  _cx[i] = c.x;
+  _cy[i] = c.y;
+  _rects[i] = r;
+}
+
+template<typename T>
+inline bool RectSet<T>::erase(const T& v)
+{
+  size_t i = indexOf(&v);
+  if (i == GEOM_NPOS)
+    return false;
+  _index.erase(v); // Before the swap, v may be a reference into _vals
+  auto swapPop = [i] (auto& vec) {
+    vec[i] = vec.back();
+    vec.pop_back();
+  };
+  swapPop(_x0); swapPop(_y0); swapPop(_x1); swapPop(_y1);
+  swapPop(_cx); swapPop(_cy);
+  swapPop(_rects);
+  swapPop(_vals);
+  if (i < _vals.size())
+    _index.at(_vals[i]) = i; // The old last entry moved into the hole
+  return true;
+}
+
+template<typename T>
+inline const Rect* RectSet<T>::get(const T& v) const
+{
+  size_t i = indexOf(&v);
+  return i == GEOM_NPOS ? nullptr : &_rects[i];
+}
+
+template<typename T>
+inline const T* RectSet<T>::nearest(const Point& p, const T* skip) const
+{
+  size_t i = GetGeomKernels(BestSimdLevel()).nearest(_cx.data(), _cy.data(), size(), p.x, p.y, indexOf(skip));
+  return i == GEOM_NPOS ? nullptr : &_vals[i];
+}
+
+template<typename T>
+inline const T* RectSet<T>::nextInDir(DIR dir, const Point& c, const T* skip) const
+{
+  const auto& k = GetGeomKernels(BestSimdLevel());
+  size_t i = GEOM_NPOS;
+  switch (dir) {
+    case DIR::Up:    i = k.inDir(_cy.data(), _cx.data(), size(), c.y, c.x, -1, indexOf(skip)); break;
+    case DIR::Down:  i = k.inDir(_cy.data(), _cx.data(), size(), c.y, c.x,  1, indexOf(skip)); break;
+    case DIR::Left:  i = k.inDir(_cx.data(), _cy.data(), size(), c.x, c.y, -1, indexOf(skip)); break;
+    case DIR::Right: i = k.inDir(_cx.data(), _cy.data(), size(), c.x, c.y,  1, indexOf(skip)); break;
+    default:         break;
+  }
+  return i == GEOM_NPOS ? nullptr : &_vals[i];
+}
+
+template<typename T>
+inline const T* RectSet<T>::containing(const Point& p) const
+{
+  size_t i = GetGeomKernels(BestSimdLevel()).containing(_x0.data(), _y0.data(), _x1.data(), _y1.data(),
+                                                        size(), p.x, p.y);
+  return i == GEOM_NPOS ? nullptr : &_vals[i];
+}
+
+template<typename T>
+inline size_t RectSet<T>::indexOf(const T* v) const
+{
+  if (v == nullptr)
+    return GEOM_NPOS;
+  auto it = _index.find(*v);
+  return it == _index.end() ? GEOM_NPOS : it->second;
 }
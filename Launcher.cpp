@@ -0,0 +1,237 @@
+#include "Launcher.hpp"
+
+#include <u/log.hpp>
+
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+/// Base names of font sets, tried in order, "fixed" is always there
+const char* const FONTS[] = {
+  "-misc-fixed-medium-r-normal--18-*-*-*-*-*-*-*",
+  "fixed",
+};
+
+} // namespace
+
+bool Launcher::open(Display* disp, int screen, const Rect& mon, const DesktopIndex& index, const Colors& colors)
+{
+  if (isOpen())
+    close();
+
+  auto start = std::chrono::steady_clock::now();
+  if (_disp != disp)
+    release();
+  _disp = disp;
+  _index = &index;
+  _colors = colors;
+  _query.clear();
+  _sel = 0;
+
+  if (_font == nullptr && !load())
+    return false;
+
+  // Query line plus ROWS results, a third of the monitor wide and up top
+  const XFontSetExtents* ext = XExtentsOfFontSet(_font);
+  _ascent = -ext->max_logical_extent.y;
+  _lineH = ext->max_logical_extent.height + 4;
+  _width = std::clamp(mon.w / 3, std::min(400, mon.w), std::min(900, mon.w));
+  _height = _lineH * int(ROWS + 1) + 2 * PAD;
+  int x = mon.o.x + (mon.w - _width) / 2;
+  int y = mon.o.y + mon.h / 4;
+
+  XSetWindowAttributes wa;
+  wa.override_redirect = True;
+  wa.background_pixel = _colors.bg;
+  wa.border_pixel = _colors.sel;
+  wa.event_mask = ExposureMask | KeyPressMask;
+  _win = XCreateWindow(_disp, RootWindow(_disp, screen), x, y, unsigned(_width), unsigned(_height), 2,
+                       CopyFromParent, InputOutput, CopyFromParent,
+                       CWOverrideRedirect | CWBackPixel | CWBorderPixel | CWEventMask, &wa);
+  _buf = XCreatePixmap(_disp, _win, unsigned(_width), unsigned(_height),
+                       unsigned(DefaultDepth(_disp, screen)));
+  _gc = XCreateGC(_disp, _win, 0, nullptr);
+
+  if (_im != nullptr) {
+    _ic = XCreateIC(_im, XNInputStyle, XIMPreeditNothing | XIMStatusNothing,
+                    XNClientWindow, _win, XNFocusWindow, _win, nullptr);
+    if (_ic != nullptr)
+      XSetICFocus(_ic);
+  }
+
+  XMapRaised(_disp, _win);
+  if (XGrabKeyboard(_disp, _win, True, GrabModeAsync, GrabModeAsync, CurrentTime) != GrabSuccess)
+    LOG(WARN) << "launcher unable to grab the keyboard";
+
+  refilter();
+  LOG(INFO) << "launcher opened entries=" << _index->size()
+            << " ms=" << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return true;
+}
+
+void Launcher::close()
+{
+  if (!isOpen())
+    return;
+  XUngrabKeyboard(_disp, CurrentTime);
+  if (_ic != nullptr)
+    XDestroyIC(_ic);
+  XFreeGC(_disp, _gc);
+  XFreePixmap(_disp, _buf);
+  XDestroyWindow(_disp, _win);
+  XFlush(_disp);
+  _ic = nullptr;
+  _win = None;
+  _buf = None;
+  _gc = None;
+  _matches.clear();
+}
+
+void Launcher::release()
+{
+  close();
+  if (_im != nullptr)
+    XCloseIM(_im);
+  if (_font != nullptr)
+    XFreeFontSet(_disp, _font);
+  _im = nullptr;
+  _font = nullptr;
+}
+
+bool Launcher::load()
+{
+  for (const char* name : FONTS) {
+    char** missing = nullptr;
+    int numMissing = 0;
+    char* defString = nullptr;
+    _font = XCreateFontSet(_disp, name, &missing, &numMissing, &defString);
+    if (missing != nullptr)
+      XFreeStringList(missing);
+    if (_font != nullptr) {
+      if (numMissing > 0)
+        LOG(WARN) << "launcher font set incomplete base=(" << name << ") missing=" << numMissing;
+      break;
+    }
+  }
+  if (_font == nullptr) {
+    LOG(ERROR) << "launcher has no font";
+    return false;
+  }
+
+  // Typed text as UTF-8 whatever the keyboard layout, an input method
+  // server set in XMODIFIERS is used when there is one
+  _im = XOpenIM(_disp, nullptr, nullptr, nullptr);
+  if (_im == nullptr)
+    LOG(WARN) << "launcher has no input method, typing is limited to Latin-1";
+  return true;
+}
+
+bool Launcher::onKey(const XKeyEvent& e, DesktopIndex::Entry& launch)
+{
+  XEvent ev;
+  ev.xkey = e;
+  if (_ic != nullptr && XFilterEvent(&ev, _win))
+    return false; // Taken by the input method
+
+  char text[64];
+  KeySym sym = NoSymbol;
+  int len = 0;
+  if (_ic != nullptr) {
+    Status status;
+    len = Xutf8LookupString(_ic, &ev.xkey, text, sizeof(text), &sym, &status);
+    if (status != XLookupChars && status != XLookupBoth)
+      len = 0;
+    if (status != XLookupKeySym && status != XLookupBoth)
+      sym = NoSymbol;
+  } else {
+    // XLookupString hands out Latin-1, the names are UTF-8
+    char latin1[32];
+    const int n = XLookupString(&ev.xkey, latin1, sizeof(latin1), &sym, nullptr);
+    for (int i = 0; i < n; ++i) {
+      const auto c = (unsigned char) latin1[i];
+      if (c < 0x80) {
+        text[len++] = char(c);
+      } else {
+        text[len++] = char(0xC0 | (c >> 6));
+        text[len++] = char(0x80 | (c & 0x3F));
+      }
+    }
+  }
+  const bool ctrl = e.state & ControlMask;
+
+  if (sym == XK_Escape) {
+    close();
+  } else if (sym == XK_Return || sym == XK_KP_Enter) {
+    bool picked = _sel < _matches.size();
+    if (picked)
+      launch = _index->get(_matches[_sel]);
+    close();
+    return picked;
+  } else if (sym == XK_Up || sym == XK_ISO_Left_Tab || (ctrl && sym == XK_p)) {
+    _sel = (_sel > 0) ? _sel - 1 : 0;
+    draw();
+  } else if (sym == XK_Down || sym == XK_Tab || (ctrl && sym == XK_n)) {
+    _sel = std::min(_sel + 1, _matches.empty() ? 0 : _matches.size() - 1);
+    draw();
+  } else if (sym == XK_BackSpace) {
+    // A whole character, continuation bytes first
+    while (!_query.empty() && ((unsigned char) _query.back() & 0xC0) == 0x80)
+      _query.pop_back();
+    if (!_query.empty())
+      _query.pop_back();
+    refilter();
+  } else if (ctrl && sym == XK_u) {
+    _query.clear();
+    refilter();
+  } else if (len > 0 && !ctrl && (unsigned char) text[0] >= 0x20) {
+    _query.append(text, size_t(len));
+    _sel = 0;
+    refilter();
+  }
+  return false;
+}
+
+void Launcher::refilter()
+{
+  if (!isOpen())
+    return;
+  _index->match(_query, ROWS, _matches);
+  _sel = std::min(_sel, _matches.empty() ? 0 : _matches.size() - 1);
+  draw();
+}
+
+void Launcher::expose()
+{
+  if (isOpen())
+    XCopyArea(_disp, _buf, _win, _gc, 0, 0, unsigned(_width), unsigned(_height), 0, 0);
+}
+
+void Launcher::draw()
+{
+  XSetForeground(_disp, _gc, _colors.bg);
+  XFillRectangle(_disp, _buf, _gc, 0, 0, unsigned(_width), unsigned(_height));
+
+  auto text = [&] (int row, std::string_view s) {
+    Xutf8DrawString(_disp, _buf, _font, _gc, PAD, PAD + row * _lineH + 2 + _ascent, s.data(), int(s.size()));
+  };
+
+  XSetForeground(_disp, _gc, _colors.fg);
+  text(0, "> " + _query + "_");
+
+  for (size_t i = 0; i < _matches.size(); ++i) {
+    int row = int(i) + 1;
+    if (i == _sel) {
+      XSetForeground(_disp, _gc, _colors.sel);
+      XFillRectangle(_disp, _buf, _gc, 0, PAD + row * _lineH, unsigned(_width), unsigned(_lineH));
+    }
+    XSetForeground(_disp, _gc, _colors.fg);
+    text(row, _index->get(_matches[i]).name);
+  }
+
+  expose();
+  XFlush(_disp);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "DesktopIndex.hpp"
+#include "Geometry.hpp"
+
+#include <X11/Xlib.h>
+
+#include <string>
+#include <vector>
+
+/// Filter box over the desktop index, drawn on one monitor. The window is
+/// override-redirect and keeps the keyboard grabbed while open. Everything is
+/// drawn into a pixmap and copied in one go, so typing never flickers.
+class Launcher
+{
+  public:
+
+    struct Colors
+    {
+      unsigned long bg;
+      unsigned long fg;
+      unsigned long sel;
+    };
+
+    bool isOpen() const { return _win != None; }
+    Window window() const { return _win; }
+
+    /// mon is in the screen's root coordinates. Names and the query are UTF-8,
+    /// drawn with a font set for LC_CTYPE.
+    bool open(Display* disp, int screen, const Rect& mon, const DesktopIndex& index, const Colors& colors);
+    void close();
+
+    /// Frees the font set and input method close() keeps for the next open,
+    /// before the display goes
+    void release();
+
+    /// A key while open. True with launch set when an entry was picked, the
+    /// launcher is closed by then. Escape closes without a pick.
+    bool onKey(const XKeyEvent& e, DesktopIndex::Entry& launch);
+
+    /// The index changed underneath, match again and redraw
+    void refilter();
+
+    /// Repaints from the back buffer, for Expose
+    void expose();
+
+  private:
+
+    /// Font set and input method, once per display
+    bool load();
+    void draw();
+
+    static constexpr unsigned ROWS = 12;
+    static constexpr int PAD = 8;
+
+    Display* _disp = nullptr;
+    const DesktopIndex* _index = nullptr;
+    Window _win = None;
+    Pixmap _buf = None;
+    GC _gc = None;
+    XFontSet _font = nullptr;
+    XIM _im = nullptr; // None available means plain XLookupString
+    XIC _ic = nullptr; // Per open, on _win
+    Colors _colors = {};
+    int _width = 0, _height = 0, _lineH = 0, _ascent = 0;
+
+    std::string _query;
+    std::vector<uint32_t> _matches;
+    size_t _sel = 0;
+};
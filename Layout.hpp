@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Geometry.hpp"
+
+#include <vector>
+
+/// Automatic layouts, computed purely from the monitor rect and window count
+enum class Layout
+{
+  Float,       // Windows stay where they are put
+  MasterStack, // First window on the left, the rest stacked on the right
+  Bsp,         // Each window splits the remaining space along its longer side
+  LAST
+};
+
+constexpr static inline const char* LayoutToString(Layout l)
+{
+  constexpr const char* const LAYOUT_NAMES[] = {
+    "float",
+    "tile",
+    "bsp",
+  };
+  static_assert(sizeof(LAYOUT_NAMES) / sizeof(const char*) == size_t(Layout::LAST));
+
+  if (l >= Layout::LAST)
+    return "Undefined";
+  return LAYOUT_NAMES[size_t(l)];
+}
+
+/// Share of the monitor width given to the master window
+constexpr double MASTER_RATIO = 0.55;
+
+/// Fills out with n outer rects (border included) tiling area. Float leaves
+/// out empty.
+static inline void ComputeLayout(Layout l, const Rect& area, size_t n, std::vector<Rect>& out)
+{
+  out.clear();
+  if (n == 0 || l == Layout::Float || l >= Layout::LAST)
+    return;
+  out.reserve(n);
+
+  if (n == 1) {
+    out.push_back(area);
+    return;
+  }
+
+  if (l == Layout::MasterStack) {
+    int masterW = int(area.w * MASTER_RATIO);
+    out.emplace_back(area.o.x, area.o.y, masterW, area.h);
+
+    // Spread the rounding remainder over the first stack windows
+    int stackN = int(n - 1);
+    int each = area.h / stackN, extra = area.h % stackN;
+    int y = area.o.y;
+    for (int i = 0; i < stackN; ++i) {
+      int h = each + (i < extra ? 1 : 0);
+      out.emplace_back(area.o.x + masterW, y, area.w - masterW, h);
+      y += h;
+    }
+    return;
+  }
+
+  // Bsp, the last window keeps whatever is left
+  Rect rest = area;
+  for (size_t i = 0; i + 1 < n; ++i) {
+    if (rest.w >= rest.h) {
+      int half = rest.w / 2;
+      out.emplace_back(rest.o.x, rest.o.y, half, rest.h);
+      rest = Rect(rest.o.x + half, rest.o.y, rest.w - half, rest.h);
+    } else {
+      int half = rest.h / 2;
+      out.emplace_back(rest.o.x, rest.o.y, rest.w, half);
+      rest = Rect(rest.o.x, rest.o.y + half, rest.w, rest.h - half);
+    }
+  }
+  out.push_back(rest);
+}
@@ -1,35 +1,185 @@
 #include "Manager.hpp"
 
+#include "AllocStats.hpp"
+#include "ErrorLog.hpp"
+#include "Snapshot.hpp"
 #include "XUtils.hpp"
 
 #include <u/log.hpp>
 
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <future>
+#include <optional>
 #include <set>
 #include <string.h>
 
+#include <fcntl.h>
+#include <libgen.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #define NUMLOCK (Mod2Mask)
 
-#define BACKGROUND 0x604020
+#define CLIENT_EVENTS (FocusChangeMask | PropertyChangeMask | EnterWindowMask)
+
+// How long a resize waits for a _NET_WM_SYNC_REQUEST ack before giving up on it
+static constexpr auto SYNC_TIMEOUT = std::chrono::milliseconds(100);
+
+// New terminals, in characters, and their offset into the monitor
+static constexpr int TERM_COLS = 120;
+static constexpr int TERM_ROWS = 40;
+static constexpr int TERM_OFFSET = 100;
+
+// Clients the registry has room for up front, mapping more than this many
+// grows it once
+static constexpr size_t CLIENTS_RESERVED = 1024;
+
+// Destroyed windows remembered, requests to them are dropped
+static constexpr size_t DEAD_REMEMBERED = 256;
+
+/// Offset putting either end of [lo, lo + len] on the nearest edge within
+/// dist, the closer end wins. 0 when neither is near one.
+static int SnapSpan(const EdgeIndex& edges, bool x, int lo, int len, int dist)
+{
+  int dLo = 0, dHi = 0;
+  bool hasLo = x ? edges.snapX(lo, dist, dLo) : edges.snapY(lo, dist, dLo);
+  bool hasHi = x ? edges.snapX(lo + len, dist, dHi) : edges.snapY(lo + len, dist, dHi);
+  if (hasLo && (!hasHi || std::abs(dLo) <= std::abs(dHi)))
+    return dLo;
+  return hasHi ? dHi : 0;
+}
+
+/// Handlers that run per keystroke, per pointer motion or per window, and
+/// must not allocate once warmed up. MapRequest is not one of them, a new
+/// window costs queryClient round trips and its name and hints anyway.
+static bool IsHotEvent(int type, int syncEventBase)
+{
+  switch (type) {
+    case MotionNotify:
+    case ButtonRelease:
+    case ConfigureNotify:
+    case ConfigureRequest:
+    case UnmapNotify:
+    case FocusIn:
+    case FocusOut:
+    case EnterNotify:
+      return true;
+    default:
+      return syncEventBase != 0 && type == syncEventBase + XSyncAlarmNotify;
+  }
+}
+
+static bool IsHotAction(Action a)
+{
+  switch (a) {
+    case Action::MoveFocus:
+    case Action::MoveGridLoc:
+    case Action::MoveGridSize:
+    case Action::MoveMonitor:
+    case Action::Maximize:
+    case Action::Unmaximize:
+    case Action::Close:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/// Startup phases, reported as one log line once init() is done
+class PhaseTimer
+{
+  public:
+
+    explicit PhaseTimer(std::chrono::steady_clock::time_point start) : _start(start), _last(start) {}
+
+    void mark(const char* phase)
+    {
+      auto now = std::chrono::steady_clock::now();
+      _report << " " << phase << "Ms=" << std::chrono::duration<double, std::milli>(now - _last).count();
+      _last = now;
+    }
+
+    std::string report() const
+    {
+      std::ostringstream out;
+      out << _report.str() << " totalMs=" << std::chrono::duration<double, std::milli>(_last - _start).count();
+      return out.str();
+    }
+
+  private:
+
+    std::chrono::steady_clock::time_point _start, _last;
+    std::ostringstream _report;
+};
+
+/// Starts argv detached from mwm (double fork, own session, output to
+/// /dev/null) and returns its pid, 0 on failure. Only async-signal-safe
+/// calls happen between fork and exec, other threads may hold locks.
+static pid_t SpawnDetached(const std::string& display, const std::vector<std::string>& args)
+{
+  std::vector<std::string> env;
+  for (char** e = environ; *e != nullptr; ++e)
+    if (strncmp(*e, "DISPLAY=", 8) != 0)
+      env.emplace_back(*e);
+  env.push_back("DISPLAY=" + display);
+
+  std::vector<char*> argv, envp;
+  for (const auto& a : args)
+    argv.push_back(const_cast<char*>(a.c_str()));
+  argv.push_back(nullptr);
+  for (const auto& e : env)
+    envp.push_back(const_cast<char*>(e.c_str()));
+  envp.push_back(nullptr);
+
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) != 0)
+    return 0;
+
+  pid_t child = fork();
+  if (child == 0) {
+    setsid();
+    pid_t pid = fork();
+    if (pid == 0) {
+      int null = open("/dev/null", O_RDWR);
+      dup2(null, STDIN_FILENO);
+      dup2(null, STDOUT_FILENO);
+      dup2(null, STDERR_FILENO);
+      execvpe(argv[0], argv.data(), envp.data());
+      _exit(127);
+    }
+    ssize_t n = write(fds[1], &pid, sizeof(pid));
+    _exit(n == ssize_t(sizeof(pid)) ? 0 : 1);
+  }
 
-#define BORDER_THICK   5
-#define BORDER_FOCUS   0x005F87
-#define BORDER_UNFOCUS 0x0C0C0C
+  close(fds[1]);
+  pid_t pid = 0;
+  if (child > 0) {
+    waitpid(child, nullptr, 0);
+    if (read(fds[0], &pid, sizeof(pid)) != ssize_t(sizeof(pid)) || pid < 0)
+      pid = 0;
+  }
+  close(fds[0]);
+  return pid;
+}
 
-#define GRID_THICK 1
-#define GRID_INACT 0x880000
-#define GRID_COLOR 0x005F87
-#define GRID_BG    0x181818
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Notes
 ///
 /// - You may need to set Xcursor.size in ~/.Xresources
-/// - Dependencies: pactl, slock, j4-dmenu-desktop, dmenu, st,
-//                  import (imagemagick)
+/// - Config is read from ~/.config/mwm/mwm.conf (see Config.hpp) and reloaded
+///   whenever it is saved
+/// - Dependencies: pactl, slock, st
+/// - One st per screen is started ahead of time and held unmapped, Numlock+T
+///   only has to map it
 
 ////////////////////////////////////////////////////////////////////////////////
-/// Keyboard / Mouse Shortcuts
+/// Keyboard / Mouse Shortcuts (defaults, see Config.hpp to rebind)
 ///
 /// Numlock         + h,j,k,l | Move focus to other window
 /// Numlock + Shift + h,j,k,l | Move window in grid on current monitor
@@ -44,10 +194,13 @@
 /// Numlock + S   | Snap current window to closest grid location / size
 /// Numlock + P   | Lock the screen
 /// Numlock + A   | Open application menu launcher
-/// Numlock + O   | Open screenshot program
+/// Numlock + O   | Screenshot of the whole screen (Shift: monitor, Ctrl: window)
 /// Numlock + Q   | Volume up
 /// Numlock + W   | Volume down
 /// Numlock + E   | Volume toggle mute
+/// Numlock + R   | Restart in place, keeping window state
+/// Numlock + Shift + R | Dump the screen recording ring (see 'record' in Config.hpp)
+/// Numlock + Y   | Cycle the current monitor's layout (float, tile, bsp)
 ///
 /// Grid Building Mode
 /// j,k             | Decrement/increment vertical grid count
@@ -57,16 +210,27 @@
 Manager::Manager(const std::string& display,
                  const std::map<int,Point>& screens,
                  const std::string& screenshotDir,
-                 const std::map<std::string,MonitorCfg>& monitorCfg)
+                 const std::string& configPath,
+                 const std::string& restorePath)
   : _argDisp(display)
   , _argScreens(screens)
   , _argScreenshotDir(screenshotDir)
-  , _argMonitorCfg(monitorCfg)
+  , _argConfigPath(configPath)
+  , _argRestorePath(restorePath)
+  , _started(std::chrono::steady_clock::now())
 {}
 
 Manager::~Manager()
 {
+  if (_inotify >= 0) {
+    close(_inotify);
+    _inotify = -1;
+  }
+
   if (_disp != nullptr) {
+    _launcher.release();
+    closeBars();
+    drainTermPool();
     XCloseDisplay(_disp);
     _disp = nullptr;
   }
@@ -74,19 +238,102 @@ Manager::~Manager()
 
 bool Manager::init()
 {
-  system("pactl upload-sample /usr/share/sounds/freedesktop/stereo/bell.oga bell.oga");
+  PhaseTimer timer(_started);
+
+  // Only needed by the first volume change, never worth waiting for
+  SpawnDetached(_argDisp, {"pactl", "upload-sample", "/usr/share/sounds/freedesktop/stereo/bell.oga", "bell.oga"});
 
-  XSetErrorHandler(&XError);
+  if (!LoadConfig(_argConfigPath, _cfg))
+    return false;
+
+  // The rest of init holds server grabs and waits on replies, watch it too
+  _watchdog.setBudget(_cfg.watchdogMs);
+  Watchdog::Scope watch(_watchdog, "init");
+
+  // Mapping a window shouldn't have to grow anything
+  _clients.reserve(CLIENTS_RESERVED);
+  _withdrawn.reserve(CLIENTS_RESERVED + DEAD_REMEMBERED);
+  _deadRing.reserve(DEAD_REMEMBERED);
+  _clientRects.reserve(CLIENTS_RESERVED);
+  _usedScratch.reserve(CLIENTS_RESERVED);
+  _freeSpace.reserve(CLIENTS_RESERVED);
+
+  // Watch the directory rather than the file, editors replace it on save
+  _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (_inotify < 0 ||
+      inotify_add_watch(_inotify, dirname(std::string(_argConfigPath).data()),
+                        IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    LOG(WARN) << "unable to watch config for changes path=(" << _argConfigPath << ")";
+  timer.mark("config");
+
+  // The recorder grabs from its own connection on its own thread
+  XInitThreads();
 
   _disp = XOpenDisplay(_argDisp.c_str());
   if (_disp == nullptr) {
     LOG(ERROR) << "failed to open X display=" << _argDisp;
     return false;
   }
+  ErrorLog::install(_disp);
+  ErrorLog::mark("init");
+
+  updateKeyCodes();
 
   const int numScreens = ScreenCount(_disp);
   LOG(INFO) << "display=" << DisplayString(_disp) << " screens=" << numScreens;
 
+  if (!_atoms.init(_disp)) {
+    LOG(ERROR) << "failed to intern atoms";
+    return false;
+  }
+
+  int syncError, syncMajor, syncMinor;
+  if (XSyncQueryExtension(_disp, &_syncEventBase, &syncError) &&
+      XSyncInitialize(_disp, &syncMajor, &syncMinor)) {
+    // One alarm, pointed at whichever counter is being resized
+    XSyncAlarmAttributes aa;
+    aa.trigger.counter = None;
+    aa.trigger.value_type = XSyncAbsolute;
+    aa.trigger.test_type = XSyncPositiveComparison;
+    XSyncIntToValue(&aa.trigger.wait_value, 0);
+    XSyncIntToValue(&aa.delta, 0);
+    aa.events = true;
+    _syncAlarm = XSyncCreateAlarm(_disp, XSyncCACounter | XSyncCAValueType | XSyncCATestType |
+                                  XSyncCAValue | XSyncCADelta | XSyncCAEvents, &aa);
+  } else {
+    LOG(WARN) << "no SYNC extension, resizes are not paced";
+  }
+
+  Snapshot snap;
+  const bool restoring = !_argRestorePath.empty() && ReadSnapshot(_argRestorePath, snap);
+  timer.mark("display");
+
+  // Screens a snapshot doesn't cover query XRandR on their own connection and
+  // thread, overlapping with each other and with the root setup below
+  std::map<int, std::future<std::optional<std::vector<XRROutput>>>> discovery;
+  for (int i = 0; i < numScreens; ++i) {
+    if (_argScreens.find(i) == _argScreens.end())
+      continue;
+    bool restored = false;
+    if (restoring) {
+      Window root = RootWindow(_disp, i);
+      _roots[root].absOrigin = _argScreens.at(i);
+      restored = restoreMonitors(root, snap);
+    }
+    if (!restored) {
+      discovery[i] = std::async(std::launch::async, [display = _argDisp, i] {
+        std::optional<std::vector<XRROutput>> outputs;
+        if (Display* disp = XOpenDisplay(display.c_str()); disp != nullptr) {
+          outputs.emplace();
+          if (!GetXRROutputs(disp, RootWindow(disp, i), *outputs))
+            outputs.reset();
+          XCloseDisplay(disp);
+        }
+        return outputs;
+      });
+    }
+  }
+
   for (int i = 0; i < numScreens; ++i) {
     if (_argScreens.find(i) == _argScreens.end()) {
       LOG(INFO) << "ignoring non-configured screen=" << i;
@@ -96,286 +343,721 @@ bool Manager::init()
     auto root = RootWindow(_disp, i);
     LOG(INFO) << "screen=" << DisplayString(_disp) << "." << i << " root=" << root
               << " origin=(" << _argScreens.at(i).x << "," << _argScreens.at(i).y << ")";
-    Root r;
+    Root& r = _roots[root];
     r.screen = i;
     r.absOrigin = _argScreens.at(i);
-    _roots[root] = r;
+    r.clientList.reserve(CLIENTS_RESERVED);
 
     XSelectInput(_disp, root, SubstructureRedirectMask | SubstructureNotifyMask |
                               KeyPressMask | ButtonPressMask | FocusChangeMask);
 
     // Set the background
-    XSetWindowBackground(_disp, root, BACKGROUND);
+    XSetWindowBackground(_disp, root, _cfg.background);
     XClearWindow(_disp, root);
 
     // Less ugly cursor
     Cursor cursor = XCreateFontCursor(_disp, XC_crosshair);
     XDefineCursor(_disp, root, cursor);
 
-    // Identify monitors on this X screen
-    {
-      bool success = true;
-
-      auto* res = XRRGetScreenResources(_disp, root);
-      assert(res != nullptr);
-      for (int j = 0; j < res->ncrtc && success; ++j) {
-        auto* crtc = XRRGetCrtcInfo(_disp, res, res->crtcs[j]);
-        assert(crtc != nullptr);
-        Rect rect{crtc->x, crtc->y, int(crtc->width), int(crtc->height)};
-        for (int k = 0; k < crtc->noutput && success; ++k) {
-          auto* output = XRRGetOutputInfo(_disp, res, crtc->outputs[k]);
-          assert(output != nullptr);
-          std::string_view connector(output->name, output->nameLen);
-
-          auto it = std::find_if(_argMonitorCfg.begin(), _argMonitorCfg.end(),
-              [&] (const auto& m) { return m.second.screen == i && m.second.connector == connector; });
-          if (it == _argMonitorCfg.end()) {
-            LOG(ERROR) << "missing config for monitor screen=" << i << " connector=(" << connector << ")";
-            success = false;
-          } else {
-            auto jt = std::find_if(_monitors.begin(), _monitors.end(),
-                [&] (const auto& mon) { return mon.cfg.name == it->second.name; });
-            if (jt != _monitors.end()) {
-              LOG(ERROR) << "duplicate monitor config screen=" << i
-                         << " connector=(" << connector << ")"
-                         << " name=(" << it->second.name << ")";
-              success = false;
-            } else {
-              LOG(INFO) << "found monitor"
-                        << " name=(" << it->second.name << ")"
-                        << " screen=" << i
-                        << " connector=(" << connector << ")"
-                        << " width=" << rect.w
-                        << " height=" << rect.h
-                        << " xPos=" << rect.o.x
-                        << " yPos=" << rect.o.y;
-              _monitors.emplace_back(Monitor{it->second, rect, root, _argScreens.at(i), 0, 1, 1});
-            }
-          }
-          XRRFreeOutputInfo(output);
-        }
-        XRRFreeCrtcInfo(crtc);
-      }
-      XRRFreeScreenResources(res);
+    ewmhInit(root);
 
-      if (!success) {
-        LOG(ERROR) << "unable to identify monitors on this screen=" << i;
-        return false;
-      }
+    // Moving windows rather than drawing on the root, the server repaints
+    // what they uncover so nothing has to be grabbed
+    XSetWindowAttributes wa;
+    wa.override_redirect = True;
+    wa.background_pixel = _cfg.borderFocus;
+    for (Window& side : r.outline)
+      side = XCreateWindow(_disp, root, 0, 0, 1, 1, 0, CopyFromParent, InputOutput, CopyFromParent,
+                           CWOverrideRedirect | CWBackPixel, &wa);
+  }
+  timer.mark("roots");
+
+  // Identify monitors on each X screen, a snapshot already knows them
+  for (auto& [screen, outputs] : discovery) {
+    Window root = RootWindow(_disp, screen);
+    auto result = outputs.get();
+    if (!result) {
+      LOG(ERROR) << "unable to query XRandR screen=" << screen;
+      return false;
     }
-
-    // Start with focus on root window of first screen
-    if (i == 0) {
+    if (!discoverMonitors(root, screen, *result))
+      return false;
+  }
+  for (const auto& r : _roots)
+    indexMonitors(r.first);
+  timer.mark("monitors");
+
+  // Per monitor scratch, relayout fills it while mapping windows
+  _tiledScratch.resize(_monitors.size());
+  for (auto& tiled : _tiledScratch)
+    tiled.reserve(CLIENTS_RESERVED);
+  _rectsScratch.reserve(CLIENTS_RESERVED);
+
+  // Before anything is laid out, the bars take their strip off every monitor
+  _focusTitle.reserve(Bar::TEXT_RESERVED);
+  if (_cfg.bar)
+    openBars();
+
+  for (auto& [root, r] : _roots) {
+    // Start with focus on root window of first screen, a restart keeps focus where it was
+    if (r.screen == 0 && !restoring) {
       switchFocus(root);
-      _lastFocus = root;
+      setLastFocus(root);
     }
 
     // Add pre-existing windows on this screen
     XGrabServer(_disp);
     Window root2, parent; Window* children; uint32_t num;
+    Trace::Span span("XQueryTree", _disp, root);
     XQueryTree(_disp, root, &root2, &parent, &children, &num);
+    std::set<Window> existing(children, children + num);
+    if (restoring) {
+      // Snapshot clients that still exist skip the attribute and tree queries
+      for (const auto& rec : snap.clients) {
+        if (rec.root == root && existing.erase(rec.client) != 0)
+          restoreClient(rec, snap.lastFocus);
+      }
+    }
     for (uint32_t j = 0; j < num; ++j)
-      addClient(children[j], true);
+      if (existing.count(children[j]) != 0)
+        addClient(children[j], true);
     XFree(children);
     XUngrabServer(_disp);
   }
+  timer.mark("adopt");
+
+  if (restoring) {
+    if (auto it = _clients.find(snap.lastFocus); it != end(_clients)) {
+      setLastFocus(snap.lastFocus);
+      ewmhSetActive(it->second.root, _lastFocus);
+    } else if (!_roots.empty()) {
+      switchFocus(_roots.begin()->first);
+      setLastFocus(_roots.begin()->first);
+    }
+    LOG(INFO) << "restored from snapshot clients=" << _clients.size()
+              << " monitors=" << _monitors.size();
+  }
 
-  if (_monitors.size() != _argMonitorCfg.size()) {
+  if (_monitors.size() != _cfg.monitors.size()) {
     LOG(ERROR) << "did not detect all configured monitors";
     return false;
   }
 
+  for (const auto& r : _roots)
+    spawnPoolTerm(r.first);
+
+  // A missing index only costs the launcher, the rest still works
+  if (!_desktop.open(DesktopIndex::DefaultPath()))
+    LOG(WARN) << "launcher has no desktop entries";
+
+  startRecorder();
+  timer.mark("extras");
+
+  LOG(INFO) << "startup timing" << timer.report();
   return true;
 }
 
+bool Manager::discoverMonitors(Window root, int screen, const std::vector<XRROutput>& outputs)
+{
+  bool success = true;
+  for (const auto& out : outputs) {
+    const std::string& connector = out.connector;
+    const Rect& rect = out.r;
+
+    auto it = std::find_if(_cfg.monitors.begin(), _cfg.monitors.end(),
+        [&] (const auto& m) { return m.second.screen == screen && m.second.connector == connector; });
+    if (it == _cfg.monitors.end()) {
+      LOG(ERROR) << "missing config for monitor screen=" << screen << " connector=(" << connector << ")";
+      success = false;
+      break;
+    }
+    auto jt = std::find_if(_monitors.begin(), _monitors.end(),
+        [&] (const auto& mon) { return mon.cfg.name == it->second.name; });
+    if (jt != _monitors.end()) {
+      LOG(ERROR) << "duplicate monitor config screen=" << screen
+                 << " connector=(" << connector << ")"
+                 << " name=(" << it->second.name << ")";
+      success = false;
+      break;
+    }
+
+    LOG(INFO) << "found monitor"
+              << " name=(" << it->second.name << ")"
+              << " screen=" << screen
+              << " connector=(" << connector << ")"
+              << " width=" << rect.w
+              << " height=" << rect.h
+              << " xPos=" << rect.o.x
+              << " yPos=" << rect.o.y;
+    _monitors.emplace_back(Monitor{it->second, rect, root, _argScreens.at(screen), 0,
+                                   _cfg.gridXFor(it->second), _cfg.gridYFor(it->second),
+                                   _cfg.layoutFor(it->second)});
+  }
+
+  if (!success) {
+    LOG(ERROR) << "unable to identify monitors on this screen=" << screen;
+    return false;
+  }
+  return true;
+}
+
+bool Manager::restoreMonitors(Window root, const Snapshot& snap)
+{
+  const size_t prevSize = _monitors.size();
+  for (const auto& rec : snap.monitors) {
+    if (rec.root != root)
+      continue;
+    auto it = _cfg.monitors.find(rec.name);
+    if (it == _cfg.monitors.end()) {
+      LOG(WARN) << "snapshot monitor no longer configured name=(" << rec.name << ")";
+      while (_monitors.size() > prevSize)
+        _monitors.pop_back();
+      return false;
+    }
+    LOG(INFO) << "restored monitor"
+              << " name=(" << rec.name << ")"
+              << " width=" << rec.r.w
+              << " height=" << rec.r.h
+              << " xPos=" << rec.r.o.x
+              << " yPos=" << rec.r.o.y;
+    _monitors.emplace_back(Monitor{it->second, rec.r, root, _roots.at(root).absOrigin, 0,
+                                   rec.gridX, rec.gridY, Layout(rec.layout)});
+  }
+  return _monitors.size() != prevSize;
+}
+
 void Manager::addClient(Window w, bool checkIgn)
 {
   auto it = _clients.find(w);
   if (it != end(_clients)) {
-    LOG(ERROR) << "window=" << w << " is already framed!";
+    HOT_LOG(ERROR) << "window=" << w << " is already framed!";
     return;
   }
 
-  XWindowAttributes attrs;
-  XGetWindowAttributes(_disp, w, &attrs);
+  NewClient n;
+  n.place = !checkIgn;
+  if (queryClient(w, checkIgn, n))
+    manageClient(n);
+}
+
+bool Manager::queryClient(Window w, bool checkIgn, NewClient& n)
+{
+  if (!GetWinAttrs(_disp, w, n.attrs))
+    return false;
+  const auto& attrs = n.attrs;
 
   if (attrs.c_class == InputOnly || attrs.override_redirect) {
-    LOG(WARN) << "ignoring non-graphics window=" << w;
-    return;
+    HOT_LOG(WARN) << "ignoring non-graphics window=" << w;
+    return false;
   }
 
-  Client c;
+  Client& c = n.c;
   c.client = w;
-  c.root = GetWinRoot(_disp, w);
+  c.state = ClientState::Pending;
+  c.root = attrs.root;
   c.ign = checkIgn && (attrs.override_redirect || (attrs.map_state != IsViewable));
   c.absOrigin = _roots.at(c.root).absOrigin;
-  _clients.insert({w, c});
+  c.border = attrs.border_width;
+  if (!c.ign) {
+    c.hints = GetWinSizeHints(_disp, w);
+    c.syncCounter = getSyncCounter(w);
 
-  // For selecting focus
-  XGrabButton(_disp, 1, 0, w, false,
-              ButtonPressMask,
-              GrabModeSync, GrabModeAsync, None, None);
+    // Clients may ask for fullscreen before they are mapped
+    n.fullscreen = GetWinHasAtom(_disp, w, _atoms[XA::NET_WM_STATE], _atoms[XA::NET_WM_STATE_FULLSCREEN]);
+  }
+  return true;
+}
 
-  // For moving/resizing
-  XGrabButton(_disp, 1, NUMLOCK, w, false,
-              ButtonPressMask | ButtonMotionMask,
-              GrabModeAsync, GrabModeAsync, None, None);
-  XGrabButton(_disp, 3, NUMLOCK, w, false,
-              ButtonPressMask | ButtonMotionMask,
-              GrabModeAsync, GrabModeAsync, None, None);
+void Manager::manageClient(const NewClient& n)
+{
+  const Client& c = n.c;
+  auto attrs = n.attrs;
+  const Window w = c.client;
+
+  // Floating monitors get new windows in their largest free region, before
+  // the window is ever drawn somewhere else
+  const auto& root = _roots.at(c.root);
+  const size_t* on = root.monitors.containing(Point(attrs.x, attrs.y));
+  const size_t* target = on ? on : root.monitors.nearest(Point(attrs.x, attrs.y));
+  bool placed = false;
+  if (target && n.place && !n.fullscreen && !c.ign && !c.hints.userPos &&
+      _monitors[*target].layout == Layout::Float) {
+    Point at;
+    const int outerW = attrs.width + (2 * _cfg.borderThick);
+    const int outerH = attrs.height + (2 * _cfg.borderThick);
+    if (placeFree(_monitors[*target], outerW, outerH, at)) {
+      XMoveWindow(_disp, w, at.x, at.y);
+      attrs.x = at.x;
+      attrs.y = at.y;
+      placed = true;
+      HOT_LOG(INFO) << "placed in free space client=" << w << " xPos=" << at.x << " yPos=" << at.y;
+    }
+  }
 
-  // Grab keys with NUMLOCK modifier
-  static const std::set<int> KEYS = {
-    XK_D, XK_T, XK_M, XK_N, XK_G, XK_S, XK_P, XK_A, XK_O,
-    XK_Q, XK_W, XK_E
-  };
-  static const std::set<int> MOV_KEYS = { XK_H, XK_J, XK_K, XK_L };
-  for (int key : KEYS)
-    XGrabKey(_disp, XKeysymToKeycode(_disp, key), NUMLOCK, w, false, GrabModeAsync, GrabModeAsync);
-  for (int key : MOV_KEYS) {
-    XGrabKey(_disp, XKeysymToKeycode(_disp, key), NUMLOCK, w, false, GrabModeAsync, GrabModeAsync);
-    XGrabKey(_disp, XKeysymToKeycode(_disp, key), NUMLOCK | ShiftMask, w, false, GrabModeAsync, GrabModeAsync);
-    XGrabKey(_disp, XKeysymToKeycode(_disp, key), NUMLOCK | ControlMask, w, false, GrabModeAsync, GrabModeAsync);
-    XGrabKey(_disp, XKeysymToKeycode(_disp, key), NUMLOCK | Mod1Mask /*Alt*/, w, false, GrabModeAsync, GrabModeAsync);
+  auto [it, added] = _clients.insert({w, c});
+  if (!added)
+    it->second = c;
+  it->second.state = ClientState::Mapped;
+  if (w == _lastFocus)
+    setLastFocus(w); // Mapped again, the old handle died with the old entry
+
+  // Mapped again after a withdraw, keep what it was before maximizing
+  if (auto old = _withdrawn.find(w); old != end(_withdrawn)) {
+    if (old->second.state == ClientState::Unmapped)
+      it->second.preMax = old->second.preMax;
+    _withdrawn.erase(old);
   }
+  setGeom(it->second, Rect(attrs.x, attrs.y, attrs.width, attrs.height));
+
+  grabButtons(w, false);
 
-  XGrabKey(_disp, XKeysymToKeycode(_disp, XF86XK_AudioMute), AnyModifier, w, false, GrabModeAsync, GrabModeAsync);
-  XGrabKey(_disp, XKeysymToKeycode(_disp, XF86XK_AudioRaiseVolume), AnyModifier, w, false, GrabModeAsync, GrabModeAsync);
-  XGrabKey(_disp, XKeysymToKeycode(_disp, XF86XK_AudioLowerVolume), AnyModifier, w, false, GrabModeAsync, GrabModeAsync);
+  grabKeys(w);
 
-  XSelectInput(_disp, w, FocusChangeMask);
+  XSelectInput(_disp, w, CLIENT_EVENTS);
 
-  XSetWindowBorderWidth(_disp, w, BORDER_THICK);
-  XSetWindowBorder(_disp, w, BORDER_UNFOCUS);
+  XSetWindowBorderWidth(_disp, w, _cfg.borderThick);
+  XSetWindowBorder(_disp, w, _cfg.borderUnfocus);
 
   // Check to make sure we dont place a new client somewhere off the visible screens
-  if (std::find_if(begin(_monitors), end(_monitors), [&] (const auto& m) {
-        return m.root == c.root &&
-               m.r.contains(Point(attrs.x, attrs.y));
-      }) == end(_monitors))
-  {
-    LOG(INFO) << "new client started off visible monitors, relocating client=" << w;
-
-    std::vector<std::pair<Rect, Monitor*>> monitors;
-    for (auto& m : _monitors)
-      if (c.root == m.root)
-        monitors.emplace_back(m.r, &m);
-    auto* mon = closestRectFromPoint(Point(attrs.x, attrs.y), monitors);
-    if (mon) {
-      int curW = std::min(attrs.width + (2 * BORDER_THICK), mon->r.w);
-      int curH = std::min(attrs.height + (2 * BORDER_THICK), mon->r.h);
+  if (!placed && on == nullptr) {
+    HOT_LOG(INFO) << "new client started off visible monitors, relocating client=" << w;
+
+    if (target) {
+      auto* mon = &_monitors[*target];
+      int curW = std::min(attrs.width + (2 * _cfg.borderThick), mon->r.w);
+      int curH = std::min(attrs.height + (2 * _cfg.borderThick), mon->r.h);
       bool border = curW != mon->r.w || curH != mon->r.h;
       XWindowChanges changes;
       changes.x = mon->r.getCenter().x - (curW / 2);
       changes.y = mon->r.getCenter().y - (curH / 2);
-      changes.width = curW - ((border ? 2 : 0) * BORDER_THICK);
-      changes.height = curH - ((border ? 2 : 0) * BORDER_THICK);
+      changes.width = curW - ((border ? 2 : 0) * _cfg.borderThick);
+      changes.height = curH - ((border ? 2 : 0) * _cfg.borderThick);
       XConfigureWindow(_disp, w, (CWX | CWY | CWWidth | CWHeight), &changes);
-      XSetWindowBorderWidth(_disp, w, border ? BORDER_THICK : 0);
+      XSetWindowBorderWidth(_disp, w, border ? _cfg.borderThick : 0);
     } else {
-      LOG(ERROR) << "nowhere visible to put new client=" << w;
+      HOT_LOG(ERROR) << "nowhere visible to put new client=" << w;
     }
-  } else {
+  } else if (!placed) {
     // Hide border if new window is already maximized to a monitor
     Rect rect(attrs.x, attrs.y, attrs.width, attrs.height);
     bool border = std::none_of(begin(_monitors), end(_monitors),
         [&] (const auto& m) { return m.root == c.root && m.r == rect; });
-    XSetWindowBorderWidth(_disp, w, border ? BORDER_THICK : 0);
+    XSetWindowBorderWidth(_disp, w, border ? _cfg.borderThick : 0);
   }
 
   XMapWindow(_disp, w);
-  LOG(INFO) << "added client=" << w;
+  ewmhAddClient(c);
+  HOT_LOG(INFO) << "added client=" << w;
+
+  if (n.fullscreen)
+    setFullscreen(_clients.at(w), true);
+  else if (!c.ign)
+    relayout(c.root);
+}
+
+void Manager::restoreClient(const Snapshot::ClientRec& rec, Window focus)
+{
+  Client c;
+  c.client = rec.client;
+  c.root = rec.root;
+  c.preMax = rec.preMax;
+  c.ign = rec.ign;
+  c.absOrigin = _roots.at(c.root).absOrigin;
+  c.fullscreen = rec.fullscreen;
+  c.preFull = rec.preFull;
+  c.preFullBorder = rec.preFullBorder;
+  c.hints = rec.hints;
+  c.syncCounter = rec.syncCounter;
+  c.state = ClientState::Mapped;
+  auto& client = _clients.insert({c.client, c}).first->second;
+  if (c.client == _lastFocus)
+    setLastFocus(c.client);
+  XWindowAttributes attrs;
+  if (GetWinAttrs(_disp, c.client, attrs)) {
+    setGeom(client, Rect(attrs.x, attrs.y, attrs.width, attrs.height));
+    client.border = attrs.border_width;
+  }
+
+  // Grabs and selections died with the old connection, border and geometry did not
+  grabKeys(c.client);
+  if (!c.fullscreen) {
+    grabButtons(c.client, c.client == focus);
+    XSelectInput(_disp, c.client, CLIENT_EVENTS);
+  }
+
+  ewmhAddClient(c);
+  LOG(INFO) << "restored client=" << c.client;
+}
+
+XSyncCounter Manager::getSyncCounter(Window w)
+{
+  if (_syncAlarm == None)
+    return None;
+
+  Atom* protocols = nullptr;
+  int num = 0;
+  bool sync = false;
+  Trace::Span span("XGetWMProtocols", _disp, w);
+  if (XGetWMProtocols(_disp, w, &protocols, &num) != 0) {
+    sync = std::find(protocols, protocols + num, _atoms[XA::NET_WM_SYNC_REQUEST]) != protocols + num;
+    XFree(protocols);
+  }
+  if (!sync)
+    return None;
+
+  unsigned long counter;
+  if (!GetWinCardinal(_disp, w, _atoms[XA::NET_WM_SYNC_REQUEST_COUNTER], counter))
+    return None;
+  return XSyncCounter(counter);
+}
+
+void Manager::grabButtons(Window w, bool focused)
+{
+  // For selecting focus
+  if (!focused) {
+    XGrabButton(_disp, 1, 0, w, false,
+                ButtonPressMask,
+                GrabModeSync, GrabModeAsync, None, None);
+  }
+
+  // For moving/resizing
+  XGrabButton(_disp, 1, NUMLOCK, w, false,
+              ButtonPressMask | ButtonReleaseMask | ButtonMotionMask,
+              GrabModeAsync, GrabModeAsync, None, None);
+  XGrabButton(_disp, 3, NUMLOCK, w, false,
+              ButtonPressMask | ButtonReleaseMask | ButtonMotionMask,
+              GrabModeAsync, GrabModeAsync, None, None);
+}
+
+void Manager::setFullscreen(Client& c, bool on)
+{
+  if (c.fullscreen == on || c.ign)
+    return;
+
+  HOT_LOG(INFO) << "fullscreen client=" << c.client << " on=" << on;
+
+  if (on) {
+    const Rect cur = c.geom;
+    const size_t* near = _roots.at(c.root).monitors.nearest(cur.getCenter());
+    if (near == nullptr) {
+      HOT_LOG(ERROR) << "no monitor to fullscreen client=" << c.client;
+      return;
+    }
+    auto* mon = &_monitors[*near];
+
+    c.fullscreen = true;
+    c.preFull = cur;
+    c.preFullBorder = c.border;
+
+    // Get out of the way, input goes straight to the client until it leaves
+    // fullscreen. The key grabs stay: they only take the Numlock bindings,
+    // every other key is delivered by the server without mwm seeing it, and
+    // without them there would be no way to leave, close or move the window.
+    XUngrabButton(_disp, AnyButton, AnyModifier, c.client);
+    XSelectInput(_disp, c.client, NoEventMask);
+
+    XSetWindowBorderWidth(_disp, c.client, 0);
+    XMoveResizeWindow(_disp, c.client, mon->r.o.x, mon->r.o.y, unsigned(mon->r.w), unsigned(mon->r.h));
+    XRaiseWindow(_disp, c.client);
+
+    SetWinHasAtom(_disp, c.client, _atoms[XA::NET_WM_STATE], _atoms[XA::NET_WM_STATE_FULLSCREEN], true);
+  } else {
+    c.fullscreen = false;
+
+    Window curFocus = GetFocus(_disp);
+    bool focused = curFocus == c.client;
+
+    XSelectInput(_disp, c.client, CLIENT_EVENTS);
+    grabButtons(c.client, focused);
+
+    XMoveResizeWindow(_disp, c.client, c.preFull.o.x, c.preFull.o.y,
+                      unsigned(c.preFull.w), unsigned(c.preFull.h));
+    XSetWindowBorderWidth(_disp, c.client, unsigned(c.preFullBorder));
+    XSetWindowBorder(_disp, c.client, focused ? _cfg.borderFocus : _cfg.borderUnfocus);
+
+    SetWinHasAtom(_disp, c.client, _atoms[XA::NET_WM_STATE], _atoms[XA::NET_WM_STATE_FULLSCREEN], false);
+  }
+
+  // The rest of the monitor takes over or gives back the space
+  relayout(c.root);
 }
 
 void Manager::run()
 {
-  // Main event loop
-  for (;;) {
-    XEvent e;
-    ::bzero(&e, sizeof(e));
-    XNextEvent(_disp, &e); // Blocks until the next event
-
-    LOG(INFO) << "new X event"
-      << " serial=" << e.xany.serial
-      << " send_event=" << e.xany.send_event
-      << " window=" << e.xany.window
-      << " type=" << XEventToString(e);
-
-    switch (e.type) {
-      // Ignore these events
-      case ReparentNotify:
-      case MapNotify:
-      case MappingNotify:
-      case ConfigureNotify:
-      case CreateNotify:
-      case DestroyNotify:
-      case KeyRelease:
-        break;
+  pollfd fds[] = {
+    { ConnectionNumber(_disp), POLLIN, 0 },
+    { _inotify, POLLIN, 0 },
+    { _desktop.fd(), POLLIN, 0 },
+  };
 
-      case MapRequest:
-        onReq_Map(e.xmaprequest);
-        break;
-      case UnmapNotify:
-        onNot_Unmap(e.xunmap);
-        break;
-      case ConfigureRequest:
-        onReq_Configure(e.xconfigurerequest);
-        break;
+  // Main event loop, runs until a restart is requested
+  bool first = true;
+  while (_restartPath.empty()) {
+    // Drain everything Xlib has already read before sleeping
+    while (XPending(_disp)) {
+      XEvent e;
+      ::bzero(&e, sizeof(e));
+      XNextEvent(_disp, &e);
+      {
+        Watchdog::Scope watch(_watchdog, XEventToString(e), e.xany.window, e.xany.serial);
+        dispatch(e);
+      }
+      if (first) {
+        first = false;
+        LOG(INFO) << "startup first event handled ms="
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _started).count();
+      }
+    }
 
-      case MotionNotify:
-        //TODO: while (XCheckTypedWindowEvent(_disp, e.xmotion.window, MotionNotify, &e)); // Get latest
-        onNot_Motion(e.xbutton);
-        break;
+    // Idle, the bars catch up with everything handled above at once
+    updateBars();
 
-      case FocusIn:
-        handleFocusChange(e.xfocus, true);
-        break;
-      case FocusOut:
-        handleFocusChange(e.xfocus, false);
-        break;
+    // Idle, spans written now never overlap one
+    Trace::flush();
 
-      case KeyPress:
-        onKeyPress(e.xkey);
-        break;
-      case ButtonPress:
-        onBtnPress(e.xbutton);
-        break;
+    if (poll(fds, sizeof(fds) / sizeof(pollfd), pollTimeout()) < 0 && errno != EINTR) {
+      LOG(ERROR) << "poll failed errno=" << errno;
+      return;
+    }
+    {
+      Trace::Span span("onTimeout", "loop");
+      Watchdog::Scope watch(_watchdog, "onTimeout");
+      ErrorLog::mark("onTimeout");
+      onTimeout();
+    }
 
-      case ClientMessage:
-        onClientMessage(e.xclient);
-        break;
+    if (fds[1].revents & POLLIN) {
+      Trace::Span span("onConfigChanged", "loop");
+      Watchdog::Scope watch(_watchdog, "onConfigChanged");
+      ErrorLog::mark("onConfigChanged");
+      onConfigChanged();
+    }
+    if (fds[2].revents & POLLIN) {
+      Trace::Span span("desktopChanged", "loop");
+      Watchdog::Scope watch(_watchdog, "desktopChanged");
+      ErrorLog::mark("desktopChanged");
+      _desktop.onChanged();
+      _launcher.refilter();
+    }
+  }
+}
 
-      default:
-        LOG(ERROR) << "XEvent not yet handled type=" << e.type
-                   << " event=(" << XEventToString(e) << ")";
+void Manager::dispatch(const XEvent& e)
+{
+  Trace::Span span(XEventToString(e), "event", e.xany.window, e.xany.serial);
+  LOG(INFO) << "new X event"
+    << " serial=" << e.xany.serial
+    << " send_event=" << e.xany.send_event
+    << " window=" << e.xany.window
+    << " type=" << XEventToString(e);
+
+  // Opened after logging, what the logger allocates is not the handler's
+  AllocScope alloc(XEventToString(e), IsHotEvent(e.type, _syncEventBase));
+
+  ErrorLog::mark(XEventToString(e));
+
+  switch (e.type) {
+    // Ignore these events
+    case ReparentNotify:
+    case MapNotify:
+    case MappingNotify:
+    case KeyRelease:
+      break;
+
+    case CreateNotify:
+      // The id was freed and handed out again
+      if (isDead(e.xcreatewindow.window)) {
+        _withdrawn.erase(e.xcreatewindow.window);
+        LOG(INFO) << "window id reused window=" << e.xcreatewindow.window;
+      }
+      break;
+
+    case MapRequest:
+      onReq_Map(e.xmaprequest);
+      break;
+    case UnmapNotify:
+      onNot_Unmap(e.xunmap);
+      break;
+    case DestroyNotify:
+      onNot_Destroy(e.xdestroywindow);
+      break;
+    case ConfigureRequest:
+      onReq_Configure(e.xconfigurerequest);
+      break;
+    case ConfigureNotify:
+      onNot_Configure(e.xconfigure);
+      break;
+
+    case MotionNotify:
+      //TODO: while (XCheckTypedWindowEvent(_disp, e.xmotion.window, MotionNotify, &e)); // Get latest
+      onNot_Motion(e.xbutton);
+      break;
+
+    case FocusIn:
+      handleFocusChange(e.xfocus, true);
+      break;
+
+    case EnterNotify:
+      onNot_Enter(e.xcrossing);
+      break;
+    case FocusOut:
+      handleFocusChange(e.xfocus, false);
+      break;
+
+    case KeyPress:
+      onKeyPress(e.xkey);
+      break;
+    case ButtonPress:
+      onBtnPress(e.xbutton);
+      break;
+    case ButtonRelease:
+      onBtnRelease(e.xbutton);
+      break;
+
+    case ClientMessage:
+      onClientMessage(e.xclient);
+      break;
+
+    case PropertyNotify:
+      onNot_Property(e.xproperty);
+      break;
+
+    case Expose:
+      if (e.xexpose.window == _launcher.window() && e.xexpose.count == 0) {
+        _launcher.expose();
         break;
-    }
+      }
+      for (auto& bar : _bars)
+        if (e.xexpose.window == bar.window())
+          bar.expose(e.xexpose);
+      break;
+
+    default:
+      if (_syncAlarm != None && e.type == _syncEventBase + XSyncAlarmNotify) {
+        onSyncAlarm(reinterpret_cast<const XSyncAlarmNotifyEvent&>(e));
+        break;
+      }
+      LOG(ERROR) << "XEvent not yet handled type=" << e.type
+                 << " event=(" << XEventToString(e) << ")";
+      break;
   }
 }
 
 /// X Event Handlers ///////////////////////////////////////////////////////////
 
+void Manager::onNot_Property(const XPropertyEvent& e)
+{
+  auto it = _clients.find(e.window);
+  if (it == end(_clients) || it->second.ign || isDead(e.window))
+    return;
+
+  if (e.atom == XA_WM_NORMAL_HINTS) {
+    it->second.hints = GetWinSizeHints(_disp, e.window);
+    LOG(INFO) << "updated size hints window=" << e.window;
+  } else if (e.atom == _atoms[XA::NET_WM_SYNC_REQUEST_COUNTER] || e.atom == _atoms[XA::WM_PROTOCOLS]) {
+    it->second.syncCounter = getSyncCounter(e.window);
+  } else if ((e.atom == XA_WM_NAME || e.atom == _atoms[XA::NET_WM_NAME]) && e.window == _lastFocus) {
+    updateFocusTitle();
+  }
+}
+
 void Manager::onReq_Map(const XMapRequestEvent& e)
 {
-  LOG(INFO) << "request=Map window=" << e.window;
+  HOT_LOG(INFO) << "request=Map window=" << e.window;
 
+  if (isDead(e.window)) {
+    HOT_LOG(INFO) << "dropped map of destroyed window=" << e.window;
+    return;
+  }
+  if (holdPoolTerm(e))
+    return;
   addClient(e.window, false);
 }
 
 void Manager::onNot_Unmap(const XUnmapEvent& e)
 {
-  LOG(INFO) << "notify=Unmap window=" << e.window;
+  HOT_LOG(INFO) << "notify=Unmap window=" << e.window;
 
   auto it = _clients.find(e.window);
   if (it != end(_clients)) {
+    Window root = it->second.root;
+    ewmhRemoveClient(it->second);
+    _clientRects.erase(e.window);
+    ++_geomGen;
+    // Kept until destroyed, a remap picks its state back up
+    Client c = it->second;
+    c.state = ClientState::Unmapped;
+    _clients.erase(it);
+    auto [old, added] = _withdrawn.insert({e.window, c});
+    if (!added)
+      old->second = c;
+    HOT_LOG(INFO) << "withdrawn client=" << e.window;
+    relayout(root);
+  }
+}
+
+void Manager::onNot_Destroy(const XDestroyWindowEvent& e)
+{
+  if (e.event != e.window && isDead(e.window))
+    return; // Already seen through the window's own selection
+
+  _clientRects.erase(e.window);
+  ++_geomGen;
+  if (_drag.w == e.window)
+    cancelDrag();
+  if (_lastFocus == e.window && !_roots.empty())
+    setLastFocus(_roots.begin()->first);
+
+  // Normally unmapped first, a client destroyed while mapped is removed here
+  if (auto it = _clients.find(e.window); it != end(_clients)) {
+    Window root = it->second.root;
+    ewmhRemoveClient(it->second);
     _clients.erase(it);
-    LOG(INFO) << "deleted client=" << e.window;
+    LOG(INFO) << "deleted destroyed client=" << e.window;
+    relayout(root);
+  }
+
+  // Only a held terminal matters, it never became a client
+  for (auto& [root, pool] : _termPool) {
+    if (pool.ready && pool.n.c.client == e.window) {
+      LOG(WARN) << "pooled terminal died window=" << e.window;
+      pool = PoolTerm();
+    }
   }
+
+  markDead(e.window);
+}
+
+void Manager::onNot_Configure(const XConfigureEvent& e)
+{
+  auto it = _clients.find(e.window);
+  if (it == end(_clients))
+    return;
+
+  setGeom(it->second, Rect(e.x, e.y, e.width, e.height));
+  it->second.border = e.border_width;
 }
 
 void Manager::onReq_Configure(const XConfigureRequestEvent& e)
 {
-  LOG(INFO) << "request=Configure window=" << e.window;
+  HOT_LOG(INFO) << "request=Configure window=" << e.window;
+
+  if (isDead(e.window)) {
+    HOT_LOG(INFO) << "dropped configure of destroyed window=" << e.window;
+    return;
+  }
+
+  // Fullscreen and tiled clients keep the geometry mwm gave them, they are
+  // told where they are instead (ICCCM 4.1.5)
+  auto it = _clients.find(e.window);
+  Client* c = (it != end(_clients) && !it->second.ign) ? &it->second : nullptr;
+  if (c != nullptr) {
+    const Monitor* mon = monitorAt(c->root, c->geom.getCenter());
+    if (c->fullscreen || (mon != nullptr && mon->layout != Layout::Float)) {
+      sendConfigureNotify(*c);
+      return;
+    }
+  }
 
   XWindowChanges changes;
   bzero(&changes, sizeof(changes));
@@ -399,18 +1081,40 @@ void Manager::onReq_Configure(const XConfigureRequestEvent& e)
     changeMask |= CWHeight;
   }
 
-  XConfigureWindow(_disp, e.window, changeMask, &changes);
-
-  // Hide border if newly-placed window is maximized to a monitor
-  {
-    XWindowAttributes attrs;
-    XGetWindowAttributes(_disp, e.window, &attrs);
-    auto root = GetWinRoot(_disp, e.window);
-    Rect rect(attrs.x, attrs.y, attrs.width, attrs.height);
+  // Hide the border of a floating window sized to its monitor. Unmanaged
+  // windows get theirs when they are mapped.
+  if (c != nullptr) {
+    Rect rect = c->geom;
+    if (changeMask & CWX)      rect.o.x = changes.x;
+    if (changeMask & CWY)      rect.o.y = changes.y;
+    if (changeMask & CWWidth)  rect.w = changes.width;
+    if (changeMask & CWHeight) rect.h = changes.height;
     bool border = std::none_of(begin(_monitors), end(_monitors),
-        [&] (const auto& m) { return m.root == root && m.r == rect; });
-    XSetWindowBorderWidth(_disp, e.window, border ? BORDER_THICK : 0);
+        [&] (const auto& m) { return m.root == c->root && m.r == rect; });
+    changes.border_width = border ? _cfg.borderThick : 0;
+    if (changes.border_width != c->border)
+      changeMask |= CWBorderWidth;
   }
+
+  XConfigureWindow(_disp, e.window, changeMask, &changes);
+}
+
+void Manager::sendConfigureNotify(const Client& c)
+{
+  XConfigureEvent ce;
+  bzero(&ce, sizeof(ce));
+  ce.type = ConfigureNotify;
+  ce.display = _disp;
+  ce.event = c.client;
+  ce.window = c.client;
+  ce.x = c.geom.o.x;
+  ce.y = c.geom.o.y;
+  ce.width = c.geom.w;
+  ce.height = c.geom.h;
+  ce.border_width = c.border;
+  ce.above = None;
+  ce.override_redirect = False;
+  XSendEvent(_disp, c.client, False, StructureNotifyMask, (XEvent*) &ce);
 }
 
 void Manager::onNot_Motion(const XButtonEvent& e)
@@ -419,55 +1123,229 @@ void Manager::onNot_Motion(const XButtonEvent& e)
     return;
 
   auto client = _drag.w;
-  if (_clients.find(client) == end(_clients)) {
-    LOG(ERROR) << "client not found for motion event client=" << client;
+  Client* c = _clients.get(_drag.client);
+  if (c == nullptr) {
+    HOT_LOG(ERROR) << "client not found for motion event client=" << client;
     return;
   }
 
   int xdiff = e.x_root - _drag.xR;
   int ydiff = e.y_root - _drag.yR;
 
+  // Edges on the monitor under the pointer, outer sizes include the border
+  const EdgeIndex* edges = _cfg.snapDist > 0 ? edgesAt(e.root, Point(e.x_root, e.y_root)) : nullptr;
+  const int border2 = 2 * _cfg.borderThick;
+
   if (_drag.btn == 1) {
     // Alt-LeftClick moves window around
-    XMoveWindow(_disp, client, _drag.x + xdiff, _drag.y + ydiff);
-    XSetWindowBorderWidth(_disp, client, BORDER_THICK);
+    int nx = _drag.x + xdiff, ny = _drag.y + ydiff;
+    if (edges) {
+      nx += SnapSpan(*edges, true, nx, _drag.width + border2, _cfg.snapDist);
+      ny += SnapSpan(*edges, false, ny, _drag.height + border2, _cfg.snapDist);
+    }
+    if (_cfg.dragOutline) {
+      drawOutline(Rect(nx, ny, _drag.width, _drag.height));
+      return;
+    }
+    XMoveWindow(_disp, client, nx, ny);
+    XSetWindowBorderWidth(_disp, client, _cfg.borderThick);
+    setGeom(*c, Rect(nx, ny, c->geom.w, c->geom.h));
   }
   else if (_drag.btn == 3) {
-    // Alt-RightClick resizes
-    int nx, ny, nw, nh;
-    switch(_drag.dirVert) {
-      case DIR::Up:
-        ny = _drag.y + ydiff;
-        nh = std::max(25, _drag.height - ydiff);
-        break;
-      case DIR::Down:
-        ny = _drag.y;
-        nh = std::max(25, _drag.height + ydiff);
-        break;
-      default:
-        ny = _drag.y;
-        nh = _drag.height;
-        break;
+    // Alt-RightClick resizes, within the client's size hints
+    int nw = _drag.width, nh = _drag.height;
+    if (_drag.dirVert == DIR::Up)
+      nh = std::max(25, _drag.height - ydiff);
+    else if (_drag.dirVert == DIR::Down)
+      nh = std::max(25, _drag.height + ydiff);
+    if (_drag.dirHorz == DIR::Left)
+      nw = std::max(25, _drag.width - xdiff);
+    else if (_drag.dirHorz == DIR::Right)
+      nw = std::max(25, _drag.width + xdiff);
+
+    // Only the edges being pulled snap
+    int d;
+    if (edges && _drag.dirHorz == DIR::Left && edges->snapX(_drag.x + _drag.width - nw, _cfg.snapDist, d))
+      nw -= d;
+    else if (edges && _drag.dirHorz == DIR::Right && edges->snapX(_drag.x + nw + border2, _cfg.snapDist, d))
+      nw += d;
+    if (edges && _drag.dirVert == DIR::Up && edges->snapY(_drag.y + _drag.height - nh, _cfg.snapDist, d))
+      nh -= d;
+    else if (edges && _drag.dirVert == DIR::Down && edges->snapY(_drag.y + nh + border2, _cfg.snapDist, d))
+      nh += d;
+    c->hints.constrain(nw, nh);
+
+    // Keep the opposite edge still when pulling the top or left one
+    int nx = (_drag.dirHorz == DIR::Left) ? _drag.x + _drag.width - nw : _drag.x;
+    int ny = (_drag.dirVert == DIR::Up) ? _drag.y + _drag.height - nh : _drag.y;
+
+    if (_cfg.dragOutline) {
+      drawOutline(Rect(nx, ny, nw, nh));
+      return;
     }
-    switch(_drag.dirHorz) {
-      case DIR::Left:
-        nx = _drag.x + xdiff;
-        nw = std::max(25, _drag.width - xdiff);
-        break;
-      case DIR::Right:
-        nx = _drag.x;
-        nw = std::max(25, _drag.width + xdiff);
-        break;
-      default:
-        nx = _drag.x;
-        nw = _drag.width;
-        break;
+    resizeClient(*c, Rect(nx, ny, nw, nh));
+  }
+}
+
+void Manager::resizeClient(Client& c, const Rect& r)
+{
+  // Pace with _NET_WM_SYNC_REQUEST, only one size in flight at a time
+  if (_drag.sync) {
+    if (_drag.syncWaiting) {
+      _drag.syncNext = r;
+      _drag.syncHasNext = true;
+      return;
+    }
+
+    ++_drag.syncValue;
+    XEvent event;
+    ::bzero(&event, sizeof(event));
+    event.xclient.type = ClientMessage;
+    event.xclient.window = c.client;
+    event.xclient.message_type = _atoms[XA::WM_PROTOCOLS];
+    event.xclient.format = 32;
+    event.xclient.data.l[0] = long(_atoms[XA::NET_WM_SYNC_REQUEST]);
+    event.xclient.data.l[1] = CurrentTime;
+    event.xclient.data.l[2] = long(_drag.syncValue & 0xFFFFFFFF);
+    event.xclient.data.l[3] = long(_drag.syncValue >> 32);
+    XSendEvent(_disp, c.client, false, NoEventMask, &event);
+
+    XSyncAlarmAttributes attr;
+    XSyncIntsToValue(&attr.trigger.wait_value, unsigned(_drag.syncValue & 0xFFFFFFFF),
+                     int(_drag.syncValue >> 32));
+    XSyncChangeAlarm(_disp, _syncAlarm, XSyncCAValue, &attr);
+
+    _drag.syncWaiting = true;
+    _drag.syncDeadline = std::chrono::steady_clock::now() + SYNC_TIMEOUT;
+  }
+
+  XMoveResizeWindow(_disp, c.client, r.o.x, r.o.y, unsigned(r.w), unsigned(r.h));
+  XSetWindowBorderWidth(_disp, c.client, _cfg.borderThick);
+  setGeom(c, r);
+}
+
+void Manager::onSyncAlarm(const XSyncAlarmNotifyEvent& e)
+{
+  if (e.alarm != _syncAlarm || !_drag.syncWaiting)
+    return;
+
+  // Client caught up with the last size, send the newest one
+  _drag.syncWaiting = false;
+  if (_drag.syncHasNext) {
+    _drag.syncHasNext = false;
+    if (Client* c = _clients.get(_drag.client))
+      resizeClient(*c, _drag.syncNext);
+  }
+}
+
+void Manager::onTimeout()
+{
+  if (_drag.syncWaiting && std::chrono::steady_clock::now() >= _drag.syncDeadline) {
+    LOG(WARN) << "sync request timed out, resizing unpaced client=" << _drag.w;
+    _drag.sync = false;
+    _drag.syncWaiting = false;
+    if (_drag.syncHasNext) {
+      _drag.syncHasNext = false;
+      if (Client* c = _clients.get(_drag.client))
+        resizeClient(*c, _drag.syncNext);
+    }
+  }
+
+  // The pointer settled, only now does the crossing cost a focus change
+  if (_focusPending != None && std::chrono::steady_clock::now() >= _focusDeadline) {
+    Window w = _focusPending;
+    const Client* c = _clients.get(_focusPendingClient);
+    _focusPending = None;
+    if (c != nullptr && w != _lastFocus) {
+      LOG(INFO) << "focus follows mouse window=" << w;
+      switchFocus(w);
     }
-    XMoveResizeWindow(_disp, client, nx, ny, nw, nh);
-    XSetWindowBorderWidth(_disp, client, BORDER_THICK);
   }
 }
 
+int Manager::pollTimeout() const
+{
+  // Rounded up, waking early would only spin until the deadline
+  auto leftMs = [] (std::chrono::steady_clock::time_point deadline) {
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    return int(std::max<decltype(left)>(0, left));
+  };
+  int timeout = -1;
+  if (_drag.syncWaiting)
+    timeout = leftMs(_drag.syncDeadline);
+  if (_focusPending != None) {
+    int focus = leftMs(_focusDeadline);
+    timeout = (timeout < 0) ? focus : std::min(timeout, focus);
+  }
+  return timeout;
+}
+
+void Manager::onNot_Enter(const XCrossingEvent& e)
+{
+  if (!_cfg.focusMouse || e.mode != NotifyNormal || e.detail == NotifyInferior)
+    return;
+  if (_drag.w != 0 || _gridActive || _launcher.isOpen())
+    return;
+
+  // Root coordinates repeat across screens, compare crossings in absolute ones
+  auto rit = _roots.find(e.root);
+  if (rit == end(_roots))
+    return;
+  Point abs = Point(e.x_root, e.y_root) + rit->second.absOrigin;
+
+  // A window moved or raised under a still pointer is not the user pointing at it
+  if (abs == _enterAbs)
+    return;
+  _enterAbs = abs;
+
+  auto it = _clients.find(e.window);
+  if (it == end(_clients) || it->second.ign) {
+    _focusPending = None;
+    return;
+  }
+
+  // Every crossing restarts the wait, a sweep over many windows ends up
+  // focusing only the last one
+  _focusPending = e.window == _lastFocus ? None : e.window;
+  _focusPendingClient = _clients.handle(it);
+  _focusDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_cfg.focusDelayMs);
+}
+
+void Manager::onBtnRelease(const XButtonEvent& e)
+{
+  if (_drag.w == 0 || int(e.button) != _drag.btn)
+    return;
+
+  HOT_LOG(INFO) << "btnRelease"
+            << " window=" << e.window
+            << " button=" << e.button;
+
+  Client* c = _clients.get(_drag.client);
+
+  // The only request the client sees for the whole outline drag
+  if (_drag.outlined) {
+    Rect r = _drag.outline;
+    drawOutline(Rect());
+    if (c != nullptr) {
+      XMoveResizeWindow(_disp, _drag.w, r.o.x, r.o.y, unsigned(r.w), unsigned(r.h));
+      XSetWindowBorderWidth(_disp, _drag.w, _cfg.borderThick);
+      setGeom(*c, r);
+    }
+  } else if (_drag.syncHasNext) {
+    // Don't leave the final size behind an unacknowledged one
+    const Rect& r = _drag.syncNext;
+    XMoveResizeWindow(_disp, _drag.w, r.o.x, r.o.y, unsigned(r.w), unsigned(r.h));
+    if (c != nullptr)
+      setGeom(*c, r);
+  }
+  _drag = {};
+
+  // Tiled windows dropped on another monitor join its layout, the rest
+  // fall back into place
+  if (c != nullptr)
+    relayout(c->root);
+}
+
 void Manager::onKeyPress(const XKeyEvent& e)
 {
   LOG(INFO) << "keyPress"
@@ -477,82 +1355,58 @@ void Manager::onKeyPress(const XKeyEvent& e)
             << " state=" << e.state;
 
   if (_gridActive) {
+    Trace::Span span("grid", "handler", e.window, e.serial);
     onKeyGridActive(e);
     return;
   }
-
-  if (e.keycode == XKeysymToKeycode(_disp, XF86XK_AudioMute)) {
-    system("pactl set-sink-mute @DEFAULT_SINK@ toggle");
-    system("pactl play-sample bell.oga");
-    return;
-  }
-  if (e.keycode == XKeysymToKeycode(_disp, XF86XK_AudioRaiseVolume)) {
-    system("pactl set-sink-volume @DEFAULT_SINK@ +1000");
-    system("pactl set-sink-mute @DEFAULT_SINK@ 0");
-    system("pactl play-sample bell.oga");
-    return;
-  }
-  if (e.keycode == XKeysymToKeycode(_disp, XF86XK_AudioLowerVolume)) {
-    system("pactl set-sink-volume @DEFAULT_SINK@ -1000");
-    system("pactl set-sink-mute @DEFAULT_SINK@ 0");
-    system("pactl play-sample bell.oga");
+  if (_launcher.isOpen()) {
+    Trace::Span span("launcher", "handler", e.window, e.serial);
+    onKeyLauncherActive(e);
     return;
   }
 
-  if (!(e.state & NUMLOCK)) {
-    if (_roots.find(e.window) == _roots.end())
-      LOG(ERROR) << "captured non-modifier keyPress keyCode=" << e.keycode;
-    return;
-  }
-
-  if (e.keycode == XKeysymToKeycode(_disp, XK_T))
-    onKeyTerminal(e);
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_G))
-    onKeyGrid(e);
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_S))
-    onKeySnapGrid(e);
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_H) ||
-           e.keycode == XKeysymToKeycode(_disp, XK_J) ||
-           e.keycode == XKeysymToKeycode(_disp, XK_K) ||
-           e.keycode == XKeysymToKeycode(_disp, XK_L)) {
-    if (e.state & ShiftMask)
-      onKeyMoveGridLoc(e);
-    else if (e.state & ControlMask)
-      onKeyMoveGridSize(e);
-    else if (e.state & Mod1Mask)
-      onKeyMoveMonitor(e);
-    else
-      onKeyMoveFocus(e);
-  }
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_M))
-    onKeyMaximize(e);
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_N))
-    onKeyUnmaximize(e);
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_D))
-    onKeyClose(e);
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_P))
-    system("slock");
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_A))
-    onKeyLauncher(e);
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_O))
-    onKeyScreenshot(e);
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_Q)) {
-    system("pactl set-sink-volume @DEFAULT_SINK@ +1000");
-    system("pactl set-sink-mute @DEFAULT_SINK@ 0");
-    system("pactl play-sample bell.oga");
-  }
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_W)) {
-    system("pactl set-sink-volume @DEFAULT_SINK@ -1000");
-    system("pactl set-sink-mute @DEFAULT_SINK@ 0");
-    system("pactl play-sample bell.oga");
-  }
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_E)) {
-    system("pactl set-sink-mute @DEFAULT_SINK@ toggle");
-    system("pactl play-sample bell.oga");
+  // Only the modifiers bindings care about, ignore caps lock and friends
+  const unsigned state = e.state & (ShiftMask | ControlMask | Mod1Mask | Mod2Mask | Mod4Mask);
+
+  const Binding* bind = nullptr;
+  for (size_t i = 0; i < _cfg.bindings.size() && bind == nullptr; ++i) {
+    const auto& b = _cfg.bindings[i];
+    if (_bindCodes[i] == e.keycode && (b.mods == AnyModifier || b.mods == state))
+      bind = &b;
   }
-  else {
+
+  if (bind == nullptr) {
     if (_roots.find(e.window) == _roots.end())
       LOG(ERROR) << "unhandled keyPress keyCode=" << e.keycode;
+    return;
+  }
+
+  Trace::Span span(ActionToString(bind->action), "handler", e.window, e.serial);
+  AllocScope alloc(ActionToString(bind->action), IsHotAction(bind->action));
+  ErrorLog::mark(ActionToString(bind->action));
+  switch (bind->action) {
+    case Action::Terminal:     onKeyTerminal(e); break;
+    case Action::Close:        onKeyClose(e); break;
+    case Action::Maximize:     onKeyMaximize(e); break;
+    case Action::Unmaximize:   onKeyUnmaximize(e); break;
+    case Action::Grid:         onKeyGrid(e); break;
+    case Action::SnapGrid:     onKeySnapGrid(e); break;
+    case Action::Lock:         system("slock"); break;
+    case Action::Launcher:     onKeyLauncher(e); break;
+    case Action::Screenshot:
+    case Action::ScreenshotMonitor:
+    case Action::ScreenshotWindow:  onKeyScreenshot(e, bind->action); break;
+    case Action::VolumeUp:     onKeyVolume(1000); break;
+    case Action::VolumeDown:   onKeyVolume(-1000); break;
+    case Action::VolumeMute:   onKeyVolume(0); break;
+    case Action::MoveFocus:    onKeyMoveFocus(e, bind->dir); break;
+    case Action::MoveGridLoc:  onKeyMoveGridLoc(e, bind->dir); break;
+    case Action::MoveGridSize: onKeyMoveGridSize(e, bind->dir); break;
+    case Action::MoveMonitor:  onKeyMoveMonitor(e, bind->dir); break;
+    case Action::Restart:      onKeyRestart(e); break;
+    case Action::CycleLayout:  onKeyCycleLayout(e); break;
+    case Action::RecordDump:   onKeyRecordDump(e); break;
+    case Action::LAST:         break;
   }
 }
 
@@ -567,7 +1421,7 @@ void Manager::onBtnPress(const XButtonEvent& e)
   // Normal click
   if (e.state == 0) {
     switchFocus(e.window);
-    _drag = {};
+    cancelDrag(); // Only left over if its release never came
     XAllowEvents(_disp, ReplayPointer, CurrentTime); // Replay button click so client handles it
     return;
   }
@@ -577,76 +1431,185 @@ void Manager::onBtnPress(const XButtonEvent& e)
 
   // Numlock click (mouse move / resive)
   if (e.state & NUMLOCK) {
+    // Another button during a drag, the drag ends with its own button
+    if (_drag.w != 0 || isDead(e.window))
+      return;
     switchFocus(e.window);
 
+    // Motion only ever moves managed windows, the cache has where it is
+    auto it = _clients.find(e.window);
+    if (it == end(_clients))
+      return;
+    const Rect& g = it->second.geom;
+
     _drag.btn = e.button;
     _drag.xR = e.x_root;
     _drag.yR = e.y_root;
     _drag.w = e.window;
-
-    XWindowAttributes attr;
-    XGetWindowAttributes(_disp, e.window, &attr);
-    _drag.x = attr.x;
-    _drag.y = attr.y;
-    _drag.width = attr.width;
-    _drag.height = attr.height;
+    _drag.client = _clients.handle(it);
+    _drag.x = g.o.x;
+    _drag.y = g.o.y;
+    _drag.width = g.w;
+    _drag.height = g.h;
 
     Point click(e.x_root, e.y_root);
 
     auto near = [] (int p2, int p1) -> bool { return std::max(0, p2 - p1) < 50; };
 
     _drag.dirHorz = DIR::LAST;
-    if (near(click.x, attr.x)) {
+    if (near(click.x, g.o.x)) {
       _drag.dirHorz = DIR::Left;
-    } else if (near(attr.x + attr.width, click.x)) {
+    } else if (near(g.o.x + g.w, click.x)) {
       _drag.dirHorz = DIR::Right;
     }
 
     _drag.dirVert = DIR::LAST;
-    if (near(click.y, attr.y)) {
+    if (near(click.y, g.o.y)) {
       _drag.dirVert = DIR::Up;
-    } else if (near(attr.y + attr.height, click.y)) {
+    } else if (near(g.o.y + g.h, click.y)) {
       _drag.dirVert = DIR::Down;
     }
+
+    // Motion rebuilds the edges as windows move, room for all of them up front
+    if (_cfg.snapDist > 0) {
+      _monitorEdges.resize(_monitors.size());
+      for (auto& cache : _monitorEdges)
+        cache.edges.reserve(std::max(_clients.size(), CLIENTS_RESERVED) + 1);
+    }
+
+    // Resizes of sync-capable clients are paced by their counter
+    if (e.button == 3 && !_cfg.dragOutline &&
+        it->second.syncCounter != None && _syncAlarm != None) {
+      XSyncValue cur;
+      Trace::Span span("XSyncQueryCounter", _disp, e.window);
+      if (XSyncQueryCounter(_disp, it->second.syncCounter, &cur)) {
+        _drag.sync = true;
+        _drag.syncValue = (int64_t(XSyncValueHigh32(cur)) << 32) | XSyncValueLow32(cur);
+
+        XSyncAlarmAttributes aa;
+        aa.trigger.counter = it->second.syncCounter;
+        XSyncChangeAlarm(_disp, _syncAlarm, XSyncCACounter, &aa);
+      }
+    }
   }
 }
 
-//TODO: Better handling of different ClientMessage types
-//TODO: FULLSCREEN thing for wfica
 void Manager::onClientMessage(const XClientMessageEvent& e)
 {
-  char* str = XGetAtomName(e.display, e.message_type);
   LOG(INFO) << "clientMessage"
             << " window=" << e.window
             << " serial=" << e.serial
             << " send_event=" << e.send_event
-            << " display=" << e.display
             << " message_type=" << e.message_type
             << " format=" << e.format
-            << " data=(" << e.data.b << ")"
-            << " atom=(" << str << ")";
-  XFree(str);
+            << " atom=(" << _atoms.name(e.message_type) << ")";
+
+  using Handler = void (Manager::*)(const XClientMessageEvent&);
+  static const auto HANDLERS = [] {
+    std::array<Handler, size_t(XA::LAST)> h = {};
+    h[size_t(XA::NET_WM_STATE)]      = &Manager::onMsgWmState;
+    h[size_t(XA::NET_ACTIVE_WINDOW)] = &Manager::onMsgActiveWindow;
+    h[size_t(XA::NET_CLOSE_WINDOW)]  = &Manager::onMsgCloseWindow;
+    return h;
+  }();
+
+  XA type = _atoms.lookup(e.message_type);
+  if (type == XA::LAST || HANDLERS[size_t(type)] == nullptr) {
+    LOG(WARN) << "unhandled clientMessage atom=" << e.message_type;
+    return;
+  }
+  Trace::Span span(_atoms.name(e.message_type), "handler", e.window, e.serial);
+  (this->*HANDLERS[size_t(type)])(e);
+}
+
+/// ClientMessage Handlers /////////////////////////////////////////////////////
+
+void Manager::onMsgWmState(const XClientMessageEvent& e)
+{
+  auto it = _clients.find(e.window);
+  if (it == end(_clients))
+    return;
+  auto& client = it->second;
+
+  // data.l[0] is the action (0 remove, 1 add, 2 toggle), [1] and [2] the
+  // states. A state named in both slots is still acted on once.
+  bool full = false;
+  for (int i = 1; i <= 2; ++i) {
+    Atom state = Atom(e.data.l[i]);
+    if (state == None)
+      continue;
+    LOG(INFO) << "wmState"
+              << " window=" << e.window
+              << " action=" << e.data.l[0]
+              << " state=(" << _atoms.name(state) << ")";
+    full = full || state == _atoms[XA::NET_WM_STATE_FULLSCREEN];
+  }
+
+  if (full) {
+    switch (e.data.l[0]) {
+      case 0: setFullscreen(client, false); break;
+      case 1: setFullscreen(client, true); break;
+      case 2: setFullscreen(client, !client.fullscreen); break;
+    }
+  }
+}
 
-  LOG(INFO) << e.data.l[0] << " " << e.data.l[1] << " "
-            << e.data.l[2] << " " << e.data.l[3] << " "
-            << XGetAtomName(e.display, e.data.l[1]);
+void Manager::onMsgActiveWindow(const XClientMessageEvent& e)
+{
+  auto it = _clients.find(e.window);
+  if (it == end(_clients) || it->second.ign)
+    return;
+  switchFocus(e.window);
+}
+
+void Manager::onMsgCloseWindow(const XClientMessageEvent& e)
+{
+  if (_clients.find(e.window) == end(_clients))
+    return;
+  sendDelete(e.window);
 }
 
 /// Focus Handlers /////////////////////////////////////////////////////////////
 
+void Manager::setLastFocus(Window w)
+{
+  _lastFocus = w;
+  _lastFocusClient = _clients.handle(w);
+}
+
 void Manager::switchFocus(Window w)
 {
-  Window curFocus; int curRevert;
-  XGetInputFocus(_disp, &curFocus, &curRevert);
+  // Any explicit focus change beats a crossing still waiting out its delay
+  _focusPending = None;
+  if (isDead(w))
+    return;
+
+  Window curFocus = GetFocus(_disp);
 
   if (curFocus == w)
     return;
 
-  LOG(INFO) << "switching focus from current=" << curFocus << " new=" << w;
+  HOT_LOG(INFO) << "switching focus from current=" << curFocus << " new=" << w;
   XSetInputFocus(_disp, w, RevertToPointerRoot, CurrentTime);
   XRaiseWindow(_disp, w);
 }
 
+void Manager::sendDelete(Window w)
+{
+  if (isDead(w))
+    return;
+
+  XEvent event;
+  ::bzero(&event, sizeof(event));
+  event.xclient.type = ClientMessage;
+  event.xclient.window = w;
+  event.xclient.message_type = _atoms[XA::WM_PROTOCOLS];
+  event.xclient.format = 32;
+  event.xclient.data.l[0] = long(_atoms[XA::WM_DELETE_WINDOW]);
+  event.xclient.data.l[1] = CurrentTime;
+  XSendEvent(_disp, w, false, NoEventMask, &event);
+}
+
 void Manager::handleFocusChange(const XFocusChangeEvent& e, bool in)
 {
   if (e.mode == NotifyGrab || e.mode == NotifyUngrab)
@@ -657,22 +1620,114 @@ void Manager::handleFocusChange(const XFocusChangeEvent& e, bool in)
   if (it != end(_monitors)) {
     drawGrid(&(*it), in);
     return;
-  }
+  }
+
+  auto jt = _clients.find(e.window);
+  if (jt == end(_clients))
+      return;
+
+  if (jt->second.fullscreen)
+    return;
+
+  if (!in) {
+    HOT_LOG(INFO) << "focus out, regrab window=" << e.window;
+    XGrabButton(_disp, 1, 0, e.window, false, ButtonPressMask,
+                GrabModeSync, GrabModeAsync, None, None);
+    XSetWindowBorder(_disp, e.window, _cfg.borderUnfocus);
+  } else {
+    HOT_LOG(INFO) << "focus in, ungrab window=" << e.window;
+    XUngrabButton(_disp, 1, 0, e.window);
+    XSetWindowBorder(_disp, e.window, _cfg.borderFocus);
+    setLastFocus(e.window);
+    ewmhSetActive(jt->second.root, e.window);
+    updateFocusTitle();
+  }
+}
+
+/// EWMH ///////////////////////////////////////////////////////////////////////
+
+void Manager::ewmhInit(Window root)
+{
+  auto& r = _roots.at(root);
+
+  // Child window that proves a compliant WM is running, override-redirect so
+  // it is never adopted as a client
+  XSetWindowAttributes wa;
+  wa.override_redirect = true;
+  r.wmCheck = XCreateWindow(_disp, root, -1, -1, 1, 1, 0, CopyFromParent, InputOnly,
+                            CopyFromParent, CWOverrideRedirect, &wa);
+  XChangeProperty(_disp, root, _atoms[XA::NET_SUPPORTING_WM_CHECK], XA_WINDOW, 32,
+                  PropModeReplace, (unsigned char*) &r.wmCheck, 1);
+  XChangeProperty(_disp, r.wmCheck, _atoms[XA::NET_SUPPORTING_WM_CHECK], XA_WINDOW, 32,
+                  PropModeReplace, (unsigned char*) &r.wmCheck, 1);
+  XChangeProperty(_disp, r.wmCheck, _atoms[XA::NET_WM_NAME], _atoms[XA::UTF8_STRING], 8,
+                  PropModeReplace, (const unsigned char*) "mwm", 3);
+
+  const Atom supported[] = {
+    _atoms[XA::NET_SUPPORTED],
+    _atoms[XA::NET_SUPPORTING_WM_CHECK],
+    _atoms[XA::NET_CLIENT_LIST],
+    _atoms[XA::NET_ACTIVE_WINDOW],
+    _atoms[XA::NET_CLOSE_WINDOW],
+    _atoms[XA::NET_WM_NAME],
+    _atoms[XA::NET_WM_STATE],
+    _atoms[XA::NET_WM_STATE_FULLSCREEN],
+    _atoms[XA::NET_WM_SYNC_REQUEST],
+  };
+  XChangeProperty(_disp, root, _atoms[XA::NET_SUPPORTED], XA_ATOM, 32, PropModeReplace,
+                  (const unsigned char*) supported, sizeof(supported) / sizeof(Atom));
+
+  // Start from a clean slate, pre-existing windows are appended as they are adopted
+  XDeleteProperty(_disp, root, _atoms[XA::NET_CLIENT_LIST]);
+  Window none = None;
+  XChangeProperty(_disp, root, _atoms[XA::NET_ACTIVE_WINDOW], XA_WINDOW, 32,
+                  PropModeReplace, (unsigned char*) &none, 1);
+}
+
+void Manager::ewmhAddClient(const Client& c)
+{
+  if (c.ign)
+    return;
+
+  _roots.at(c.root).clientList.push_back(c.client);
+  XChangeProperty(_disp, c.root, _atoms[XA::NET_CLIENT_LIST], XA_WINDOW, 32,
+                  PropModeAppend, (const unsigned char*) &c.client, 1);
+}
+
+void Manager::ewmhRemoveClient(const Client& c)
+{
+  if (_netActive == c.client)
+    ewmhSetActive(c.root, None);
+
+  if (c.ign)
+    return;
+
+  auto& list = _roots.at(c.root).clientList;
+  auto it = std::find(begin(list), end(list), c.client);
+  if (it == end(list))
+    return;
+  list.erase(it);
 
-  if (_clients.find(e.window) == end(_clients))
-      return;
+  XChangeProperty(_disp, c.root, _atoms[XA::NET_CLIENT_LIST], XA_WINDOW, 32, PropModeReplace,
+                  (const unsigned char*) list.data(), int(list.size()));
+}
 
-  if (!in) {
-    LOG(INFO) << "focus out, regrab window=" << e.window;
-    XGrabButton(_disp, 1, 0, e.window, false, ButtonPressMask,
-                GrabModeSync, GrabModeAsync, None, None);
-    XSetWindowBorder(_disp, e.window, BORDER_UNFOCUS);
-  } else {
-    LOG(INFO) << "focus in, ungrab window=" << e.window;
-    XUngrabButton(_disp, 1, 0, e.window);
-    XSetWindowBorder(_disp, e.window, BORDER_FOCUS);
-    _lastFocus = e.window;
+void Manager::ewmhSetActive(Window root, Window w)
+{
+  if (_netActive == w)
+    return;
+
+  // Only one screen can have an active window at a time
+  if (_netActiveRoot != None && _netActiveRoot != root) {
+    Window none = None;
+    XChangeProperty(_disp, _netActiveRoot, _atoms[XA::NET_ACTIVE_WINDOW], XA_WINDOW, 32,
+                    PropModeReplace, (unsigned char*) &none, 1);
   }
+  _netActive = w;
+  _netActiveRoot = root;
+
+  XChangeProperty(_disp, root, _atoms[XA::NET_ACTIVE_WINDOW], XA_WINDOW, 32,
+                  PropModeReplace, (const unsigned char*) &w, 1);
 }
 
 /// Key Press Handlers /////////////////////////////////////////////////////////
@@ -710,12 +1765,9 @@ void Manager::onKeyGridActive(const XKeyEvent& e)
       else if (e.keycode == XKeysymToKeycode(_disp, XK_L))
         dir = DIR::Right;
 
-      std::vector<std::pair<Point, Monitor*>> monitors;
-      for (auto& monitor : _monitors)
-        if (&monitor != mon)
-          monitors.emplace_back(monitor.absOrigin + monitor.r.getCenter(), &monitor);
-      if (auto* m = getNextPointInDir(dir, mon->absOrigin + mon->r.getCenter(), monitors); m != nullptr)
-        switchFocus(m->gridDraw);
+      size_t cur = size_t(mon - _monitors.data());
+      if (auto* m = _monitorsAbs.nextInDir(dir, mon->absOrigin + mon->r.getCenter(), &cur); m != nullptr)
+        switchFocus(_monitors[*m].gridDraw);
     } else {
       if (e.keycode == XKeysymToKeycode(_disp, XK_J))
         mon->gridY = (mon->gridY == 1) ? 1 : mon->gridY - 1;
@@ -736,34 +1788,58 @@ void Manager::onKeyGridActive(const XKeyEvent& e)
 void Manager::onKeyTerminal(const XKeyEvent& e)
 {
   LOG(INFO) << "launching terminal window=" << e.window;
-
-  Window root = GetWinRoot(_disp, e.window);
+  auto start = std::chrono::steady_clock::now();
+
+  // The focused client's cached geometry saves a round trip
+  Window root;
+  Rect cur;
+  if (auto it = _clients.find(e.window); it != end(_clients)) {
+    root = it->second.root;
+    cur = it->second.geom;
+  } else {
+    root = GetWinRoot(_disp, e.window);
+    XWindowAttributes attr;
+    GetWinAttrs(_disp, e.window, attr);
+    cur = Rect(attr.x, attr.y, attr.width, attr.height);
+  }
   int screen = _roots.at(root).screen;
 
-  static const int cols = 120;
-  static const int rows = 40;
-  static const int offset = 100;
-  int x = offset;
-  int y = offset;
-
-  XWindowAttributes attr;
-  XGetWindowAttributes(_disp, e.window, &attr);
-  Rect cur(attr.x, attr.y, attr.width, attr.height);
+  int x = TERM_OFFSET;
+  int y = TERM_OFFSET;
   Point cen = cur.getCenter();
-  auto itm = std::find_if(begin(_monitors), end(_monitors),
-                          [&] (const auto& m) { return m.root == root && m.r.contains(cen); });
-  if (itm == end(_monitors)) {
+  Monitor* itm = monitorAt(root, cen);
+  if (itm == nullptr) {
     LOG(ERROR) << "no monitor contains (" << cen.x << "," << cen.y << ")";
   } else {
-    x = itm->r.o.x + offset;
-    y = itm->r.o.y + offset;
+    x = itm->r.o.x + TERM_OFFSET;
+    y = itm->r.o.y + TERM_OFFSET;
+  }
+
+  // A pooled terminal is already running, showing it is one move and a map
+  auto& pool = _termPool[root];
+  if (pool.ready) {
+    NewClient n = std::move(pool.n);
+    pool = PoolTerm();
+    n.attrs.x = x;
+    n.attrs.y = y;
+    XMoveWindow(_disp, n.c.client, x, y);
+    manageClient(n);
+    XFlush(_disp);
+    LOG(INFO) << "handed out pooled terminal window=" << n.c.client
+              << " ms=" << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    spawnPoolTerm(root);
+    return;
   }
 
-  std::ostringstream cmd;
-  cmd << "DISPLAY=" << DisplayString(_disp) << "." << screen << " ";
-  cmd << "st -g " << cols << "x" << rows << "+" << x << "+" << y << " &";
-  LOG(INFO) << "starting cmd=(" << cmd.str() << ")";
-  system(cmd.str().c_str());
+  char cmd[256];
+  snprintf(cmd, sizeof(cmd), "DISPLAY=%s.%d st -g %dx%d+%d+%d &",
+           DisplayString(_disp), screen, TERM_COLS, TERM_ROWS, x, y);
+  LOG(INFO) << "starting cmd=(" << cmd << ")";
+  system(cmd);
+
+  // Still starting, or gone without ever mapping
+  if (pool.pid == 0 || kill(pool.pid, 0) != 0)
+    spawnPoolTerm(root);
 }
 
 void Manager::onKeyGrid(const XKeyEvent& /*e*/)
@@ -773,10 +1849,11 @@ void Manager::onKeyGrid(const XKeyEvent& /*e*/)
   _gridActive = true;
 
   for (auto& monitor : _monitors) {
+    const Rect area = workArea(monitor);
     auto gridDraw = XCreateSimpleWindow(_disp, monitor.root,
-        monitor.r.o.x, monitor.r.o.y,
-        monitor.r.w - 2*GRID_THICK, monitor.r.h - 2*GRID_THICK,
-        GRID_THICK, GRID_COLOR, GRID_BG);
+        area.o.x, area.o.y,
+        area.w - 2*_cfg.gridThick, area.h - 2*_cfg.gridThick,
+        _cfg.gridThick, _cfg.gridColor, _cfg.gridBg);
     monitor.gridDraw = gridDraw;
 
     static const std::set<int> KEYS = { XK_H, XK_J, XK_K, XK_L, XK_G };
@@ -791,68 +1868,52 @@ void Manager::onKeyGrid(const XKeyEvent& /*e*/)
   }
 }
 
-void Manager::onKeyMoveMonitor(const XKeyEvent& e)
+void Manager::onKeyMoveMonitor(const XKeyEvent& e, DIR dir)
 {
-  DIR dir;
-  if (e.keycode == XKeysymToKeycode(_disp, XK_H))
-    dir = DIR::Left;
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_J))
-    dir = DIR::Down;
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_K))
-    dir = DIR::Up;
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_L))
-    dir = DIR::Right;
+  if (isDead(e.window))
+    return;
 
   XWindowAttributes attr;
-  XGetWindowAttributes(_disp, e.window, &attr);
+  GetWinAttrs(_disp, e.window, attr);
   Rect cur(attr.x, attr.y, attr.width, attr.height);
   Point cen = cur.getCenter();
   Window root = GetWinRoot(_disp, e.window);
 
-  auto it = std::find_if(begin(_monitors), end(_monitors),
-                         [&] (const auto& m) { return m.root == root && m.r.contains(cen); });
-  if (it == end(_monitors)) {
-    LOG(ERROR) << "no monitor contains (" << cen.x << "," << cen.y << ")";
+  Monitor* it = monitorAt(root, cen);
+  if (it == nullptr) {
+    HOT_LOG(ERROR) << "no monitor contains (" << cen.x << "," << cen.y << ")";
     return;
   }
-  auto* curMon = &(*it);
+  auto* curMon = it;
 
-  std::vector<std::pair<Point, Monitor*>> monitors;
-  for (auto& monitor : _monitors)
-    if (&monitor != curMon && monitor.root == root)
-      monitors.emplace_back(monitor.r.getCenter(), &monitor);
-  auto* m = getNextPointInDir(dir, curMon->r.getCenter(), monitors);
-  if (m == nullptr)
+  size_t curIdx = size_t(curMon - _monitors.data());
+  const size_t* next = _roots.at(root).monitors.nextInDir(dir, curMon->r.getCenter(), &curIdx);
+  if (next == nullptr)
     return;
+  auto* m = &_monitors[*next];
 
-  int w = std::min(cur.w + (2 * BORDER_THICK), m->r.w);
-  int h = std::min(cur.h + (2 * BORDER_THICK), m->r.h);
+  int w = std::min(cur.w + (2 * _cfg.borderThick), m->r.w);
+  int h = std::min(cur.h + (2 * _cfg.borderThick), m->r.h);
   bool border = w != m->r.w || h != m->r.h;
 
   XWindowChanges changes;
   changes.x = m->r.getCenter().x - (w / 2);
   changes.y = m->r.getCenter().y - (h / 2);
-  changes.width = w - ((border ? 2 : 0) * BORDER_THICK);
-  changes.height = h - ((border ? 2 : 0) * BORDER_THICK);
+  changes.width = w - ((border ? 2 : 0) * _cfg.borderThick);
+  changes.height = h - ((border ? 2 : 0) * _cfg.borderThick);
 
   XConfigureWindow(_disp, e.window, (CWX | CWY | CWWidth | CWHeight), &changes);
-  XSetWindowBorderWidth(_disp, e.window, border ? BORDER_THICK : 0);
+  XSetWindowBorderWidth(_disp, e.window, border ? _cfg.borderThick : 0);
+
+  if (auto cit = _clients.find(e.window); cit != end(_clients)) {
+    setGeom(cit->second, Rect(changes.x, changes.y, changes.width, changes.height));
+    relayout(root);
+  }
 }
 
-void Manager::onKeyMoveFocus(const XKeyEvent& e)
+void Manager::onKeyMoveFocus(const XKeyEvent& /*e*/, DIR dir)
 {
-  DIR dir;
-  if (e.keycode == XKeysymToKeycode(_disp, XK_H))
-    dir = DIR::Left;
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_J))
-    dir = DIR::Down;
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_K))
-    dir = DIR::Up;
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_L))
-    dir = DIR::Right;
-
-  Window curFocus; int curRevert;
-  XGetInputFocus(_disp, &curFocus, &curRevert);
+  Window curFocus = GetFocus(_disp);
   if (curFocus == PointerRoot || curFocus == None)
     curFocus = _roots.begin()->first;
   else if (_clients.find(curFocus) == end(_clients))
@@ -864,36 +1925,37 @@ void Manager::onKeyMoveFocus(const XKeyEvent& e)
 
 void Manager::onKeyMaximize(const XKeyEvent& e)
 {
-  Window curFocus; int curRevert;
-  XGetInputFocus(_disp, &curFocus, &curRevert);
+  Window curFocus = GetFocus(_disp);
+  if (isDead(curFocus))
+    return;
 
   auto it = _clients.find(curFocus);
   if (it == end(_clients)) {
-    LOG(ERROR) << "unable to find client=" << e.subwindow;
+    HOT_LOG(ERROR) << "unable to find client=" << e.subwindow;
     return;
   }
   auto& client = it->second;
-  if (client.ign)
+  if (client.ign || client.fullscreen)
     return;
 
-  LOG(INFO) << "maximizing"
+  HOT_LOG(INFO) << "maximizing"
             << " curFocus=" << curFocus
             << " window=" << e.window
             << " subwindow=" << e.subwindow;
 
   XWindowAttributes attr;
-  XGetWindowAttributes(_disp, client.client, &attr);
+  GetWinAttrs(_disp, client.client, attr);
   Point c = Rect(attr.x, attr.y, attr.width, attr.height).getCenter();
 
-  auto it2 = std::find_if(begin(_monitors), end(_monitors),
-                          [&] (const auto& m) { return m.root == client.root && m.r.contains(c); });
-  if (it2 == end(_monitors)) {
-    LOG(ERROR) << "no monitor contains (" << c.x << "," << c.y << ")";
+  Monitor* it2 = monitorAt(client.root, c);
+  if (it2 == nullptr) {
+    HOT_LOG(ERROR) << "no monitor contains (" << c.x << "," << c.y << ")";
     return;
   }
   auto& mon = *it2;
+  const Rect area = workArea(mon);
 
-  if (attr.width == mon.r.w && attr.height == mon.r.h)
+  if (attr.width == area.w && attr.height == area.h)
     return;
 
   client.preMax.o.x = attr.x;
@@ -901,31 +1963,43 @@ void Manager::onKeyMaximize(const XKeyEvent& e)
   client.preMax.w = attr.width;
   client.preMax.h = attr.height;
 
+  // Clients with size increments or a max size may not fill the monitor,
+  // keep their border and center them in the leftover space
+  int w = area.w, h = area.h;
+  client.hints.constrain(w, h);
+  bool border = w != area.w || h != area.h;
+  if (border) {
+    w = area.w - 2 * _cfg.borderThick;
+    h = area.h - 2 * _cfg.borderThick;
+    client.hints.constrain(w, h);
+  }
+
   XWindowChanges changes;
-  changes.x = mon.r.o.x;
-  changes.y = mon.r.o.y;
-  changes.width = mon.r.w;
-  changes.height = mon.r.h;
+  changes.width = w;
+  changes.height = h;
+  changes.x = area.o.x + (area.w - w) / 2 - (border ? _cfg.borderThick : 0);
+  changes.y = area.o.y + (area.h - h) / 2 - (border ? _cfg.borderThick : 0);
   XConfigureWindow(_disp, client.client, (CWX | CWY | CWWidth | CWHeight), &changes);
 
-  XSetWindowBorderWidth(_disp, client.client, 0);
+  XSetWindowBorderWidth(_disp, client.client, border ? _cfg.borderThick : 0);
 }
 
 void Manager::onKeyUnmaximize(const XKeyEvent& e)
 {
-  Window curFocus; int curRevert;
-  XGetInputFocus(_disp, &curFocus, &curRevert);
+  Window curFocus = GetFocus(_disp);
+  if (isDead(curFocus))
+    return;
 
   auto it = _clients.find(curFocus);
   if (it == end(_clients)) {
-    LOG(ERROR) << "unable to find client=" << e.subwindow;
+    HOT_LOG(ERROR) << "unable to find client=" << e.subwindow;
     return;
   }
   auto& client = it->second;
-  if (client.ign)
+  if (client.ign || client.fullscreen)
     return;
 
-  LOG(INFO) << "unmaximizing"
+  HOT_LOG(INFO) << "unmaximizing"
             << " curFocus=" << curFocus
             << " window=" << e.window
             << " subwindow=" << e.subwindow;
@@ -943,218 +2017,849 @@ void Manager::onKeyUnmaximize(const XKeyEvent& e)
   client.preMax.h = 0;
 
   XConfigureWindow(_disp, client.client, (CWX | CWY | CWWidth | CWHeight), &changes);
-  XSetWindowBorderWidth(_disp, client.client, BORDER_THICK);
+  XSetWindowBorderWidth(_disp, client.client, _cfg.borderThick);
 }
 
 void Manager::onKeyClose(const XKeyEvent& e)
 {
-  Window curFocus; int curRevert;
-  XGetInputFocus(_disp, &curFocus, &curRevert);
+  Window curFocus = GetFocus(_disp);
+  if (isDead(curFocus))
+    return;
   auto center = _roots.at(GetWinRoot(_disp, curFocus)).absOrigin + GetWinRect(_disp, curFocus).getCenter();
 
-  LOG(INFO) << "closing window"
+  HOT_LOG(INFO) << "closing window"
             << " curFocus=" << curFocus
             << " window=" << e.window
             << " subwindow=" << e.subwindow;
 
-  XEvent event;
-  event.xclient.type = ClientMessage;
-  event.xclient.window = curFocus;
-  event.xclient.message_type = XInternAtom(_disp, "WM_PROTOCOLS", true);
-  event.xclient.format = 32;
-  event.xclient.data.l[0] = XInternAtom(_disp, "WM_DELETE_WINDOW", false);
-  event.xclient.data.l[1] = CurrentTime;
-  XSendEvent(_disp, curFocus, false, NoEventMask, &event);
+  sendDelete(curFocus);
 
-  std::vector<std::pair<Rect, Window>> windows;
-  for (auto& c : _clients)
-    if (c.first != curFocus && !c.second.ign)
-      windows.emplace_back(GetWinRect(_disp, c.first) + c.second.absOrigin, c.first);
-  switchFocus(closestRectFromPoint(center, windows));
+  const Window* next = _clientRects.nearest(center, &curFocus);
+  switchFocus(next ? *next : 0);
 }
 
 void Manager::onKeyLauncher(const XKeyEvent& e)
 {
-  int screen = _roots.at(GetWinRoot(_disp, e.window)).screen;
-  std::ostringstream cmd;
-  cmd << "DISPLAY=" << DisplayString(_disp) << "." << screen << " ";
-  cmd << "j4-dmenu-desktop";
-  cmd << " --dmenu=\"dmenu -i -p 'mwm' -l 25 -c -w " << e.window << "\"";
-  cmd << " --term=\"st\"";
-  cmd << " >/dev/null 2>&1 &";
-  system(cmd.str().c_str());
+  // On the focused window's monitor, else wherever the pointer is
+  Window curFocus = GetFocus(_disp);
+  auto it = _clients.find(curFocus);
+  Window root = (it != end(_clients)) ? it->second.root : GetWinRoot(_disp, e.window);
+  Point p;
+  if (it != end(_clients)) {
+    p = it->second.geom.getCenter();
+  } else {
+    p = GetPointer(_disp, root);
+  }
+
+  const auto& r = _roots.at(root);
+  Monitor* mon = monitorAt(root, p);
+  Rect area = mon ? mon->r : Rect(0, 0, DisplayWidth(_disp, r.screen), DisplayHeight(_disp, r.screen));
+  _launcher.open(_disp, r.screen, area, _desktop,
+                 Launcher::Colors{_cfg.gridBg, WhitePixel(_disp, r.screen), _cfg.borderFocus});
+}
+
+void Manager::onKeyLauncherActive(const XKeyEvent& e)
+{
+  DesktopIndex::Entry entry;
+  if (!_launcher.onKey(e, entry))
+    return;
+
+  // Same terminal and detaching as every other launch
+  int screen = _roots.at(e.root).screen;
+  _cmd.assign("DISPLAY=").append(DisplayString(_disp)).append(".").append(std::to_string(screen));
+  _cmd.append(entry.terminal ? " st -e " : " ").append(entry.exec).append(" >/dev/null 2>&1 &");
+  LOG(INFO) << "launching name=(" << entry.name << ") cmd=(" << _cmd << ")";
+  system(_cmd.c_str());
+}
+
+void Manager::onKeyScreenshot(const XKeyEvent& e, Action area)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  Window curFocus = GetFocus(_disp);
+  auto it = _clients.find(curFocus);
+  Window root = (it != end(_clients)) ? it->second.root : GetWinRoot(_disp, e.window);
+  const auto& r = _roots.at(root);
+
+  // Whole screen unless a monitor or window is asked for and can be found
+  Rect rect(0, 0, DisplayWidth(_disp, r.screen), DisplayHeight(_disp, r.screen));
+  if (area == Action::ScreenshotWindow && it != end(_clients)) {
+    int b = it->second.border;
+    rect = Rect(it->second.geom.o.x, it->second.geom.o.y,
+                it->second.geom.w + 2 * b, it->second.geom.h + 2 * b);
+  } else if (area == Action::ScreenshotMonitor) {
+    Point p;
+    if (it != end(_clients)) {
+      p = it->second.geom.getCenter();
+    } else {
+      p = GetPointer(_disp, root);
+    }
+    if (auto* mon = monitorAt(root, p); mon != nullptr)
+      rect = mon->r;
+  }
+
+  Capture cap;
+  if (!CaptureRoot(_disp, r.screen, rect, cap))
+    return;
+
+  char stamp[64];
+  time_t now = time(nullptr);
+  strftime(stamp, sizeof(stamp), "%Y-%m-%d::%H:%M:%S", localtime(&now));
+  cap.path = _argScreenshotDir + "/screenshot-" + stamp + ".png";
+  cap.start = start;
+  cap.captureMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  LOG(INFO) << "captured screenshot"
+            << " area=" << ActionToString(area)
+            << " width=" << cap.width
+            << " height=" << cap.height
+            << " shm=" << cap.shm
+            << " captureMs=" << cap.captureMs;
+  _screenshots.submit(std::move(cap));
+}
+
+void Manager::onKeyRestart(const XKeyEvent& /*e*/)
+{
+  Snapshot snap;
+  snap.lastFocus = _lastFocus;
+
+  auto record = [&] (const Client& c) {
+    Snapshot::ClientRec rec;
+    ::bzero(&rec, sizeof(rec));
+    rec.client = c.client;
+    rec.root = c.root;
+    rec.preMax = c.preMax;
+    rec.preFull = c.preFull;
+    rec.preFullBorder = c.preFullBorder;
+    rec.ign = c.ign;
+    rec.fullscreen = c.fullscreen;
+    rec.hints = c.hints;
+    rec.syncCounter = c.syncCounter;
+    snap.clients.push_back(rec);
+  };
+  for (const auto& r : _roots)
+    for (Window w : r.second.clientList)
+      record(_clients.at(w));
+  for (const auto& c : _clients)
+    if (c.second.ign)
+      record(c.second);
+
+  for (const auto& mon : _monitors) {
+    Snapshot::MonitorRec rec;
+    ::bzero(&rec, sizeof(rec));
+    strncpy(rec.name, mon.cfg.name.c_str(), sizeof(rec.name) - 1);
+    rec.root = mon.root;
+    rec.r = mon.r;
+    rec.gridX = mon.gridX;
+    rec.gridY = mon.gridY;
+    rec.layout = uint32_t(mon.layout);
+    snap.monitors.push_back(rec);
+  }
+
+  const char* dir = getenv("XDG_RUNTIME_DIR");
+  std::string path = std::string(dir ? dir : "/tmp") + "/mwm-" + std::to_string(getpid()) + ".snap";
+  if (!WriteSnapshot(path, snap))
+    return;
+
+  LOG(INFO) << "restarting in place snapshot=(" << path << ")";
+  _restartPath = path;
+}
+
+void Manager::onKeyCycleLayout(const XKeyEvent& /*e*/)
+{
+  Window curFocus = GetFocus(_disp);
+
+  // The focused client's monitor, or the first one when nothing is focused
+  Monitor* mon = _monitors.empty() ? nullptr : &_monitors.front();
+  if (auto it = _clients.find(curFocus); it != end(_clients)) {
+    const auto& c = it->second;
+    Point cen = c.geom.getCenter();
+    if (auto* m = monitorAt(c.root, cen); m != nullptr)
+      mon = m;
+  }
+  if (mon == nullptr)
+    return;
+
+  mon->layout = Layout((size_t(mon->layout) + 1) % size_t(Layout::LAST));
+  LOG(INFO) << "layout monitor=(" << mon->cfg.name << ") layout=" << LayoutToString(mon->layout);
+  relayout(mon->root);
+}
+
+void Manager::onKeyRecordDump(const XKeyEvent& /*e*/)
+{
+  if (!_recorder) {
+    LOG(WARN) << "recorder is off, enable it with 'record' in the config";
+    return;
+  }
+  _recorder->dump(_argScreenshotDir);
 }
 
-void Manager::onKeyScreenshot(const XKeyEvent& e)
+void Manager::onKeyVolume(int step)
 {
-  int screen = _roots.at(GetWinRoot(_disp, e.window)).screen;
-  std::ostringstream cmd;
-  cmd << "DISPLAY=" << DisplayString(_disp) << "." << screen << " ";
-  cmd << "import \"" << _argScreenshotDir << "/screenshot-$(date '+%Y-%m-%d::%H:%M:%S').png\" &";
-  LOG(INFO) << "starting cmd=(" << cmd.str() << ")";
-  system(cmd.str().c_str());
+  if (step == 0) {
+    system("pactl set-sink-mute @DEFAULT_SINK@ toggle");
+  } else {
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "pactl set-sink-volume @DEFAULT_SINK@ %+d", step);
+    system(cmd);
+    system("pactl set-sink-mute @DEFAULT_SINK@ 0");
+  }
+  system("pactl play-sample bell.oga");
 }
 
 void Manager::snapGrid(Window w, Rect r)
 {
   Point c = r.getCenter();
   Window root = GetWinRoot(_disp, w);
-  auto it = std::find_if(begin(_monitors), end(_monitors),
-                         [&] (const auto& m) { return m.root == root && m.r.contains(c); });
-  if (it == end(_monitors)) {
-    LOG(ERROR) << "no monitor contains (" << c.x << "," << c.y << ")";
+  Monitor* it = monitorAt(root, c);
+  if (it == nullptr) {
+    HOT_LOG(ERROR) << "no monitor contains (" << c.x << "," << c.y << ")";
     return;
   }
   auto& mon = *it;
 
-  double gridW = double(mon.r.w) / mon.gridX;
-  double gridH = double(mon.r.h) / mon.gridY;
-  auto xNum = std::max(1u, (unsigned) round(double(r.w) / gridW));
-  auto yNum = std::max(1u, (unsigned) round(double(r.h) / gridH));
-  auto widX = int(xNum * gridW);
-  auto widY = int(yNum * gridH);
-  bool border = xNum != mon.gridX || yNum != mon.gridY;
-
-  int minX;
-  int minDist = INT_MAX;
-  for (unsigned j = 1, k = xNum; j <= (mon.gridX - xNum) + 1; ++j, k += 2) {
-    auto gridCen = mon.r.o.x + int(k*(gridW/2));
-    auto dist = abs(c.x - gridCen);
-    if (dist < minDist) {
-      minDist = dist;
-      minX = gridCen;
-    }
-  }
+  GridSnap snap = SnapToGrid(workArea(mon), mon.gridX, mon.gridY, r);
+  int widX = snap.w, widY = snap.h;
+  int minX = snap.center.x, minY = snap.center.y;
+  bool border = !snap.full;
 
-  int minY;
-  minDist = INT_MAX;
-  for (unsigned j = 1, k = yNum; j <= (mon.gridY - yNum) + 1; ++j, k += 2) {
-    auto gridCen = mon.r.o.y + int(k*(gridH/2));
-    auto dist = abs(c.y - gridCen);
-    if (dist < minDist) {
-      minDist = dist;
-      minY = gridCen;
+  XWindowChanges changes;
+  changes.width = widX - ((border ? 2 : 0) * _cfg.borderThick);
+  changes.height = widY - ((border ? 2 : 0) * _cfg.borderThick);
+  if (auto cit = _clients.find(w); cit != end(_clients)) {
+    // Honor the client's size hints, centered within its cells
+    int cw = changes.width, ch = changes.height;
+    cit->second.hints.constrain(cw, ch);
+    if (cw != changes.width || ch != changes.height) {
+      border = true;
+      cw = std::min(cw, widX - 2 * _cfg.borderThick);
+      ch = std::min(ch, widY - 2 * _cfg.borderThick);
+      cit->second.hints.constrain(cw, ch);
+      changes.width = cw;
+      changes.height = ch;
     }
   }
-
-  XWindowChanges changes;
-  changes.width = widX - ((border ? 2 : 0) * BORDER_THICK);
-  changes.height = widY - ((border ? 2 : 0) * BORDER_THICK);
-  changes.x = minX - (widX / 2);
-  changes.y = minY - (widY / 2);
+  changes.x = minX - (changes.width / 2) - (border ? _cfg.borderThick : 0);
+  changes.y = minY - (changes.height / 2) - (border ? _cfg.borderThick : 0);
   XConfigureWindow(_disp, w, (CWX | CWY | CWWidth | CWHeight), &changes);
 
-  XSetWindowBorderWidth(_disp, w, border ? BORDER_THICK : 0);
+  XSetWindowBorderWidth(_disp, w, border ? _cfg.borderThick : 0);
 }
 
 void Manager::onKeySnapGrid(const XKeyEvent& e)
 {
+  if (isDead(e.window))
+    return;
   XWindowAttributes attr;
-  XGetWindowAttributes(_disp, e.window, &attr);
+  GetWinAttrs(_disp, e.window, attr);
   snapGrid(e.window, Rect(attr.x, attr.y, attr.width, attr.height));
 }
 
-void Manager::onKeyMoveGridLoc(const XKeyEvent& e)
+void Manager::onKeyMoveGridLoc(const XKeyEvent& e, DIR dir)
 {
+  if (isDead(e.window))
+    return;
+
   XWindowAttributes attr;
-  XGetWindowAttributes(_disp, e.window, &attr);
+  GetWinAttrs(_disp, e.window, attr);
   Rect loc(attr.x, attr.y, attr.width, attr.height);
   Point c = loc.getCenter();
   Window root = GetWinRoot(_disp, e.window);
 
-  auto it = std::find_if(begin(_monitors), end(_monitors),
-                         [&] (const auto& m) { return m.root == root && m.r.contains(c); });
-  if (it == end(_monitors)) {
-    LOG(ERROR) << "no monitor contains (" << c.x << "," << c.y << ")";
+  Monitor* it = monitorAt(root, c);
+  if (it == nullptr) {
+    HOT_LOG(ERROR) << "no monitor contains (" << c.x << "," << c.y << ")";
     return;
   }
   auto& mon = *it;
+  const Rect area = workArea(mon);
 
-  int gridW = mon.r.w / mon.gridX;
-  int gridH = mon.r.h / mon.gridY;
+  int gridW = area.w / mon.gridX;
+  int gridH = area.h / mon.gridY;
 
-  if (e.keycode == XKeysymToKeycode(_disp, XK_H))
-    loc.o.x = std::max(loc.o.x - gridW, mon.r.o.x);
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_J))
-    loc.o.y = std::min(loc.o.y + gridH, mon.r.o.y + mon.r.h - loc.h);
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_K))
-    loc.o.y = std::max(loc.o.y - gridH, mon.r.o.y);
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_L))
-    loc.o.x = std::min(loc.o.x + gridW, mon.r.o.x + mon.r.w - loc.w);
+  if (dir == DIR::Left)
+    loc.o.x = std::max(loc.o.x - gridW, area.o.x);
+  else if (dir == DIR::Down)
+    loc.o.y = std::min(loc.o.y + gridH, area.o.y + area.h - loc.h);
+  else if (dir == DIR::Up)
+    loc.o.y = std::max(loc.o.y - gridH, area.o.y);
+  else if (dir == DIR::Right)
+    loc.o.x = std::min(loc.o.x + gridW, area.o.x + area.w - loc.w);
 
   snapGrid(e.window, loc);
 }
 
-void Manager::onKeyMoveGridSize(const XKeyEvent& e)
+void Manager::onKeyMoveGridSize(const XKeyEvent& e, DIR dir)
 {
+  if (isDead(e.window))
+    return;
+
   XWindowAttributes attr;
-  XGetWindowAttributes(_disp, e.window, &attr);
+  GetWinAttrs(_disp, e.window, attr);
   Rect loc(attr.x, attr.y, attr.width, attr.height);
   Point c = loc.getCenter();
   Window root = GetWinRoot(_disp, e.window);
 
-  auto it = std::find_if(begin(_monitors), end(_monitors),
-                         [&] (const auto& m) { return m.root == root && m.r.contains(c); });
-  if (it == end(_monitors)) {
-    LOG(ERROR) << "no monitor contains (" << c.x << "," << c.y << ")";
+  Monitor* it = monitorAt(root, c);
+  if (it == nullptr) {
+    HOT_LOG(ERROR) << "no monitor contains (" << c.x << "," << c.y << ")";
     return;
   }
   auto& mon = *it;
+  const Rect area = workArea(mon);
 
-  int gridW = mon.r.w / mon.gridX;
-  int gridH = mon.r.h / mon.gridY;
+  int gridW = area.w / mon.gridX;
+  int gridH = area.h / mon.gridY;
 
-  if (e.keycode == XKeysymToKeycode(_disp, XK_H))
+  if (dir == DIR::Left)
     loc.w = std::max(loc.w - gridW, gridW);
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_J))
+  else if (dir == DIR::Down)
     loc.h = std::max(loc.h - gridH, gridH);
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_K))
-    loc.h = std::min(loc.h + gridH, mon.r.h);
-  else if (e.keycode == XKeysymToKeycode(_disp, XK_L))
-    loc.w = std::min(loc.w + gridW, mon.r.w);
+  else if (dir == DIR::Up)
+    loc.h = std::min(loc.h + gridH, area.h);
+  else if (dir == DIR::Right)
+    loc.w = std::min(loc.w + gridW, area.w);
 
   snapGrid(e.window, loc);
 }
 
+/// Lifecycle //////////////////////////////////////////////////////////////////
+
+bool Manager::isDead(Window w) const
+{
+  auto it = _withdrawn.find(w);
+  return it != end(_withdrawn) && it->second.state == ClientState::Destroyed;
+}
+
+void Manager::markDead(Window w)
+{
+  // A withdrawn client's record turns into the dead one, anything else gets
+  // a bare record
+  auto [it, added] = _withdrawn.insert({w, Client{}});
+  if (!added && it->second.state == ClientState::Destroyed)
+    return;
+  it->second.client = w;
+  it->second.state = ClientState::Destroyed;
+
+  if (_deadRing.size() < DEAD_REMEMBERED) {
+    _deadRing.push_back(w);
+  } else {
+    // The oldest is forgotten, unless its id has been handed out again since
+    auto old = _withdrawn.find(_deadRing[_deadNext]);
+    if (old != end(_withdrawn) && old->second.state == ClientState::Destroyed)
+      _withdrawn.erase(old);
+    _deadRing[_deadNext] = w;
+    _deadNext = (_deadNext + 1) % DEAD_REMEMBERED;
+  }
+}
+
+/// Status Bar ///////////////////////////////////////////////////////////////
+
+void Manager::openBars()
+{
+  _bars.resize(_monitors.size());
+  const Bar::Colors colors = { _cfg.barBg, _cfg.barFg, _cfg.borderFocus };
+  for (size_t i = 0; i < _monitors.size(); ++i) {
+    const auto& mon = _monitors[i];
+    if (!_bars[i].open(_disp, _roots.at(mon.root).screen, mon.r, colors))
+      LOG(ERROR) << "no bar for monitor=(" << mon.cfg.name << ")";
+  }
+  updateFocusTitle();
+}
+
+void Manager::closeBars()
+{
+  for (auto& bar : _bars)
+    bar.close();
+  _bars.clear();
+}
+
+void Manager::updateBars()
+{
+  if (_bars.empty())
+    return;
+
+  // Only the bar of the monitor the focused window is on shows its title
+  const Client* focus = _clients.get(_lastFocusClient);
+  char grid[32];
+  for (size_t i = 0; i < _bars.size(); ++i) {
+    const auto& mon = _monitors[i];
+    auto& bar = _bars[i];
+    bar.set(Bar::Seg::Monitor, mon.cfg.name);
+    bar.set(Bar::Seg::Layout, LayoutToString(mon.layout));
+    snprintf(grid, sizeof(grid), "%ux%u", mon.gridX, mon.gridY);
+    bar.set(Bar::Seg::Grid, grid, _gridActive);
+    bool here = focus != nullptr && focus->root == mon.root && mon.r.contains(focus->geom.getCenter());
+    bar.set(Bar::Seg::Title, here ? std::string_view(_focusTitle) : std::string_view(), here);
+    bar.flush();
+  }
+}
+
+void Manager::updateFocusTitle()
+{
+  if (_bars.empty())
+    return;
+  if (_clients.get(_lastFocusClient) != nullptr)
+    GetWinName(_disp, _lastFocus, _atoms[XA::NET_WM_NAME], _atoms[XA::UTF8_STRING], Bar::TEXT_RESERVED,
+               _focusTitle);
+  else
+    _focusTitle.clear();
+}
+
+Rect Manager::workArea(const Monitor& mon) const
+{
+  // The bar takes a strip off the top
+  size_t i = size_t(&mon - _monitors.data());
+  int barH = (i < _bars.size()) ? _bars[i].height() : 0;
+  return Rect(mon.r.o.x, mon.r.o.y + barH, mon.r.w, mon.r.h - barH);
+}
+
+/// Terminal Pool ////////////////////////////////////////////////////////////
+
+void Manager::spawnPoolTerm(Window root)
+{
+  std::string display = std::string(DisplayString(_disp)) + "." + std::to_string(_roots.at(root).screen);
+  std::string geom = std::to_string(TERM_COLS) + "x" + std::to_string(TERM_ROWS);
+  pid_t pid = SpawnDetached(display, {"st", "-g", geom});
+  if (pid == 0) {
+    LOG(ERROR) << "unable to start pooled terminal root=" << root << " errno=" << errno;
+    return;
+  }
+  _termPool[root] = PoolTerm{pid, false, {}};
+  LOG(INFO) << "starting pooled terminal root=" << root << " pid=" << pid;
+}
+
+bool Manager::holdPoolTerm(const XMapRequestEvent& e)
+{
+  // Only worth a round trip while a terminal on this root is starting
+  auto it = _termPool.find(e.parent);
+  if (it == end(_termPool) || it->second.pid == 0 || it->second.ready)
+    return false;
+
+  unsigned long pid;
+  if (!GetWinCardinal(_disp, e.window, _atoms[XA::NET_WM_PID], pid) || pid_t(pid) != it->second.pid)
+    return false;
+
+  // Queried now so handing it out needs nothing from the server
+  if (!queryClient(e.window, false, it->second.n))
+    return false;
+  it->second.ready = true;
+  HOT_LOG(INFO) << "holding pooled terminal window=" << e.window << " pid=" << pid;
+  return true;
+}
+
+void Manager::drainTermPool()
+{
+  // A restart starts its own, these would stay around unmapped forever
+  for (const auto& [root, pool] : _termPool) {
+    if (pool.ready)
+      XKillClient(_disp, pool.n.c.client);
+    else if (pool.pid != 0)
+      kill(pool.pid, SIGTERM);
+  }
+  _termPool.clear();
+}
+
+/// Config ///////////////////////////////////////////////////////////////////
+
+void Manager::onConfigChanged()
+{
+  // Drain the queue, several events for one save only need one reload
+  alignas(inotify_event) char buf[4096];
+  bool changed = false;
+  const std::string base = basename(std::string(_argConfigPath).data());
+  ssize_t len;
+  while ((len = read(_inotify, buf, sizeof(buf))) > 0) {
+    for (char* p = buf; p < buf + len; ) {
+      auto* ev = (inotify_event*) p;
+      if (ev->len > 0 && base == ev->name)
+        changed = true;
+      p += sizeof(inotify_event) + ev->len;
+    }
+  }
+  if (!changed)
+    return;
+
+  Config next;
+  if (!LoadConfig(_argConfigPath, next)) {
+    LOG(ERROR) << "keeping running config";
+    return;
+  }
+  applyConfig(next);
+}
+
+void Manager::applyConfig(Config& next)
+{
+  // Monitors are tied to what init() discovered, only their grids can change live
+  bool sameMonitors = next.monitors.size() == _cfg.monitors.size() &&
+      std::equal(begin(next.monitors), end(next.monitors), begin(_cfg.monitors),
+                 [] (const auto& a, const auto& b) { return a.second.sameOutput(b.second); });
+  if (!sameMonitors)
+    LOG(WARN) << "monitor config changes require a restart, keeping current monitors";
+
+  Config prev = _cfg;
+
+  // Monitor::cfg references the map nodes, update them in place and move the
+  // map across (moving a std::map keeps its nodes)
+  for (auto& [name, m] : _cfg.monitors) {
+    if (!sameMonitors)
+      break;
+    m.gridX = next.monitors.at(name).gridX;
+    m.gridY = next.monitors.at(name).gridY;
+    m.layout = next.monitors.at(name).layout;
+  }
+  next.monitors = std::move(_cfg.monitors);
+  _cfg = std::move(next);
+
+  for (auto& mon : _monitors) {
+    const auto& old = prev.monitors.at(mon.cfg.name);
+    unsigned gx = _cfg.gridXFor(mon.cfg), gy = _cfg.gridYFor(mon.cfg);
+    if (prev.gridXFor(old) != gx || prev.gridYFor(old) != gy) {
+      LOG(INFO) << "config grid change monitor=(" << mon.cfg.name << ") x=" << gx << " y=" << gy;
+      mon.gridX = gx;
+      mon.gridY = gy;
+    }
+    Layout layout = _cfg.layoutFor(mon.cfg);
+    if (prev.layoutFor(old) != layout) {
+      LOG(INFO) << "config layout change monitor=(" << mon.cfg.name << ") layout=" << LayoutToString(layout);
+      mon.layout = layout;
+    }
+  }
+
+  if (prev.background != _cfg.background) {
+    for (const auto& r : _roots) {
+      XSetWindowBackground(_disp, r.first, _cfg.background);
+      XClearWindow(_disp, r.first);
+    }
+  }
+
+  if (prev.borderThick != _cfg.borderThick) {
+    for (const auto& c : _clients) {
+      XWindowAttributes attr;
+      if (!c.second.fullscreen && GetWinAttrs(_disp, c.first, attr) &&
+          attr.border_width == prev.borderThick)
+        XSetWindowBorderWidth(_disp, c.first, unsigned(_cfg.borderThick));
+    }
+  }
+
+  if (prev.borderFocus != _cfg.borderFocus || prev.borderUnfocus != _cfg.borderUnfocus) {
+    for (const auto& c : _clients)
+      XSetWindowBorder(_disp, c.first, c.first == _lastFocus ? _cfg.borderFocus : _cfg.borderUnfocus);
+    for (const auto& r : _roots)
+      for (Window side : r.second.outline)
+        XSetWindowBackground(_disp, side, _cfg.borderFocus);
+  }
+
+  if (prev.bar != _cfg.bar || prev.barBg != _cfg.barBg || prev.barFg != _cfg.barFg ||
+      (_cfg.bar && prev.borderFocus != _cfg.borderFocus)) {
+    LOG(INFO) << "config bar change on=" << _cfg.bar;
+    closeBars();
+    if (_cfg.bar)
+      openBars();
+    // The work area moved if the bar came or went
+    if (prev.bar != _cfg.bar)
+      for (const auto& r : _roots)
+        relayout(r.first);
+  }
+
+  if (_gridActive) {
+    bool colors = prev.gridColor != _cfg.gridColor || prev.gridInact != _cfg.gridInact ||
+                  prev.gridBg != _cfg.gridBg;
+    Window curFocus = GetFocus(_disp);
+    for (auto& mon : _monitors) {
+      if (colors)
+        XSetWindowBackground(_disp, mon.gridDraw, _cfg.gridBg);
+      drawGrid(&mon, mon.gridDraw == curFocus);
+    }
+  }
+
+  if (prev.bindings != _cfg.bindings) {
+    // Only touch the grabs that actually changed
+    std::vector<std::pair<KeyCode, unsigned>> removed, added;
+    for (const auto& b : prev.bindings)
+      if (std::find_if(begin(_cfg.bindings), end(_cfg.bindings), [&] (const auto& n) {
+            return n.sym == b.sym && n.mods == b.mods; }) == end(_cfg.bindings))
+        removed.emplace_back(XKeysymToKeycode(_disp, b.sym), b.mods);
+    for (const auto& b : _cfg.bindings)
+      if (std::find_if(begin(prev.bindings), end(prev.bindings), [&] (const auto& o) {
+            return o.sym == b.sym && o.mods == b.mods; }) == end(prev.bindings))
+        added.emplace_back(XKeysymToKeycode(_disp, b.sym), b.mods);
+
+    updateKeyCodes();
+    for (const auto& c : _clients) {
+      for (const auto& [code, mods] : removed)
+        XUngrabKey(_disp, code, mods, c.first);
+      for (const auto& [code, mods] : added)
+        XGrabKey(_disp, code, mods, c.first, false, GrabModeAsync, GrabModeAsync);
+    }
+    LOG(INFO) << "config bindings changed removed=" << removed.size() << " added=" << added.size();
+  }
+
+  if (prev.recordFps != _cfg.recordFps || prev.recordSecs != _cfg.recordSecs ||
+      prev.recordMegabytes != _cfg.recordMegabytes)
+    startRecorder();
+
+  if (prev.watchdogMs != _cfg.watchdogMs)
+    _watchdog.setBudget(_cfg.watchdogMs);
+
+  // Layout or border changes, unchanged windows are skipped
+  for (const auto& r : _roots)
+    relayout(r.first);
+
+  XFlush(_disp);
+  LOG(INFO) << "applied config path=(" << _argConfigPath << ")";
+}
+
+void Manager::startRecorder()
+{
+  _recorder.reset();
+  if (_cfg.recordFps == 0)
+    return;
+
+  std::vector<Recorder::Area> areas;
+  for (const auto& mon : _monitors)
+    areas.push_back({mon.cfg.name, _roots.at(mon.root).screen, mon.r});
+  _recorder = std::make_unique<Recorder>(DisplayString(_disp), std::move(areas), _cfg.recordFps,
+                                         _cfg.recordSecs, size_t(_cfg.recordMegabytes) << 20);
+}
+
+void Manager::updateKeyCodes()
+{
+  _bindCodes.clear();
+  for (const auto& b : _cfg.bindings)
+    _bindCodes.push_back(XKeysymToKeycode(_disp, b.sym));
+}
+
+void Manager::grabKeys(Window w)
+{
+  for (size_t i = 0; i < _cfg.bindings.size(); ++i)
+    XGrabKey(_disp, _bindCodes[i], _cfg.bindings[i].mods, w, false, GrabModeAsync, GrabModeAsync);
+}
+
 /// Utils //////////////////////////////////////////////////////////////////////
 
+Monitor* Manager::monitorAt(Window root, const Point& p)
+{
+  auto it = _roots.find(root);
+  if (it == end(_roots))
+    return nullptr;
+  const size_t* i = it->second.monitors.containing(p);
+  return i ? &_monitors[*i] : nullptr;
+}
+
+void Manager::indexMonitors(Window root)
+{
+  // Monitors are only ever added at startup, their indices stay valid
+  auto& r = _roots.at(root);
+  r.monitors.clear();
+  for (size_t i = 0; i < _monitors.size(); ++i) {
+    if (_monitors[i].root != root)
+      continue;
+    r.monitors.set(i, _monitors[i].r);
+    _monitorsAbs.set(i, _monitors[i].r + _monitors[i].absOrigin);
+  }
+}
+
+void Manager::setGeom(Client& c, const Rect& r)
+{
+  if (c.client != _drag.w)
+    ++_geomGen;
+  c.geom = r;
+  if (!c.ign)
+    _clientRects.set(c.client, r + c.absOrigin);
+}
+
+const EdgeIndex* Manager::edgesAt(Window root, const Point& p)
+{
+  auto rit = _roots.find(root);
+  if (rit == end(_roots))
+    return nullptr;
+  const size_t* i = rit->second.monitors.containing(p);
+  if (i == nullptr)
+    return nullptr;
+
+  if (_monitorEdges.size() != _monitors.size())
+    _monitorEdges.resize(_monitors.size());
+  MonitorEdges& cache = _monitorEdges[*i];
+  if (cache.gen == _geomGen && cache.skip == _drag.w)
+    return &cache.edges;
+
+  // Outer rects of the windows reaching into the monitor, the dragged one aside
+  const Rect& m = _monitors[*i].r;
+  cache.edges.clear();
+  cache.edges.add(m);
+  for (const auto& [w, c] : _clients) {
+    if (c.root != root || c.ign || w == _drag.w)
+      continue;
+    Rect outer(c.geom.o.x, c.geom.o.y, c.geom.w + (2 * c.border), c.geom.h + (2 * c.border));
+    if (outer.o.x < m.o.x + m.w && outer.o.x + outer.w > m.o.x &&
+        outer.o.y < m.o.y + m.h && outer.o.y + outer.h > m.o.y)
+      cache.edges.add(outer);
+  }
+  cache.edges.sort();
+  cache.gen = _geomGen;
+  cache.skip = _drag.w;
+  return &cache.edges;
+}
+
+bool Manager::placeFree(const Monitor& mon, int outerW, int outerH, Point& at)
+{
+  // Outer rects of everything already on this root, root coordinates
+  auto& used = _usedScratch;
+  used.clear();
+  for (const auto& [w, c] : _clients) {
+    if (c.root == mon.root && !c.ign)
+      used.push_back(Rect(c.geom.o.x, c.geom.o.y, c.geom.w + (2 * c.border), c.geom.h + (2 * c.border)));
+  }
+
+  Rect free;
+  const Rect area = workArea(mon);
+  if (!_freeSpace.largest(area, used, std::min(outerW, area.w), std::min(outerH, area.h), free))
+    return false;
+
+  // Centered in the region, clamped so a window larger than it stays on the monitor
+  at.x = std::max(area.o.x, free.o.x + (free.w - outerW) / 2);
+  at.y = std::max(area.o.y, free.o.y + (free.h - outerH) / 2);
+  return true;
+}
+
+void Manager::relayout(Window root)
+{
+  auto rit = _roots.find(root);
+  if (rit == end(_roots))
+    return;
+
+  // Tiled clients per monitor, in mapping order, from cached geometry only.
+  // The scratch vectors keep their capacity from one call to the next.
+  auto& tiled = _tiledScratch;
+  tiled.resize(_monitors.size());
+  for (auto& t : tiled)
+    t.clear();
+  for (Window w : rit->second.clientList) {
+    auto& c = _clients.at(w);
+    if (c.fullscreen)
+      continue;
+    if (auto* i = rit->second.monitors.containing(c.geom.getCenter()); i != nullptr)
+      tiled[*i].push_back(&c);
+  }
+
+  unsigned sent = 0;
+  auto& rects = _rectsScratch;
+  for (size_t i = 0; i < _monitors.size(); ++i) {
+    const auto& mon = _monitors[i];
+    if (mon.root != root || mon.layout == Layout::Float)
+      continue;
+
+    const Rect area = workArea(mon);
+    ComputeLayout(mon.layout, area, tiled[i].size(), rects);
+    for (size_t j = 0; j < rects.size(); ++j) {
+      auto& c = *tiled[i][j];
+
+      // Like maximize, a window filling its monitor drops the border
+      int b = (rects[j] == area) ? 0 : _cfg.borderThick;
+      XWindowChanges changes;
+      changes.x = rects[j].o.x;
+      changes.y = rects[j].o.y;
+      changes.width = std::max(1, rects[j].w - 2 * b);
+      changes.height = std::max(1, rects[j].h - 2 * b);
+      changes.border_width = b;
+
+      unsigned mask = 0;
+      if (changes.x != c.geom.o.x)      mask |= CWX;
+      if (changes.y != c.geom.o.y)      mask |= CWY;
+      if (changes.width != c.geom.w)    mask |= CWWidth;
+      if (changes.height != c.geom.h)   mask |= CWHeight;
+      if (changes.border_width != c.border) mask |= CWBorderWidth;
+      if (mask == 0)
+        continue;
+
+      XConfigureWindow(_disp, c.client, mask, &changes);
+      setGeom(c, Rect(changes.x, changes.y, changes.width, changes.height));
+      c.border = b;
+      ++sent;
+    }
+  }
+
+  if (sent > 0) {
+    XFlush(_disp);
+    HOT_LOG(INFO) << "relayout root=" << root << " changed=" << sent;
+  }
+}
+
 void Manager::drawGrid(Monitor* mon, bool active)
 {
   XClearWindow(_disp, mon->gridDraw);
-  XSetWindowBorder(_disp, mon->gridDraw, (active ? GRID_COLOR : GRID_INACT));
+  XSetWindowBorder(_disp, mon->gridDraw, (active ? _cfg.gridColor : _cfg.gridInact));
 
   XGCValues values;
   GC gc = XCreateGC(_disp, mon->gridDraw, 0, &values);
-  XSetForeground(_disp, gc, (active ? GRID_COLOR : GRID_INACT));
-  XSetLineAttributes(_disp, gc, GRID_THICK, LineSolid, CapButt, JoinBevel);
+  XSetForeground(_disp, gc, (active ? _cfg.gridColor : _cfg.gridInact));
+  XSetLineAttributes(_disp, gc, _cfg.gridThick, LineSolid, CapButt, JoinBevel);
 
+  const Rect area = workArea(*mon);
   for (unsigned i = 0; i < mon->gridX - 1; ++i) {
-    int x = ((i+1) * (mon->r.w / mon->gridX));
-    XDrawLine(_disp, mon->gridDraw, gc, x, 0, x, mon->r.h);
+    int x = ((i+1) * (area.w / mon->gridX));
+    XDrawLine(_disp, mon->gridDraw, gc, x, 0, x, area.h);
   }
 
   for (unsigned i = 0; i < mon->gridY - 1; ++i) {
-    int y = ((i+1) * (mon->r.h / mon->gridY));
-    XDrawLine(_disp, mon->gridDraw, gc, 0, y, mon->r.w, y);
+    int y = ((i+1) * (area.h / mon->gridY));
+    XDrawLine(_disp, mon->gridDraw, gc, 0, y, area.w, y);
   }
+  XFreeGC(_disp, gc);
 }
 
-Window Manager::getNextWindowInDir(DIR dir, Window w)
+void Manager::drawOutline(const Rect& r)
 {
-  std::vector<std::pair<Point, Window>> windows;
-  for (const auto& m : _clients) {
-    if (m.first != w && !m.second.ign) {
-      XWindowAttributes a;
-      XGetWindowAttributes(_disp, m.first, &a);
-      Point c = m.second.absOrigin + Rect(a.x, a.y, a.width, a.height).getCenter();
-      windows.emplace_back(c, m.first);
-    }
+  if (r.w <= 0) {
+    // Hidden everywhere, the dragged window may already be gone
+    if (_drag.outlined)
+      for (const auto& root : _roots)
+        for (Window side : root.second.outline)
+          XUnmapWindow(_disp, side);
+    _drag.outlined = false;
+    return;
   }
 
-  XWindowAttributes attr;
-  XGetWindowAttributes(_disp, w, &attr);
-  Point c = _roots.at(GetWinRoot(_disp, w)).absOrigin + Rect(attr.x, attr.y, attr.width, attr.height).getCenter();
+  const Client* c = _clients.get(_drag.client);
+  if (c == nullptr || (_drag.outlined && _drag.outline == r))
+    return;
+  const auto& side = _roots.at(c->root).outline;
+
+  // Around the border, where the window will end up
+  const int b = std::max(1, _cfg.borderThick);
+  const int x = r.o.x, y = r.o.y;
+  const unsigned w = unsigned(r.w + 2 * b), h = unsigned(r.h);
+  XMoveResizeWindow(_disp, side[0], x, y, w, unsigned(b));
+  XMoveResizeWindow(_disp, side[1], x, y + r.h + b, w, unsigned(b));
+  XMoveResizeWindow(_disp, side[2], x, y + b, unsigned(b), h);
+  XMoveResizeWindow(_disp, side[3], x + r.w + b, y + b, unsigned(b), h);
+  if (!_drag.outlined)
+    for (int i = 0; i < 4; ++i)
+      XMapRaised(_disp, side[i]);
+
+  _drag.outlined = true;
+  _drag.outline = r;
+}
+
+void Manager::cancelDrag()
+{
+  drawOutline(Rect());
+  _drag = {};
+}
+
+Window Manager::getNextWindowInDir(DIR dir, Window w)
+{
+  // Clients come from the cache, only a root or unmanaged window is queried
+  Point c;
+  if (const Rect* r = _clientRects.get(w)) {
+    c = r->getCenter();
+  } else {
+    XWindowAttributes attr;
+    GetWinAttrs(_disp, w, attr);
+    c = _roots.at(GetWinRoot(_disp, w)).absOrigin + Rect(attr.x, attr.y, attr.width, attr.height).getCenter();
+  }
 
-  auto closest = getNextPointInDir(dir, c, windows);
-  return closest ? closest : w;
+  const Window* closest = _clientRects.nextInDir(dir, c, &w);
+  return closest ? *closest : w;
 }
@@ -1,19 +1,30 @@
 #pragma once
 
+#include "Atoms.hpp"
+#include "Bar.hpp"
+#include "Config.hpp"
+#include "DesktopIndex.hpp"
+#include "FlatMap.hpp"
 #include "Geometry.hpp"
+#include "Launcher.hpp"
+#include "Recorder.hpp"
+#include "Screenshot.hpp"
+#include "Snapshot.hpp"
+#include "Watchdog.hpp"
 
 #include <X11/Xlib.h>
+#include <X11/extensions/sync.h>
+
+struct XRROutput;
+
+#include <chrono>
 
 #include <map>
+#include <memory>
 #include <vector>
 #include <cstdint>
 
-struct MonitorCfg
-{
-  std::string name;
-  int screen;
-  std::string connector;
-};
+#include <sys/types.h>
 
 struct Monitor
 {
@@ -25,26 +36,87 @@ struct Monitor
   Window gridDraw;
   unsigned gridX;
   unsigned gridY;
+
+  Layout layout;
+};
+
+/// Edges of a monitor and the windows on it, root coordinates. Rebuilt when
+/// Manager::_geomGen moves on, never with the dragged window in it.
+struct MonitorEdges
+{
+  EdgeIndex edges;
+  uint64_t gen = 0;
+  Window skip = 0;
 };
 
 struct Root
 {
   int screen;
   Point absOrigin;
+
+  Window wmCheck;
+  std::vector<Window> clientList; // _NET_CLIENT_LIST, in mapping order
+
+  Window outline[4]; // Sides of the frame for outline drags, unmapped in between
+
+  RectSet<size_t> monitors; // Indices into Manager::_monitors, root coordinates
+};
+
+/// Where a window is in its life, as far as mwm has seen
+enum class ClientState
+{
+  Pending,   // Queried, not mapped yet (held pool terminals)
+  Mapped,    // Managed, everything in _clients
+  Unmapped,  // Withdrawn, kept in _withdrawn until mapped again or destroyed
+  Destroyed, // Gone, kept in _withdrawn for a while so requests to it are dropped
 };
 
 struct Client
 {
   Window client;
+  ClientState state = ClientState::Pending;
   Window root;
   Rect preMax;
   bool ign;
   Point absOrigin;
+
+  // Last known geometry, kept current from ConfigureNotify so layouts never
+  // have to ask the server
+  Rect geom;
+  int border = 0;
+
+  bool fullscreen = false;
+  Rect preFull;
+  int preFullBorder;
+
+  SizeHints hints;
+  XSyncCounter syncCounter = None; // _NET_WM_SYNC_REQUEST_COUNTER
+};
+
+/// A window already queried, all addClient needs to map it without asking
+/// the server anything else
+struct NewClient
+{
+  Client c;
+  XWindowAttributes attrs;
+  bool fullscreen = false;
+  bool place = false; // New rather than adopted, may be moved into free space
 };
 
+/// A terminal started ahead of Numlock+T, held unmapped until handed out
+struct PoolTerm
+{
+  pid_t pid = 0;      // Whose window to hold back, 0 when none is starting
+  bool ready = false; // Its window was seen, n is filled in
+  NewClient n;
+};
+
+using ClientHandle = FlatMap<Window, Client>::Handle;
+
 struct Drag
 {
   Window w = 0;
+  ClientHandle client; // w in Manager::_clients, no lookup per motion
 
   int xR, yR;
   int x, y;
@@ -53,6 +125,18 @@ struct Drag
   int btn;
   DIR dirVert;
   DIR dirHorz;
+
+  // Outline mode only, the frame currently shown
+  bool outlined = false;
+  Rect outline;
+
+  // Sync-paced resize, syncNext is the newest size not yet sent
+  bool sync = false;
+  bool syncWaiting = false;
+  bool syncHasNext = false;
+  int64_t syncValue = 0;
+  Rect syncNext;
+  std::chrono::steady_clock::time_point syncDeadline;
 };
 
 class Manager
@@ -62,57 +146,174 @@ class Manager
     Manager(const std::string& display,
             const std::map<int,Point>& screens,
             const std::string& screenshotDir,
-            const std::map<std::string,MonitorCfg>& monitorCfg);
+            const std::string& configPath,
+            const std::string& restorePath);
     ~Manager();
 
     bool init();
     void run();
 
+    /// Set once run() returned because a restart was requested
+    const std::string& restartPath() const { return _restartPath; }
+
   private:
 
     // X server events
     void onReq_Map(const XMapRequestEvent& e);
     void onNot_Unmap(const XUnmapEvent& e);
+    void onNot_Destroy(const XDestroyWindowEvent& e);
+    void onNot_Configure(const XConfigureEvent& e);
     void onReq_Configure(const XConfigureRequestEvent& e);
     void onNot_Motion(const XButtonEvent& e);
+    void onNot_Enter(const XCrossingEvent& e);
+    void onNot_Property(const XPropertyEvent& e);
+    void onSyncAlarm(const XSyncAlarmNotifyEvent& e);
     void handleFocusChange(const XFocusChangeEvent& e, bool in);
     void onKeyPress(const XKeyEvent& e);
     void onBtnPress(const XButtonEvent& e);
+    void onBtnRelease(const XButtonEvent& e);
     void onClientMessage(const XClientMessageEvent& e);
+    void dispatch(const XEvent& e);
+
+    // ClientMessage handlers
+    void onMsgWmState(const XClientMessageEvent& e);
+    void onMsgActiveWindow(const XClientMessageEvent& e);
+    void onMsgCloseWindow(const XClientMessageEvent& e);
 
     // Keypress handlers
     void onKeyTerminal(const XKeyEvent& e);
-    void onKeyMoveMonitor(const XKeyEvent& e);
-    void onKeyMoveFocus(const XKeyEvent& e);
+    void onKeyMoveMonitor(const XKeyEvent& e, DIR dir);
+    void onKeyMoveFocus(const XKeyEvent& e, DIR dir);
     void onKeyMaximize(const XKeyEvent& e);
     void onKeyUnmaximize(const XKeyEvent& e);
     void onKeyClose(const XKeyEvent& e);
     void onKeyLauncher(const XKeyEvent& e);
-    void onKeyScreenshot(const XKeyEvent& e);
+    void onKeyLauncherActive(const XKeyEvent& e);
+    void onKeyScreenshot(const XKeyEvent& e, Action area);
     void onKeyGrid(const XKeyEvent& e);
     void onKeyGridActive(const XKeyEvent& e);
     void onKeySnapGrid(const XKeyEvent& e);
-    void onKeyMoveGridLoc(const XKeyEvent& e);
-    void onKeyMoveGridSize(const XKeyEvent& e);
+    void onKeyMoveGridLoc(const XKeyEvent& e, DIR dir);
+    void onKeyMoveGridSize(const XKeyEvent& e, DIR dir);
+    void onKeyVolume(int step);
+    void onKeyRestart(const XKeyEvent& e);
+    void onKeyCycleLayout(const XKeyEvent& e);
+    void onKeyRecordDump(const XKeyEvent& e);
+
+    // Config
+    void onConfigChanged();
+    void applyConfig(Config& next);
+    void updateKeyCodes();
+    void grabKeys(Window w);
+    void startRecorder();
+
+    // Terminal pool
+    void spawnPoolTerm(Window root);
+    bool holdPoolTerm(const XMapRequestEvent& e);
+    void drainTermPool();
 
     // Misc
+    bool discoverMonitors(Window root, int screen, const std::vector<XRROutput>& outputs);
+    bool restoreMonitors(Window root, const Snapshot& snap);
     void addClient(Window w, bool checkIgn);
+    bool queryClient(Window w, bool checkIgn, NewClient& n);
+    void manageClient(const NewClient& n);
+    void restoreClient(const Snapshot::ClientRec& rec, Window focus);
+    void grabButtons(Window w, bool focused);
+    XSyncCounter getSyncCounter(Window w);
+    void resizeClient(Client& c, const Rect& r);
+    void onTimeout();
+    int pollTimeout() const;
+    void setFullscreen(Client& c, bool on);
+    void setLastFocus(Window w);
     void switchFocus(Window w);
+    void sendDelete(Window w);
     void snapGrid(Window w, Rect r);
+    bool isDead(Window w) const;
+    void markDead(Window w);
+    void relayout(Window root);
+    Monitor* monitorAt(Window root, const Point& p);
+    void indexMonitors(Window root);
+    void setGeom(Client& c, const Rect& r);
+    void sendConfigureNotify(const Client& c); // Where c already is, for a request not applied
+    bool placeFree(const Monitor& mon, int outerW, int outerH, Point& at);
+    const EdgeIndex* edgesAt(Window root, const Point& p);
     void drawGrid(Monitor* mon, bool active);
+    void drawOutline(const Rect& r);
+    void cancelDrag(); // Hides the outline, applies nothing
     Window getNextWindowInDir(DIR dir, Window w);
 
+    // EWMH
+    void ewmhInit(Window root);
+    void ewmhAddClient(const Client& c);
+    void ewmhRemoveClient(const Client& c);
+    void ewmhSetActive(Window root, Window w);
+
+    // Status bar
+    void openBars();
+    void closeBars();
+    void updateBars();
+    void updateFocusTitle();
+    Rect workArea(const Monitor& mon) const;
+
     const std::string& _argDisp;
     const std::map<int,Point>& _argScreens;
     const std::string& _argScreenshotDir;
-    const std::map<std::string,MonitorCfg>& _argMonitorCfg;
+    const std::string& _argConfigPath;
+    const std::string& _argRestorePath;
+
+    Config _cfg;
+    std::vector<KeyCode> _bindCodes; // Parallel to _cfg.bindings
+    int _inotify = -1;
 
     Display* _disp = nullptr;
-    std::map<Window, Client> _clients;
+    FlatMap<Window, Client> _clients;   // Mapped only, hot on every event, unordered
+    FlatMap<Window, Client> _withdrawn; // Unmapped, or recently destroyed
+    std::vector<Window> _deadRing;      // Bounds the destroyed ones, oldest overwritten first
+    size_t _deadNext = 0;
     std::map<Window, Root> _roots;
     std::vector<Monitor> _monitors;
+    RectSet<size_t> _monitorsAbs;  // Indices into _monitors, absolute coordinates
+    std::vector<MonitorEdges> _monitorEdges; // By index into _monitors, sized at drag start
+    RectSet<Window> _clientRects;  // Managed clients, absolute coordinates
 
     Drag _drag = {};
+    uint64_t _geomGen = 1; // Bumped whenever a client rect other than the dragged one changes
     bool _gridActive = false;
     Window _lastFocus = 0;
+    ClientHandle _lastFocusClient; // Empty while _lastFocus is a root
+
+    // Focus follows mouse, the window the pointer last crossed into waits
+    // out the delay before it is focused
+    Window _focusPending = None;
+    ClientHandle _focusPendingClient;
+    std::chrono::steady_clock::time_point _focusDeadline;
+    Point _enterAbs; // Where the last crossing happened, absolute coordinates
+    std::string _restartPath;
+
+    std::map<Window, PoolTerm> _termPool; // By root
+
+    // Scratch space reused across calls, so steady-state handlers don't allocate
+    std::vector<std::vector<Client*>> _tiledScratch; // relayout
+    std::vector<Rect> _rectsScratch;                 // relayout
+    std::vector<Rect> _usedScratch;                  // placeFree
+    FreeSpace _freeSpace;                            // placeFree
+    std::string _cmd;                                // Launch commands
+
+    DesktopIndex _desktop;
+    Launcher _launcher;
+    std::vector<Bar> _bars;  // By index into _monitors, empty while the bar is off
+    std::string _focusTitle; // Name of _lastFocus, UTF-8
+
+    ScreenshotWriter _screenshots;
+    std::unique_ptr<Recorder> _recorder;
+
+    std::chrono::steady_clock::time_point _started; // Construction, for the startup report
+    Watchdog _watchdog;
+
+    Atoms _atoms;
+    int _syncEventBase = 0;
+    XSyncAlarm _syncAlarm = None;
+    Window _netActive = None;
+    Window _netActiveRoot = None;
 };
@@ -0,0 +1,417 @@
+#include "Recorder.hpp"
+
+#include "Screenshot.hpp"
+
+#include <u/log.hpp>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <sys/ipc.h>
+#include <sys/resource.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+namespace {
+
+/// Seconds between keyframes, also the eviction granularity
+constexpr unsigned KEYFRAME_SECS = 10;
+
+/// How often CPU and memory use are logged
+constexpr auto STATS_PERIOD = std::chrono::seconds(60);
+
+/// Dump threads are detached, these let the process wait them out
+std::mutex g_dumpMutex;
+std::condition_variable g_dumpCond;
+unsigned g_dumps = 0;
+
+double ThreadCpuMs()
+{
+  rusage ru;
+  if (getrusage(RUSAGE_THREAD, &ru) != 0)
+    return 0;
+  return double(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e3 +
+         double(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e3;
+}
+
+/// A grab target that is reused every frame, MIT-SHM when possible
+struct Grabber
+{
+  XImage* img = nullptr;
+  XShmSegmentInfo shm = {};
+  bool useShm = false;
+
+  /// False means MIT-SHM is unusable and grab() falls back to XGetImage
+  bool init(Display* disp, int screen, const Rect& r)
+  {
+    if (!XShmQueryExtension(disp))
+      return false;
+    img = XShmCreateImage(disp, DefaultVisual(disp, screen), unsigned(DefaultDepth(disp, screen)),
+                          ZPixmap, nullptr, &shm, unsigned(r.w), unsigned(r.h));
+    if (img == nullptr)
+      return false;
+    shm.shmid = shmget(IPC_PRIVATE, size_t(img->bytes_per_line) * size_t(r.h), IPC_CREAT | 0600);
+    shm.shmaddr = (shm.shmid < 0) ? (char*) -1 : (char*) shmat(shm.shmid, nullptr, 0);
+    shm.readOnly = False;
+    bool ok = shm.shmaddr != (char*) -1 && XShmAttach(disp, &shm);
+    if (ok)
+      XSync(disp, False); // Server side attached, the id can go
+    if (shm.shmid >= 0)
+      shmctl(shm.shmid, IPC_RMID, nullptr); // Freed once both sides detach
+    if (!ok) {
+      if (shm.shmaddr != (char*) -1)
+        shmdt(shm.shmaddr);
+      img->data = nullptr;
+      XDestroyImage(img);
+      img = nullptr;
+      return false;
+    }
+    img->data = shm.shmaddr;
+    useShm = true;
+    return true;
+  }
+
+  /// Grabs into img, which stays owned by the grabber
+  XImage* grab(Display* disp, Window root, const Rect& r)
+  {
+    if (useShm)
+      return XShmGetImage(disp, root, img, r.o.x, r.o.y, AllPlanes) ? img : nullptr;
+    if (img != nullptr)
+      XDestroyImage(img);
+    img = XGetImage(disp, root, r.o.x, r.o.y, unsigned(r.w), unsigned(r.h), AllPlanes, ZPixmap);
+    return img;
+  }
+
+  void release(Display* disp)
+  {
+    if (img == nullptr)
+      return;
+    if (useShm) {
+      XShmDetach(disp, &shm);
+      shmdt(shm.shmaddr);
+      img->data = nullptr;
+    }
+    XDestroyImage(img);
+    img = nullptr;
+  }
+};
+
+std::shared_ptr<const std::vector<uint8_t>> Compress(const uint8_t* data, size_t len)
+{
+  uLongf outLen = compressBound(uLong(len));
+  std::vector<uint8_t> out(outLen);
+  if (compress2(out.data(), &outLen, data, uLong(len), 1) != Z_OK)
+    return nullptr;
+  return std::make_shared<const std::vector<uint8_t>>(out.begin(), out.begin() + long(outLen));
+}
+
+} // namespace
+
+Recorder::Recorder(const std::string& display, std::vector<Area> areas,
+                   unsigned fps, unsigned seconds, size_t maxBytes)
+  : _display(display)
+  , _areas(std::move(areas))
+  , _period(std::chrono::microseconds(1000000 / std::max(1u, fps)))
+  , _window(std::chrono::seconds(seconds))
+  , _maxBytes(maxBytes)
+{
+  _thread = std::thread(&Recorder::loop, this);
+}
+
+Recorder::~Recorder()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _cond.notify_one();
+  if (_thread.joinable())
+    _thread.join();
+}
+
+void Recorder::loop()
+{
+  Display* disp = XOpenDisplay(_display.c_str());
+  if (disp == nullptr) {
+    LOG(ERROR) << "recorder unable to open X display=" << _display;
+    return;
+  }
+
+  std::vector<Grabber> grabbers(_areas.size());
+  for (size_t i = 0; i < _areas.size(); ++i)
+    if (!grabbers[i].init(disp, _areas[i].screen, _areas[i].r))
+      LOG(WARN) << "recorder MIT-SHM unavailable, using XGetImage area=(" << _areas[i].name << ")";
+  _prev.resize(_areas.size());
+
+  const uint64_t keyEvery = std::max<uint64_t>(1, uint64_t(KEYFRAME_SECS * std::chrono::seconds(1) / _period));
+  std::vector<uint8_t> delta;
+  uint64_t tick = 0, frames = 0;
+  double grabMs = 0;
+  auto statsStart = std::chrono::steady_clock::now();
+  double statsCpu = ThreadCpuMs();
+  auto next = std::chrono::steady_clock::now();
+
+  LOG(INFO) << "recorder started areas=" << _areas.size()
+            << " periodUs=" << _period.count()
+            << " windowSecs=" << _window.count()
+            << " maxBytes=" << _maxBytes;
+
+  for (;;) {
+    bool key;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      key = _forceKey || tick % keyEvery == 0;
+      _forceKey = false;
+    }
+
+    Group group;
+    auto grabStart = std::chrono::steady_clock::now();
+    auto now = std::chrono::system_clock::now();
+    for (size_t i = 0; i < _areas.size(); ++i) {
+      XImage* img = grabbers[i].grab(disp, RootWindow(disp, _areas[i].screen), _areas[i].r);
+      if (img == nullptr || (img->bits_per_pixel != 32 && img->bits_per_pixel != 16)) {
+        LOG(ERROR) << "recorder grab failed area=(" << _areas[i].name << ")";
+        continue;
+      }
+
+      const size_t len = size_t(img->bytes_per_line) * size_t(img->height);
+      const auto* cur = reinterpret_cast<const uint8_t*>(img->data);
+      if (_prev[i].size() != len) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _formats.resize(_areas.size());
+        _formats[i] = Format{img->width, img->height, img->bytes_per_line, img->bits_per_pixel,
+                             img->red_mask, img->green_mask, img->blue_mask};
+        _prev[i].assign(len, 0);
+      }
+
+      // XOR against the last frame, mostly zeros when little changed
+      const uint8_t* src = cur;
+      if (!key) {
+        delta.resize(len);
+        for (size_t j = 0; j < len; ++j)
+          delta[j] = cur[j] ^ _prev[i][j];
+        src = delta.data();
+      }
+      // _prev has to stay the last frame the ring holds, deltas after a lost
+      // one would decode against it. A lost keyframe leaves the group without
+      // a base, so the next tick starts a new one.
+      auto data = Compress(src, len);
+      if (data == nullptr) {
+        LOG(ERROR) << "recorder compress failed area=(" << _areas[i].name << ")";
+        std::lock_guard<std::mutex> lock(_mutex);
+        _forceKey = true;
+        continue;
+      }
+      memcpy(_prev[i].data(), cur, len);
+
+      group.bytes += data->size();
+      group.frames.push_back(Frame{uint32_t(i), key, now, std::move(data)});
+      ++frames;
+    }
+    grabMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - grabStart).count();
+
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (key || _ring.empty()) {
+        _ring.push_back(std::move(group));
+      } else {
+        auto& last = _ring.back();
+        last.bytes += group.bytes;
+        for (auto& f : group.frames)
+          last.frames.push_back(std::move(f));
+      }
+      _ringBytes += group.bytes;
+      evict(now);
+
+      // One group alone over budget, start another so the old one can go
+      if (_ring.size() == 1 && _ringBytes > _maxBytes)
+        _forceKey = true;
+
+      ++tick;
+      auto steadyNow = std::chrono::steady_clock::now();
+      if (steadyNow - statsStart >= STATS_PERIOD) {
+        double wallMs = std::chrono::duration<double, std::milli>(steadyNow - statsStart).count();
+        double cpuMs = ThreadCpuMs();
+        size_t rawBytes = 0;
+        for (const auto& p : _prev)
+          rawBytes += p.size();
+        LOG(INFO) << "recorder stats"
+                  << " frames=" << frames
+                  << " groups=" << _ring.size()
+                  << " ringBytes=" << _ringBytes
+                  << " rawBytes=" << rawBytes
+                  << " cpuPct=" << (100.0 * (cpuMs - statsCpu) / wallMs)
+                  << " grabMsAvg=" << (tick ? grabMs / double(tick) : 0.0);
+        statsStart = steadyNow;
+        statsCpu = cpuMs;
+      }
+
+      // Fixed rate, a slow frame doesn't cause a burst of catch-up frames
+      next += _period;
+      if (next < steadyNow)
+        next = steadyNow + _period;
+      if (_cond.wait_until(lock, next, [this] { return _stop; }))
+        break;
+    }
+  }
+
+  for (auto& g : grabbers)
+    g.release(disp);
+  XCloseDisplay(disp);
+  LOG(INFO) << "recorder stopped";
+}
+
+void Recorder::evict(std::chrono::system_clock::time_point now)
+{
+  // A group goes once the next one already starts outside the window, or
+  // while over budget. The newest group always stays.
+  while (_ring.size() > 1) {
+    const auto& front = _ring.front();
+    const auto& second = _ring[1];
+    bool old = !second.frames.empty() && second.frames.front().time < now - _window;
+    if (!old && _ringBytes <= _maxBytes)
+      break;
+    _ringBytes -= front.bytes;
+    _ring.pop_front();
+  }
+}
+
+void Recorder::dump(const std::string& dir)
+{
+  if (_dumping->exchange(true)) {
+    LOG(WARN) << "recorder dump already running";
+    return;
+  }
+
+  // Frames are shared, copying the ring only copies pointers
+  std::vector<Group> groups;
+  std::vector<Format> formats;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    groups.assign(_ring.begin(), _ring.end());
+    formats = _formats;
+  }
+
+  std::vector<std::string> names;
+  for (const auto& a : _areas)
+    names.push_back(a.name);
+
+  // Detached so tearing the recorder down never waits on a dump in progress
+  {
+    std::lock_guard<std::mutex> lock(g_dumpMutex);
+    ++g_dumps;
+  }
+  std::thread(&Recorder::WriteDump, std::move(groups), std::move(formats), std::move(names),
+              ExpandHome(dir), _dumping).detach();
+}
+
+void Recorder::WaitForDumps()
+{
+  std::unique_lock<std::mutex> lock(g_dumpMutex);
+  g_dumpCond.wait(lock, [] { return g_dumps == 0; });
+}
+
+void Recorder::WriteDump(std::vector<Group> groups, std::vector<Format> formats,
+                         std::vector<std::string> names, std::string dir,
+                         std::shared_ptr<std::atomic<bool>> dumping)
+{
+  struct Done
+  {
+    std::atomic<bool>& dumping;
+    ~Done()
+    {
+      dumping = false;
+      std::lock_guard<std::mutex> lock(g_dumpMutex);
+      --g_dumps;
+      g_dumpCond.notify_all();
+    }
+  } done{*dumping};
+
+  auto start = std::chrono::steady_clock::now();
+
+  char stamp[64];
+  time_t now = time(nullptr);
+  tm local;
+  strftime(stamp, sizeof(stamp), "%Y-%m-%d::%H:%M:%S", localtime_r(&now, &local));
+  std::string out = dir + "/recording-" + stamp;
+  if (mkdir(out.c_str(), 0700) != 0) {
+    LOG(ERROR) << "unable to create recording dir=(" << out << ") errno=" << errno;
+    return;
+  }
+
+  std::vector<std::vector<uint8_t>> cur(formats.size());
+  std::vector<unsigned> seq(formats.size(), 0);
+  size_t written = 0;
+  for (const auto& g : groups) {
+    for (const auto& f : g.frames) {
+      if (f.area >= formats.size())
+        continue;
+      const Format& fmt = formats[f.area];
+      const size_t len = size_t(fmt.stride) * size_t(fmt.height);
+
+      std::vector<uint8_t> raw(len);
+      uLongf rawLen = uLongf(len);
+      if (uncompress(raw.data(), &rawLen, f.data->data(), uLong(f.data->size())) != Z_OK || rawLen != len) {
+        LOG(ERROR) << "corrupt recorder frame area=(" << names[f.area] << ")";
+        continue;
+      }
+      auto& pixels = cur[f.area];
+      if (f.key) {
+        pixels = std::move(raw);
+      } else {
+        if (pixels.size() != len)
+          continue; // Delta without its keyframe
+        for (size_t j = 0; j < len; ++j)
+          pixels[j] ^= raw[j];
+      }
+
+      Capture cap;
+      cap.width = fmt.width;
+      cap.height = fmt.height;
+      cap.stride = fmt.stride;
+      cap.bitsPerPixel = fmt.bitsPerPixel;
+      cap.redMask = fmt.redMask;
+      cap.greenMask = fmt.greenMask;
+      cap.blueMask = fmt.blueMask;
+      cap.data = static_cast<uint8_t*>(malloc(len));
+      if (cap.data == nullptr)
+        continue;
+      memcpy(cap.data, pixels.data(), len);
+
+      std::string png;
+      if (!EncodePng(cap, 2, png))
+        continue;
+
+      // Name sorts by time per area, ready for an image sequence encoder
+      time_t t = std::chrono::system_clock::to_time_t(f.time);
+      auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(f.time.time_since_epoch()).count() % 1000;
+      char when[32];
+      strftime(when, sizeof(when), "%H%M%S", localtime_r(&t, &local));
+      char name[128];
+      snprintf(name, sizeof(name), "/%s-%06u-%s.%03lld.png", names[f.area].c_str(),
+               seq[f.area]++, when, (long long) ms);
+
+      std::string path = out + name;
+      FILE* fp = fopen(path.c_str(), "wb");
+      if (fp == nullptr) {
+        LOG(ERROR) << "unable to write recording frame path=(" << path << ") errno=" << errno;
+        continue;
+      }
+      fwrite(png.data(), 1, png.size(), fp);
+      fclose(fp);
+      ++written;
+    }
+  }
+
+  LOG(INFO) << "wrote recording dir=(" << out << ")"
+            << " frames=" << written
+            << " ms=" << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
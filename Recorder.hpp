@@ -0,0 +1,93 @@
+#pragma once
+
+#include "Geometry.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Keeps the last few seconds of every monitor in memory so they can be
+/// dumped after the fact. Runs on its own thread with its own X connection.
+///
+/// Frames are the XOR against the previous frame of the same monitor,
+/// deflated. A keyframe starts a group every KEYFRAME_SECS. Whole groups are
+/// evicted from the front, so every group left in the ring decodes on its
+/// own. Memory is bounded by the byte budget plus one raw frame per monitor.
+class Recorder
+{
+  public:
+
+    struct Area
+    {
+      std::string name;
+      int screen;
+      Rect r;
+    };
+
+    Recorder(const std::string& display, std::vector<Area> areas,
+             unsigned fps, unsigned seconds, size_t maxBytes);
+    ~Recorder();
+
+    /// Writes the ring as PNGs under dir/recording-<time>/, off the event loop
+    void dump(const std::string& dir);
+
+    /// Blocks until every dump, of any recorder, has been written out
+    static void WaitForDumps();
+
+  private:
+
+    struct Frame
+    {
+      uint32_t area;
+      bool key;
+      std::chrono::system_clock::time_point time;
+      std::shared_ptr<const std::vector<uint8_t>> data; // Deflated (XOR) pixels
+    };
+
+    struct Group
+    {
+      std::vector<Frame> frames;
+      size_t bytes = 0;
+    };
+
+    /// Pixel layout of an area, as the server hands it out
+    struct Format
+    {
+      int width = 0, height = 0, stride = 0, bitsPerPixel = 0;
+      unsigned long redMask = 0, greenMask = 0, blueMask = 0;
+    };
+
+    void loop();
+    void evict(std::chrono::system_clock::time_point now);
+
+    /// Runs detached, so it only touches what it is handed
+    static void WriteDump(std::vector<Group> groups, std::vector<Format> formats,
+                          std::vector<std::string> names, std::string dir,
+                          std::shared_ptr<std::atomic<bool>> dumping);
+
+    const std::string _display;
+    const std::vector<Area> _areas;
+    const std::chrono::microseconds _period;
+    const std::chrono::seconds _window;
+    const size_t _maxBytes;
+
+    std::vector<Format> _formats;            // Filled in before the first frame
+    std::vector<std::vector<uint8_t>> _prev; // Last raw frame per area, recorder thread only
+
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    bool _stop = false;
+    bool _forceKey = false;
+    std::deque<Group> _ring;
+    size_t _ringBytes = 0;
+
+    std::thread _thread;
+    std::shared_ptr<std::atomic<bool>> _dumping = std::make_shared<std::atomic<bool>>(false);
+};
@@ -0,0 +1,375 @@
+#include "Screenshot.hpp"
+
+#include <u/log.hpp>
+
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <zlib.h>
+
+namespace {
+
+double MsSince(std::chrono::steady_clock::time_point t)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+}
+
+/// Shift and width of a channel mask, so any TrueColor layout can be unpacked
+struct Channel
+{
+  unsigned shift = 0;
+  unsigned bits = 0;
+
+  explicit Channel(unsigned long mask)
+  {
+    while (mask != 0 && (mask & 1) == 0) {
+      mask >>= 1;
+      ++shift;
+    }
+    while (mask & 1) {
+      mask >>= 1;
+      ++bits;
+    }
+  }
+
+  uint8_t get(uint32_t px) const
+  {
+    uint32_t v = (px >> shift) & ((1u << bits) - 1);
+    if (bits >= 8)
+      return uint8_t(v >> (bits - 8));
+    return uint8_t((v * 255) / ((1u << bits) - 1));
+  }
+};
+
+/// One PNG row of Sub-filtered RGB, filter byte included
+void FilterRow(const Capture& cap, int y, const Channel& r, const Channel& g, const Channel& b, uint8_t* out)
+{
+  const uint8_t* row = cap.data + size_t(y) * size_t(cap.stride);
+  *out++ = 1; // Sub
+  uint8_t prev[3] = { 0, 0, 0 };
+  for (int x = 0; x < cap.width; ++x) {
+    uint32_t px;
+    if (cap.bitsPerPixel == 32) {
+      memcpy(&px, row + x * 4, 4);
+    } else {
+      uint16_t p16;
+      memcpy(&p16, row + x * 2, 2);
+      px = p16;
+    }
+    uint8_t rgb[3] = { r.get(px), g.get(px), b.get(px) };
+    for (int c = 0; c < 3; ++c) {
+      *out++ = uint8_t(rgb[c] - prev[c]);
+      prev[c] = rgb[c];
+    }
+  }
+}
+
+struct Stripe
+{
+  int y0, y1;
+  bool last;
+  std::vector<uint8_t> out; // Raw deflate, ends byte aligned
+  uLong adler = 0;
+  uLong rawLen = 0;
+  bool ok = false;
+};
+
+/// Deflates a run of rows on its own. Every stripe but the last ends with a
+/// sync flush so the pieces concatenate into one valid deflate stream.
+void DeflateStripe(const Capture& cap, Stripe& s)
+{
+  Channel r(cap.redMask), g(cap.greenMask), b(cap.blueMask);
+  const size_t rowLen = 1 + size_t(cap.width) * 3;
+  std::vector<uint8_t> raw(rowLen * size_t(s.y1 - s.y0));
+  for (int y = s.y0; y < s.y1; ++y)
+    FilterRow(cap, y, r, g, b, raw.data() + rowLen * size_t(y - s.y0));
+
+  s.rawLen = uLong(raw.size());
+  s.adler = adler32(adler32(0, nullptr, 0), raw.data(), uInt(raw.size()));
+
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (deflateInit2(&z, 3, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return;
+  s.out.resize(deflateBound(&z, uLong(raw.size())) + 16);
+  z.next_in = raw.data();
+  z.avail_in = uInt(raw.size());
+  z.next_out = s.out.data();
+  z.avail_out = uInt(s.out.size());
+  int ret = deflate(&z, s.last ? Z_FINISH : Z_SYNC_FLUSH);
+  s.ok = s.last ? ret == Z_STREAM_END : (ret == Z_OK && z.avail_in == 0);
+  s.out.resize(z.total_out);
+  deflateEnd(&z);
+}
+
+void PutU32(std::string& out, uint32_t v)
+{
+  char b[4] = { char(v >> 24), char(v >> 16), char(v >> 8), char(v) };
+  out.append(b, 4);
+}
+
+void PutChunk(std::string& out, const char* type, const std::string& body)
+{
+  PutU32(out, uint32_t(body.size()));
+  size_t crcStart = out.size();
+  out.append(type, 4);
+  out += body;
+  uLong crc = crc32(0, reinterpret_cast<const Bytef*>(out.data() + crcStart), uInt(out.size() - crcStart));
+  PutU32(out, uint32_t(crc));
+}
+
+} // namespace
+
+std::string ExpandHome(const std::string& path)
+{
+  const char* home = getenv("HOME");
+  if (home == nullptr)
+    return path;
+  if (path.rfind("${HOME}", 0) == 0)
+    return home + path.substr(7);
+  if (path.rfind("~", 0) == 0)
+    return home + path.substr(1);
+  return path;
+}
+
+/// Capture ////////////////////////////////////////////////////////////////////
+
+Capture::Capture(Capture&& o) noexcept
+{
+  *this = std::move(o);
+}
+
+Capture& Capture::operator=(Capture&& o) noexcept
+{
+  if (this != &o) {
+    release();
+    width = o.width;
+    height = o.height;
+    stride = o.stride;
+    bitsPerPixel = o.bitsPerPixel;
+    redMask = o.redMask;
+    greenMask = o.greenMask;
+    blueMask = o.blueMask;
+    data = o.data;
+    shm = o.shm;
+    path = std::move(o.path);
+    start = o.start;
+    captureMs = o.captureMs;
+    o.data = nullptr;
+  }
+  return *this;
+}
+
+Capture::~Capture()
+{
+  release();
+}
+
+void Capture::release()
+{
+  if (data == nullptr)
+    return;
+  if (shm)
+    shmdt(data);
+  else
+    free(data);
+  data = nullptr;
+}
+
+bool CaptureRoot(Display* disp, int screen, const Rect& r, Capture& cap)
+{
+  Window root = RootWindow(disp, screen);
+  Visual* visual = DefaultVisual(disp, screen);
+  unsigned depth = unsigned(DefaultDepth(disp, screen));
+
+  // Clip to the screen, XGetImage fails on anything outside it
+  int x0 = std::max(0, r.o.x), y0 = std::max(0, r.o.y);
+  int x1 = std::min(DisplayWidth(disp, screen), r.o.x + r.w);
+  int y1 = std::min(DisplayHeight(disp, screen), r.o.y + r.h);
+  if (x1 <= x0 || y1 <= y0) {
+    LOG(ERROR) << "screenshot area is off screen x=" << r.o.x << " y=" << r.o.y;
+    return false;
+  }
+  unsigned w = unsigned(x1 - x0), h = unsigned(y1 - y0);
+
+  XImage* img = nullptr;
+  bool shm = false;
+  if (XShmQueryExtension(disp)) {
+    XShmSegmentInfo info;
+    img = XShmCreateImage(disp, visual, depth, ZPixmap, nullptr, &info, w, h);
+    if (img != nullptr) {
+      info.shmid = shmget(IPC_PRIVATE, size_t(img->bytes_per_line) * h, IPC_CREAT | 0600);
+      info.shmaddr = (info.shmid < 0) ? (char*) -1 : (char*) shmat(info.shmid, nullptr, 0);
+      if (info.shmaddr != (char*) -1) {
+        img->data = info.shmaddr;
+        info.readOnly = False;
+        shm = XShmAttach(disp, &info) && XShmGetImage(disp, root, img, x0, y0, AllPlanes);
+        XShmDetach(disp, &info);
+        shmctl(info.shmid, IPC_RMID, nullptr); // Freed once the last user detaches
+        if (!shm)
+          shmdt(info.shmaddr);
+      } else if (info.shmid >= 0) {
+        shmctl(info.shmid, IPC_RMID, nullptr);
+      }
+      if (!shm) {
+        img->data = nullptr;
+        XDestroyImage(img);
+        img = nullptr;
+      }
+    }
+  }
+  if (img == nullptr) {
+    LOG(WARN) << "MIT-SHM capture unavailable, using XGetImage";
+    img = XGetImage(disp, root, x0, y0, w, h, AllPlanes, ZPixmap);
+    if (img == nullptr) {
+      LOG(ERROR) << "unable to capture screen=" << screen;
+      return false;
+    }
+  }
+
+  if ((img->bits_per_pixel != 32 && img->bits_per_pixel != 16) || img->byte_order != LSBFirst) {
+    LOG(ERROR) << "unsupported screenshot format bpp=" << img->bits_per_pixel
+               << " byteOrder=" << img->byte_order;
+    if (shm)
+      shmdt(img->data);
+    else
+      free(img->data);
+    img->data = nullptr;
+    XDestroyImage(img);
+    return false;
+  }
+
+  cap.width = img->width;
+  cap.height = img->height;
+  cap.stride = img->bytes_per_line;
+  cap.bitsPerPixel = img->bits_per_pixel;
+  cap.redMask = img->red_mask;
+  cap.greenMask = img->green_mask;
+  cap.blueMask = img->blue_mask;
+  cap.data = reinterpret_cast<uint8_t*>(img->data);
+  cap.shm = shm;
+
+  // The pixels now belong to cap
+  img->data = nullptr;
+  XDestroyImage(img);
+  return true;
+}
+
+bool EncodePng(const Capture& cap, unsigned threads, std::string& out)
+{
+  // Stripes of at least 64 rows, too small and the flush overhead shows
+  unsigned num = std::max(1u, std::min(threads, unsigned(cap.height / 64)));
+  std::vector<Stripe> stripes(num);
+  for (unsigned i = 0; i < num; ++i) {
+    stripes[i].y0 = int(size_t(cap.height) * i / num);
+    stripes[i].y1 = int(size_t(cap.height) * (i + 1) / num);
+    stripes[i].last = i + 1 == num;
+  }
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 1; i < num; ++i)
+    workers.emplace_back(DeflateStripe, std::cref(cap), std::ref(stripes[i]));
+  DeflateStripe(cap, stripes[0]);
+  for (auto& t : workers)
+    t.join();
+
+  std::string idat;
+  idat += char(0x78); // Deflate, 32K window
+  idat += char(0x01);
+  uLong adler = adler32(0, nullptr, 0);
+  for (const auto& s : stripes) {
+    if (!s.ok)
+      return false;
+    idat.append(reinterpret_cast<const char*>(s.out.data()), s.out.size());
+    adler = adler32_combine(adler, s.adler, z_off_t(s.rawLen));
+  }
+  PutU32(idat, uint32_t(adler));
+
+  std::string ihdr;
+  PutU32(ihdr, uint32_t(cap.width));
+  PutU32(ihdr, uint32_t(cap.height));
+  ihdr += char(8); // Bit depth
+  ihdr += char(2); // RGB
+  ihdr += char(0); // Deflate
+  ihdr += char(0); // Adaptive filtering
+  ihdr += char(0); // No interlace
+
+  out.assign("\x89PNG\r\n\x1a\n", 8);
+  PutChunk(out, "IHDR", ihdr);
+  PutChunk(out, "IDAT", idat);
+  PutChunk(out, "IEND", std::string());
+  return true;
+}
+
+/// ScreenshotWriter ///////////////////////////////////////////////////////////
+
+ScreenshotWriter::~ScreenshotWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _cond.notify_one();
+  if (_thread.joinable())
+    _thread.join();
+}
+
+void ScreenshotWriter::submit(Capture&& cap)
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _jobs.push_back(std::move(cap));
+  }
+  if (!_thread.joinable())
+    _thread = std::thread(&ScreenshotWriter::loop, this);
+  _cond.notify_one();
+}
+
+void ScreenshotWriter::loop()
+{
+  const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  for (;;) {
+    Capture cap;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _cond.wait(lock, [this] { return _stop || !_jobs.empty(); });
+      if (_jobs.empty())
+        return;
+      cap = std::move(_jobs.front());
+      _jobs.pop_front();
+    }
+
+    auto encodeStart = std::chrono::steady_clock::now();
+    std::string png;
+    if (!EncodePng(cap, threads, png)) {
+      LOG(ERROR) << "unable to encode screenshot path=(" << cap.path << ")";
+      continue;
+    }
+    double encodeMs = MsSince(encodeStart);
+
+    std::string path = ExpandHome(cap.path);
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == nullptr || fwrite(png.data(), 1, png.size(), f) != png.size()) {
+      LOG(ERROR) << "unable to write screenshot path=(" << path << ") errno=" << errno;
+      if (f != nullptr)
+        fclose(f);
+      continue;
+    }
+    fclose(f);
+
+    LOG(INFO) << "wrote screenshot path=(" << path << ")"
+              << " width=" << cap.width
+              << " height=" << cap.height
+              << " bytes=" << png.size()
+              << " captureMs=" << cap.captureMs
+              << " encodeMs=" << encodeMs
+              << " totalMs=" << MsSince(cap.start);
+  }
+}
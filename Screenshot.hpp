@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Geometry.hpp"
+
+#include <X11/Xlib.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/// Pixels grabbed off a root window, still in the server's format. Owns the
+/// memory, which is an attached MIT-SHM segment or Xlib's own buffer.
+struct Capture
+{
+  Capture() = default;
+  Capture(Capture&& o) noexcept;
+  Capture& operator=(Capture&& o) noexcept;
+  Capture(const Capture&) = delete;
+  Capture& operator=(const Capture&) = delete;
+  ~Capture();
+
+  int width = 0;
+  int height = 0;
+  int stride = 0;        // Bytes per row
+  int bitsPerPixel = 0;
+  unsigned long redMask = 0, greenMask = 0, blueMask = 0;
+
+  uint8_t* data = nullptr;
+  bool shm = false;
+
+  std::string path;      // Where the PNG goes
+  std::chrono::steady_clock::time_point start;
+  double captureMs = 0;
+
+  private:
+
+    void release();
+};
+
+/// Grabs r (root coordinates, clipped to the screen) into cap. Uses MIT-SHM
+/// when the server supports it, a plain XGetImage otherwise.
+bool CaptureRoot(Display* disp, int screen, const Rect& r, Capture& cap);
+
+/// Encodes cap as an RGB PNG into out. Rows are split into stripes that are
+/// deflated on separate threads and joined into one zlib stream.
+bool EncodePng(const Capture& cap, unsigned threads, std::string& out);
+
+/// Expands a leading ${HOME} or ~, the way the shell used to for import
+std::string ExpandHome(const std::string& path);
+
+/// Encodes and writes captures off the event loop, one job at a time. The
+/// thread starts with the first job and is joined on destruction.
+class ScreenshotWriter
+{
+  public:
+
+    ~ScreenshotWriter();
+
+    void submit(Capture&& cap);
+
+  private:
+
+    void loop();
+
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::deque<Capture> _jobs;
+    bool _stop = false;
+};
@@ -0,0 +1,112 @@
+#include "Snapshot.hpp"
+
+#include <u/log.hpp>
+
+#include <cstring>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint32_t SNAP_MAGIC = 0x6d776d53; // "mwmS"
+constexpr uint32_t SNAP_VERSION = 3;
+
+struct Header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t lastFocus;
+  uint32_t numClients;
+  uint32_t numMonitors;
+};
+
+static_assert(std::is_trivially_copyable_v<Snapshot::ClientRec>);
+static_assert(std::is_trivially_copyable_v<Snapshot::MonitorRec>);
+
+} // namespace
+
+bool WriteSnapshot(const std::string& path, const Snapshot& snap)
+{
+  const size_t clientBytes = snap.clients.size() * sizeof(Snapshot::ClientRec);
+  const size_t monitorBytes = snap.monitors.size() * sizeof(Snapshot::MonitorRec);
+  const size_t size = sizeof(Header) + clientBytes + monitorBytes;
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    LOG(ERROR) << "unable to create snapshot path=(" << path << ") errno=" << errno;
+    return false;
+  }
+  if (ftruncate(fd, off_t(size)) != 0) {
+    LOG(ERROR) << "unable to size snapshot path=(" << path << ") errno=" << errno;
+    close(fd);
+    return false;
+  }
+  void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    LOG(ERROR) << "unable to map snapshot path=(" << path << ") errno=" << errno;
+    return false;
+  }
+
+  auto* p = static_cast<char*>(map);
+  Header h{SNAP_MAGIC, SNAP_VERSION, snap.lastFocus,
+           uint32_t(snap.clients.size()), uint32_t(snap.monitors.size())};
+  ::memcpy(p, &h, sizeof(h));
+  ::memcpy(p + sizeof(h), snap.clients.data(), clientBytes);
+  ::memcpy(p + sizeof(h) + clientBytes, snap.monitors.data(), monitorBytes);
+  munmap(map, size);
+
+  LOG(INFO) << "wrote snapshot path=(" << path << ")"
+            << " clients=" << h.numClients
+            << " monitors=" << h.numMonitors;
+  return true;
+}
+
+bool ReadSnapshot(const std::string& path, Snapshot& snap)
+{
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    LOG(ERROR) << "unable to open snapshot path=(" << path << ") errno=" << errno;
+    return false;
+  }
+  unlink(path.c_str());
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+    LOG(ERROR) << "truncated snapshot path=(" << path << ")";
+    close(fd);
+    return false;
+  }
+  const size_t size = size_t(st.st_size);
+  void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    LOG(ERROR) << "unable to map snapshot path=(" << path << ") errno=" << errno;
+    return false;
+  }
+
+  const auto* p = static_cast<const char*>(map);
+  Header h;
+  ::memcpy(&h, p, sizeof(h));
+  const size_t clientBytes = size_t(h.numClients) * sizeof(Snapshot::ClientRec);
+  const size_t monitorBytes = size_t(h.numMonitors) * sizeof(Snapshot::MonitorRec);
+  bool valid = h.magic == SNAP_MAGIC && h.version == SNAP_VERSION &&
+               size == sizeof(Header) + clientBytes + monitorBytes;
+  if (valid) {
+    snap.lastFocus = Window(h.lastFocus);
+    snap.clients.resize(h.numClients);
+    snap.monitors.resize(h.numMonitors);
+    ::memcpy(snap.clients.data(), p + sizeof(h), clientBytes);
+    ::memcpy(snap.monitors.data(), p + sizeof(h) + clientBytes, monitorBytes);
+  } else {
+    LOG(ERROR) << "invalid snapshot path=(" << path << ")"
+               << " magic=" << h.magic
+               << " version=" << h.version;
+  }
+  munmap(map, size);
+  return valid;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Geometry.hpp"
+
+#include <X11/Xlib.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// State carried across an in-place restart. Records are plain data so the
+/// file can be written and read straight through a memory mapping.
+struct Snapshot
+{
+  struct ClientRec
+  {
+    Window client;
+    Window root;
+    Rect preMax;
+    Rect preFull;
+    int32_t preFullBorder;
+    uint8_t ign;
+    uint8_t fullscreen;
+    SizeHints hints;
+    XID syncCounter;
+  };
+
+  struct MonitorRec
+  {
+    char name[64];
+    Window root;
+    Rect r;
+    uint32_t gridX;
+    uint32_t gridY;
+    uint32_t layout;
+  };
+
+  Window lastFocus = 0;
+  std::vector<ClientRec> clients;   // In _NET_CLIENT_LIST order
+  std::vector<MonitorRec> monitors;
+};
+
+bool WriteSnapshot(const std::string& path, const Snapshot& snap);
+
+/// Reads and removes the snapshot, a snapshot is only ever restored once
+bool ReadSnapshot(const std::string& path, Snapshot& snap);
@@ -0,0 +1,112 @@
+#include "Trace.hpp"
+
+#include <u/log.hpp>
+
+#include <atomic>
+
+namespace {
+
+/// Small per-thread ids, the main thread is the first to trace
+uint32_t ThreadId()
+{
+  static std::atomic<uint32_t> next{1};
+  thread_local uint32_t id = next++;
+  return id;
+}
+
+} // namespace
+
+bool Trace::start(const std::string& path)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_file != nullptr)
+    return true;
+
+  _file = fopen(path.c_str(), "w");
+  if (_file == nullptr) {
+    LOG(ERROR) << "trace unable to open path=" << path << " errno=" << errno;
+    return false;
+  }
+  _t0 = std::chrono::steady_clock::now();
+  _events.reserve(MAX_BUFFERED);
+  _first = true;
+  _on = true;
+
+  // A bare array, viewers accept it without the closing bracket should mwm
+  // die before stop()
+  fprintf(_file, "[\n");
+  LOG(INFO) << "trace started path=" << path;
+  return true;
+}
+
+void Trace::stop()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_file == nullptr)
+    return;
+  _on = false;
+  write();
+  fprintf(_file, "\n]\n");
+  fclose(_file);
+  _file = nullptr;
+  LOG(INFO) << "trace stopped";
+}
+
+void Trace::flush()
+{
+  if (!on())
+    return;
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_file != nullptr && !_events.empty()) {
+    write();
+    fflush(_file);
+  }
+}
+
+void Trace::record(Event e)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_file == nullptr)
+    return;
+  _events.push_back(e);
+  if (_events.size() >= MAX_BUFFERED)
+    write();
+}
+
+void Trace::write()
+{
+  for (const Event& e : _events) {
+    fprintf(_file, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                   "\"pid\":1,\"tid\":%u,\"args\":{\"window\":\"0x%lx\",\"serial\":%lu}}",
+            _first ? "" : ",\n", e.name, e.cat, e.ts, e.dur, e.tid, e.window, e.serial);
+    _first = false;
+  }
+  _events.clear();
+}
+
+/// Span ///////////////////////////////////////////////////////////////////////
+
+Trace::Span::Span(const char* name, const char* cat, unsigned long window, unsigned long serial)
+{
+  if (!on())
+    return;
+  _name = name;
+  _cat = cat;
+  _window = window;
+  _serial = serial;
+  _start = std::chrono::steady_clock::now();
+}
+
+Trace::Span::Span(const char* name, Display* disp, unsigned long window)
+  : Span(name, "xreq", window, on() ? NextRequest(disp) : 0)
+{
+}
+
+Trace::Span::~Span()
+{
+  if (_name == nullptr)
+    return;
+  using Us = std::chrono::duration<double, std::micro>;
+  auto end = std::chrono::steady_clock::now();
+  record({ _name, _cat, _window, _serial, Us(_start - _t0).count(), Us(end - _start).count(), ThreadId() });
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <X11/Xlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// Span recorder written as Chrome trace-event JSON, opens in
+/// chrome://tracing and ui.perfetto.dev. Off unless started: a Span is then a
+/// single branch. When on, spans are buffered and written out whenever the
+/// event loop goes idle, so writing never lands inside a span.
+class Trace
+{
+  public:
+
+    /// Truncates path and starts recording, false if it can't be opened
+    static bool start(const std::string& path);
+
+    /// Writes what's buffered and closes the array
+    static void stop();
+
+    /// Writes what's buffered, called from the idle point of the event loop
+    static void flush();
+
+    static bool on() { return _on.load(std::memory_order_relaxed); }
+
+    /// One span, from construction to destruction. Names and categories must
+    /// be string literals or otherwise outlive the trace.
+    class Span
+    {
+      public:
+
+        Span(const char* name, const char* cat, unsigned long window = 0, unsigned long serial = 0);
+
+        /// An X round trip, serial is the request about to be sent on disp
+        Span(const char* name, Display* disp, unsigned long window = 0);
+
+        ~Span();
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+      private:
+
+        const char* _name = nullptr; // nullptr when tracing is off
+        const char* _cat;
+        unsigned long _window;
+        unsigned long _serial;
+        std::chrono::steady_clock::time_point _start;
+    };
+
+  private:
+
+    struct Event
+    {
+      const char* name;
+      const char* cat;
+      unsigned long window;
+      unsigned long serial;
+      double ts;  // Microseconds since start
+      double dur;
+      uint32_t tid;
+    };
+
+    static void record(Event e);
+    static void write(); // _mutex held
+
+    static constexpr size_t MAX_BUFFERED = 1 << 16; // Written early past this
+
+    inline static std::atomic<bool> _on{false};
+    inline static FILE* _file = nullptr;
+    inline static std::mutex _mutex;
+    inline static std::vector<Event> _events;
+    inline static std::chrono::steady_clock::time_point _t0;
+    inline static bool _first = true; // No comma before the next event
+};
@@ -0,0 +1,204 @@
+#include "Watchdog.hpp"
+
+#include <u/log.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <cxxabi.h>
+#include <execinfo.h>
+#include <signal.h>
+
+namespace {
+
+constexpr int MAX_FRAMES = 64;
+constexpr auto CAPTURE_WAIT = std::chrono::milliseconds(100);
+
+// Filled in by the signal handler on the watched thread
+void* g_stack[MAX_FRAMES];
+std::atomic<int> g_frames{0};
+std::atomic<bool> g_captured{false};
+
+void OnCaptureSignal(int)
+{
+  // backtrace() was called once up front, so it no longer loads anything
+  int saved = errno;
+  g_frames.store(backtrace(g_stack, MAX_FRAMES), std::memory_order_relaxed);
+  g_captured.store(true, std::memory_order_release);
+  errno = saved;
+}
+
+int CaptureSignal()
+{
+  return SIGRTMIN + 1;
+}
+
+int64_t NowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// "mwm(_ZN7Manager8dispatchERK7_XEvent+0x5c) [0x...]" with the name demangled
+std::string Demangle(const char* frame)
+{
+  std::string s(frame);
+  size_t open = s.find('('), plus = s.find('+', open);
+  if (open == std::string::npos || plus == std::string::npos || plus == open + 1)
+    return s;
+  int status = -1;
+  std::string mangled = s.substr(open + 1, plus - open - 1);
+  char* name = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+  if (status == 0 && name != nullptr)
+    s.replace(open + 1, plus - open - 1, name);
+  free(name);
+  return s;
+}
+
+} // namespace
+
+Watchdog::~Watchdog()
+{
+  setBudget(0);
+}
+
+void Watchdog::setBudget(unsigned ms)
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _budgetMs = ms;
+    _stop = ms == 0;
+  }
+  _cv.notify_one();
+
+  if (ms == 0) {
+    if (_thread.joinable())
+      _thread.join();
+    return;
+  }
+  if (_thread.joinable()) {
+    LOG(INFO) << "watchdog budget changed ms=" << ms;
+    return;
+  }
+
+  static bool installed = [] {
+    void* warm[1];
+    backtrace(warm, 1);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnCaptureSignal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(CaptureSignal(), &sa, nullptr) == 0;
+  }();
+  if (!installed)
+    LOG(WARN) << "watchdog unable to install its signal handler, reports will have no stack";
+
+  _target = pthread_self();
+  _thread = std::thread(&Watchdog::loop, this);
+  LOG(INFO) << "watchdog started budgetMs=" << ms;
+}
+
+void Watchdog::begin(const char* what, unsigned long window, unsigned long serial)
+{
+  uint64_t seq = _seq.load(std::memory_order_relaxed);
+  _startNs.store(NowNs(), std::memory_order_relaxed);
+  _what.store(what, std::memory_order_relaxed);
+  _window.store(window, std::memory_order_relaxed);
+  _serial.store(serial, std::memory_order_relaxed);
+
+  // Sequentially consistent against the watchdog parking: either it sees this
+  // sequence before it blocks, or this sees it parked and wakes it
+  _seq.store(seq + 1, std::memory_order_seq_cst);
+  if (_parked.load(std::memory_order_seq_cst)) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _parked.store(false, std::memory_order_relaxed);
+    }
+    _cv.notify_one();
+  }
+}
+
+void Watchdog::end()
+{
+  uint64_t seq = _seq.load(std::memory_order_relaxed);
+  _seq.store(seq + 1, std::memory_order_release);
+
+  // Only ever taken after a report, the common case is the load above
+  if (_reported.load(std::memory_order_relaxed) == seq) {
+    LOG(WARN) << "watchdog stall over what=" << _what.load(std::memory_order_relaxed)
+              << " ms=" << (NowNs() - _startNs.load(std::memory_order_relaxed)) / 1000000;
+  }
+}
+
+void Watchdog::loop()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (!_stop) {
+    uint64_t seq = _seq.load(std::memory_order_seq_cst);
+    if ((seq & 1) == 0 || _reported.load(std::memory_order_relaxed) == seq) {
+      // Nothing open, or already reported: no wakeups until begin()
+      _parked.store(true, std::memory_order_seq_cst);
+      if (_seq.load(std::memory_order_seq_cst) == seq)
+        _cv.wait(lock, [this] { return _stop || !_parked.load(std::memory_order_relaxed); });
+      _parked.store(false, std::memory_order_relaxed);
+      continue;
+    }
+
+    int64_t start = _startNs.load(std::memory_order_relaxed);
+    const char* what = _what.load(std::memory_order_relaxed);
+    unsigned long window = _window.load(std::memory_order_relaxed);
+    unsigned long serial = _serial.load(std::memory_order_relaxed);
+    if (_seq.load(std::memory_order_acquire) != seq)
+      continue; // Finished while reading
+
+    // Asleep until this unit is over budget, then look again: it's reported
+    // only if it is still the one open
+    const int64_t now = NowNs();
+    const int64_t due = start + int64_t(_budgetMs) * 1000000;
+    if (now < due) {
+      _cv.wait_for(lock, std::chrono::nanoseconds(due - now));
+      continue;
+    }
+    int64_t ms = (now - start) / 1000000;
+
+    lock.unlock();
+    report(seq, what, window, serial, ms);
+    lock.lock();
+  }
+}
+
+void Watchdog::report(uint64_t seq, const char* what, unsigned long window, unsigned long serial, int64_t ms)
+{
+  _reported.store(seq, std::memory_order_relaxed);
+
+  g_captured.store(false, std::memory_order_relaxed);
+  bool captured = false;
+  if (pthread_kill(_target, CaptureSignal()) == 0) {
+    auto deadline = std::chrono::steady_clock::now() + CAPTURE_WAIT;
+    while (!(captured = g_captured.load(std::memory_order_acquire)) &&
+           std::chrono::steady_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  LOG(WARN) << "watchdog stall what=" << (what ? what : "?")
+            << " window=" << window
+            << " serial=" << serial
+            << " ms=" << ms
+            << " stack=" << (captured ? g_frames.load(std::memory_order_relaxed) : 0);
+  if (!captured)
+    return;
+
+  int frames = g_frames.load(std::memory_order_relaxed);
+  char** symbols = backtrace_symbols(g_stack, frames);
+  if (symbols == nullptr)
+    return;
+  // Frame 0 and 1 are the handler and the signal trampoline
+  for (int i = 2; i < frames; ++i)
+    LOG(WARN) << "watchdog  #" << (i - 2) << " " << Demangle(symbols[i]);
+  free(symbols);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include <pthread.h>
+
+/// Notices when the event thread spends longer than a budget on one unit of
+/// work. The stalled thread's stack is captured from a signal handler, then
+/// symbolized and logged on the watchdog's own thread, so the report is out
+/// while the stall is still going on. A second line gives the total once the
+/// work finishes.
+///
+/// begin() and end() are a few atomic stores, cheap enough for every event.
+/// The watchdog thread only runs while work is open: it sleeps until the
+/// budget of the current unit runs out, and while the event thread is idle
+/// it blocks until begin() wakes it, which takes the mutex only then.
+class Watchdog
+{
+  public:
+
+    Watchdog() = default;
+    ~Watchdog();
+
+    Watchdog(const Watchdog&) = delete;
+    Watchdog& operator=(const Watchdog&) = delete;
+
+    /// Starts or retunes the watchdog, 0 stops it. The calling thread is the
+    /// one watched.
+    void setBudget(unsigned ms);
+
+    /// Around each unit of work. what must be a literal or static table
+    /// entry, it's read from the watchdog thread.
+    void begin(const char* what, unsigned long window = 0, unsigned long serial = 0);
+    void end();
+
+    /// begin() and end() for one scope
+    class Scope
+    {
+      public:
+
+        Scope(Watchdog& w, const char* what, unsigned long window = 0, unsigned long serial = 0)
+          : _w(w) { _w.begin(what, window, serial); }
+        ~Scope() { _w.end(); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+
+        Watchdog& _w;
+    };
+
+  private:
+
+    void loop();
+    void report(uint64_t seq, const char* what, unsigned long window, unsigned long serial, int64_t ms);
+
+    // Seqlock over the current work: odd while busy, the fields are only
+    // trusted if the sequence reads the same before and after
+    std::atomic<uint64_t> _seq{0};
+    std::atomic<int64_t> _startNs{0};
+    std::atomic<const char*> _what{nullptr};
+    std::atomic<unsigned long> _window{0};
+    std::atomic<unsigned long> _serial{0};
+    std::atomic<uint64_t> _reported{0}; // Sequence of the stall last logged
+    std::atomic<bool> _parked{false};   // Watchdog blocked until the next begin()
+
+    pthread_t _target = {};
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    unsigned _budgetMs = 0;
+    bool _stop = false;
+};
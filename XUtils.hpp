@@ -1,41 +1,76 @@
 #pragma once
 
+#include "Trace.hpp"
+
 #include <u/log.hpp>
 
 #include <X11/cursorfont.h>
 #include <X11/XF86keysym.h>
+#include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <X11/Xproto.h>
+#include <X11/Xutil.h>
 #include <X11/extensions/Xrandr.h>
+#include <X11/extensions/sync.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <string>
+#include <vector>
+
+/// An output lit by a CRTC, as XRandR currently has it configured
+struct XRROutput
+{
+  std::string connector;
+  Rect r;
+};
 
 constexpr static inline const char* XEventToString(const XEvent& e);
 constexpr static inline const char* XOpcodeToString(const unsigned char opcode);
-static inline int XError(Display* display, XErrorEvent* e);
+static inline bool GetWinAttrs(Display* disp, Window w, XWindowAttributes& attr);
+static inline Window GetFocus(Display* disp);
+static inline Point GetPointer(Display* disp, Window root);
 static inline Rect GetWinRect(Display* disp, Window w);
 static inline Window GetWinRoot(Display* disp, Window w);
+static inline bool GetWinHasAtom(Display* disp, Window w, Atom prop, Atom atom);
+static inline void SetWinHasAtom(Display* disp, Window w, Atom prop, Atom atom, bool on);
+static inline SizeHints GetWinSizeHints(Display* disp, Window w);
+static inline bool GetWinCardinal(Display* disp, Window w, Atom prop, unsigned long& out);
+static inline void GetWinName(Display* disp, Window w, Atom netWmName, Atom utf8, size_t max, std::string& out);
+static inline bool GetXRROutputs(Display* disp, Window root, std::vector<XRROutput>& out);
 static inline void DumpXRR(Display* disp, Window root);
 
 /// Implementation /////////////////////////////////////////////////////////////
 
-static inline int XError(Display* display, XErrorEvent* e) {
-  char buf[4096];
-  ::memset(buf, 0, sizeof(buf));
-  XGetErrorText(display, e->error_code, buf, sizeof(buf));
-  LOG(ERROR) << "X ERROR"
-             << " display=" << DisplayString(display)
-             << " majorOpcode=" << XOpcodeToString(e->request_code)
-             << " minorOpcode=" << (int) e->minor_code
-             << " what=(" << buf << ")";
-  return 0;
+static inline bool GetWinAttrs(Display* disp, Window w, XWindowAttributes& attr)
+{
+  Trace::Span span("XGetWindowAttributes", disp, w);
+  return XGetWindowAttributes(disp, w, &attr) != 0;
+}
+
+static inline Window GetFocus(Display* disp)
+{
+  Trace::Span span("XGetInputFocus", disp);
+  Window focus; int revert;
+  XGetInputFocus(disp, &focus, &revert);
+  return focus;
+}
+
+/// Root coordinates, the pointer may be on another screen's root
+static inline Point GetPointer(Display* disp, Window root)
+{
+  Trace::Span span("XQueryPointer", disp, root);
+  Window rootRet, childRet; int wx, wy; unsigned mask;
+  Point p;
+  XQueryPointer(disp, root, &rootRet, &childRet, &p.x, &p.y, &wx, &wy, &mask);
+  return p;
 }
 
 static inline Rect GetWinRect(Display* disp, Window w)
 {
   XWindowAttributes attr;
-  if (XGetWindowAttributes(disp, w, &attr) == 0)
+  if (!GetWinAttrs(disp, w, attr))
     return Rect();
   return Rect(attr.x, attr.y, attr.width, attr.height);
 }
@@ -45,11 +80,152 @@ static inline Window GetWinRoot(Display* disp, Window w)
   Window root, parent;
   Window* children = nullptr;
   uint32_t num;
+  Trace::Span span("XQueryTree", disp, w);
   const auto ret = XQueryTree(disp, w, &root, &parent, &children, &num);
   XFree(children);
   return (ret != 0) ? root : 0;
 }
 
+/// Whether the atom list in prop contains atom
+static inline bool GetWinHasAtom(Display* disp, Window w, Atom prop, Atom atom)
+{
+  bool found = false;
+  Atom type; int format;
+  unsigned long num, after;
+  unsigned char* data = nullptr;
+  Trace::Span span("XGetWindowProperty", disp, w);
+  if (XGetWindowProperty(disp, w, prop, 0, 64, false, XA_ATOM,
+                         &type, &format, &num, &after, &data) == Success && data != nullptr) {
+    if (type == XA_ATOM && format == 32)
+      found = std::find((Atom*) data, (Atom*) data + num, atom) != (Atom*) data + num;
+    XFree(data);
+  }
+  return found;
+}
+
+/// Adds atom to or removes it from the atom list in prop, the other atoms are
+/// left as they are
+static inline void SetWinHasAtom(Display* disp, Window w, Atom prop, Atom atom, bool on)
+{
+  Atom type = None; int format = 0;
+  unsigned long num = 0, after;
+  unsigned char* data = nullptr;
+  Trace::Span span("XGetWindowProperty", disp, w);
+  XGetWindowProperty(disp, w, prop, 0, 1024, false, XA_ATOM, &type, &format, &num, &after, &data);
+  const bool list = type == XA_ATOM && format == 32 && data != nullptr;
+
+  Atom* atoms = (Atom*) data;
+  Atom* last = list ? std::remove(atoms, atoms + num, atom) : atoms;
+  if (on && (!list || last == atoms + num)) {
+    // Missing or of some other type, which append can't extend
+    const int mode = (list || type == None) ? PropModeAppend : PropModeReplace;
+    XChangeProperty(disp, w, prop, XA_ATOM, 32, mode, (unsigned char*) &atom, 1);
+  } else if (!on && list && last != atoms + num) {
+    XChangeProperty(disp, w, prop, XA_ATOM, 32, PropModeReplace, data, int(last - atoms));
+  }
+  if (data != nullptr)
+    XFree(data);
+}
+
+/// _NET_WM_NAME, else WM_NAME converted, as UTF-8 and empty if there is none.
+/// Cut to at most max bytes at a character boundary and assigned into out, so
+/// with max reserved in out it never allocates.
+static inline void GetWinName(Display* disp, Window w, Atom netWmName, Atom utf8, size_t max, std::string& out)
+{
+  auto assign = [&] (const char* s, size_t len) {
+    size_t n = std::min(len, max);
+    while (n > 0 && n < len && (s[n] & 0xC0) == 0x80)
+      --n;
+    out.assign(s, n);
+  };
+  out.clear();
+
+  Atom type; int format;
+  unsigned long num, after;
+  unsigned char* data = nullptr;
+  {
+    Trace::Span span("XGetWindowProperty", disp, w);
+    // One more byte than fits shows whether the cut lands inside a character
+    const long words = long(max / 4 + 1);
+    if (XGetWindowProperty(disp, w, netWmName, 0, words, false, utf8,
+                           &type, &format, &num, &after, &data) == Success && data != nullptr) {
+      const bool found = type == utf8 && format == 8 && num > 0;
+      if (found)
+        assign((const char*) data, num);
+      XFree(data);
+      if (found)
+        return;
+    }
+  }
+
+  // Legacy clients, STRING or COMPOUND_TEXT
+  XTextProperty prop;
+  Trace::Span span("XGetWMName", disp, w);
+  if (XGetWMName(disp, w, &prop) == 0 || prop.value == nullptr)
+    return;
+  char** list = nullptr;
+  int count = 0;
+  if (Xutf8TextPropertyToTextList(disp, &prop, &list, &count) >= Success && count > 0 && list != nullptr)
+    assign(list[0], strlen(list[0]));
+  if (list != nullptr)
+    XFreeStringList(list);
+  XFree(prop.value);
+}
+
+static inline bool GetWinCardinal(Display* disp, Window w, Atom prop, unsigned long& out)
+{
+  Atom type; int format;
+  unsigned long num, after;
+  unsigned char* data = nullptr;
+  bool found = false;
+  Trace::Span span("XGetWindowProperty", disp, w);
+  if (XGetWindowProperty(disp, w, prop, 0, 1, false, XA_CARDINAL,
+                         &type, &format, &num, &after, &data) == Success && data != nullptr) {
+    found = type == XA_CARDINAL && format == 32 && num == 1;
+    if (found)
+      out = *(unsigned long*) data;
+    XFree(data);
+  }
+  return found;
+}
+
+static inline SizeHints GetWinSizeHints(Display* disp, Window w)
+{
+  SizeHints h;
+  XSizeHints xh;
+  long supplied;
+  Trace::Span span("XGetWMNormalHints", disp, w);
+  if (XGetWMNormalHints(disp, w, &xh, &supplied) == 0)
+    return h;
+
+  h.userPos = (xh.flags & USPosition) != 0;
+
+  // ICCCM: base and min size each default to the other
+  if (xh.flags & PBaseSize) {
+    h.baseW = xh.base_width;
+    h.baseH = xh.base_height;
+  } else if (xh.flags & PMinSize) {
+    h.baseW = xh.min_width;
+    h.baseH = xh.min_height;
+  }
+  if (xh.flags & PMinSize) {
+    h.minW = std::max(1, xh.min_width);
+    h.minH = std::max(1, xh.min_height);
+  } else if (xh.flags & PBaseSize) {
+    h.minW = std::max(1, xh.base_width);
+    h.minH = std::max(1, xh.base_height);
+  }
+  if ((xh.flags & PMaxSize) && xh.max_width > 0 && xh.max_height > 0) {
+    h.maxW = xh.max_width;
+    h.maxH = xh.max_height;
+  }
+  if ((xh.flags & PResizeInc) && xh.width_inc > 0 && xh.height_inc > 0) {
+    h.incW = xh.width_inc;
+    h.incH = xh.height_inc;
+  }
+  return h;
+}
+
 constexpr static inline const char* XEventToString(const XEvent& e)
 {
   constexpr const char* const X_EVENT_TYPE_NAMES[] = {
@@ -237,9 +413,35 @@ constexpr static inline const char* XOpcodeToString(const unsigned char opcode)
   return X_REQ_OPCODE_NAMES[opcode];
 }
 
+/// Reads the current configuration only. XRRGetScreenResources would make the
+/// server re-probe every output, which takes hundreds of milliseconds.
+static inline bool GetXRROutputs(Display* disp, Window root, std::vector<XRROutput>& out)
+{
+  Trace::Span span("GetXRROutputs", disp, root);
+  auto* res = XRRGetScreenResourcesCurrent(disp, root);
+  if (res == nullptr)
+    return false;
+  for (int j = 0; j < res->ncrtc; ++j) {
+    auto* crtc = XRRGetCrtcInfo(disp, res, res->crtcs[j]);
+    if (crtc == nullptr)
+      continue;
+    Rect rect{crtc->x, crtc->y, int(crtc->width), int(crtc->height)};
+    for (int k = 0; k < crtc->noutput; ++k) {
+      auto* output = XRRGetOutputInfo(disp, res, crtc->outputs[k]);
+      if (output == nullptr)
+        continue;
+      out.push_back({std::string(output->name, size_t(output->nameLen)), rect});
+      XRRFreeOutputInfo(output);
+    }
+    XRRFreeCrtcInfo(crtc);
+  }
+  XRRFreeScreenResources(res);
+  return true;
+}
+
 static inline void DumpXRR(Display* disp, Window root)
 {
-  auto* res = XRRGetScreenResources(disp, root);
+  auto* res = XRRGetScreenResourcesCurrent(disp, root);
   assert(res != nullptr);
 
   LOG(INFO) << "screen resources"
@@ -0,0 +1,91 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+/// Microbenchmark Harness
+///
+/// Shared by the bench/ executables. Each result is one JSON object per line:
+///   {"bench":"nearest","impl":"avx2","n":1000,"iters":...,"ns_per_op":...,
+///    "ops_per_sec":...,"items_per_sec":...}
+/// items_per_sec is ops_per_sec times the items one op handles: candidates
+/// scanned by default, 1 for lookups into a set of n.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+
+struct BenchOptions
+{
+  std::string filter;
+  double minMs = 200;
+  unsigned seed = 1;
+};
+
+/// Keeps results alive without the cost of a volatile store per op
+inline uint64_t g_benchSink = 0;
+
+/// False (after printing usage) on anything it doesn't understand
+inline bool ParseBenchOptions(int argc, char** argv, BenchOptions& opt)
+{
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      opt.filter = argv[++i];
+    } else if (strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc) {
+      opt.minMs = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      opt.seed = unsigned(atoi(argv[++i]));
+    } else {
+      fprintf(stderr, "usage: %s [--filter <substring>] [--min-ms <ms>] [--seed <n>]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Runs fn(i) in growing batches until minMs has passed, then reports.
+/// Each op counts as items of work
+template<typename F>
+void RunBench(const BenchOptions& opt, const char* bench, const char* impl, size_t n, size_t items,
+              F&& fn)
+{
+  std::string name = std::string(bench) + "/" + impl;
+  if (!opt.filter.empty() && name.find(opt.filter) == std::string::npos)
+    return;
+
+  using Clock = std::chrono::steady_clock;
+  uint64_t iters = 0;
+  uint64_t batch = 1;
+  double ns = 0;
+  while (ns < opt.minMs * 1e6) {
+    auto start = Clock::now();
+    for (uint64_t i = 0; i < batch; ++i)
+      g_benchSink += uint64_t(fn(iters + i));
+    ns += double(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    iters += batch;
+    batch *= 2;
+  }
+
+  double nsPerOp = ns / double(iters);
+  printf("{\"bench\":\"%s\",\"impl\":\"%s\",\"n\":%zu,\"iters\":%llu,"
+         "\"ns_per_op\":%.3f,\"ops_per_sec\":%.1f,\"items_per_sec\":%.1f}\n",
+         bench, impl, n, (unsigned long long) iters,
+         nsPerOp, 1e9 / nsPerOp, 1e9 / nsPerOp * double(items ? items : 1));
+  fflush(stdout);
+}
+
+/// Each op handles all n items, a scan
+template<typename F>
+void RunBench(const BenchOptions& opt, const char* bench, const char* impl, size_t n, F&& fn)
+{
+  RunBench(opt, bench, impl, n, n, std::forward<F>(fn));
+}
+
+/// Never true, stops the compiler from dropping the work
+inline void FinishBench()
+{
+  if (g_benchSink == 0x5eed)
+    fprintf(stderr, "\n");
+}
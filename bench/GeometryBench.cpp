@@ -0,0 +1,269 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Geometry Microbenchmarks
+///
+/// Standalone, no X server needed. Prints one JSON object per line, see
+/// Bench.hpp for the format.
+///
+/// Usage: mwm-bench-geometry [--filter <substring>] [--min-ms <ms>] [--seed <n>]
+///
+/// Workloads are generated: candidate counts from 10 to 100k spread over
+/// several screens with their own absolute origins, grids up to 64x64, and up to
+/// 1000 windows on one monitor for free space placement and edge snapping.
+
+#include "Bench.hpp"
+
+#include "../Geometry.hpp"
+
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+/// Screens side by side and stacked, like a multi-screen _argScreens map
+const Point SCREEN_ORIGINS[] = {
+  { 0, 0 }, { 1920, 0 }, { 3840, 0 }, { 0, 1080 }, { 2560, 1440 },
+};
+
+const char* ImplName(SimdLevel l)
+{
+  switch (l) {
+    case SimdLevel::Scalar: return "scalar";
+    case SimdLevel::SSE2:   return "sse2";
+    case SimdLevel::AVX2:   return "avx2";
+    default:                return "undefined";
+  }
+}
+
+/// Candidate rects scattered over the screens, absolute coordinates
+std::vector<Rect> GenRects(std::mt19937& rng, size_t n)
+{
+  std::uniform_int_distribution<size_t> screen(0, std::size(SCREEN_ORIGINS) - 1);
+  std::uniform_int_distribution<int> x(0, 1919), y(0, 1079), w(50, 1200), h(50, 800);
+  std::vector<Rect> rects;
+  rects.reserve(n);
+  for (size_t i = 0; i < n; ++i)
+    rects.push_back(Rect(x(rng), y(rng), w(rng), h(rng)) + SCREEN_ORIGINS[screen(rng)]);
+  return rects;
+}
+
+std::vector<Point> GenPoints(std::mt19937& rng, size_t n)
+{
+  std::vector<Point> points;
+  for (const auto& r : GenRects(rng, n))
+    points.push_back(r.getCenter());
+  return points;
+}
+
+/// The pre-RectSet loops over vectors of pairs, kept as the baseline
+size_t PairsNearest(const Point& p, const std::vector<std::pair<Rect, size_t>>& rects)
+{
+  size_t closest = GEOM_NPOS;
+  double minDist = DBL_MAX;
+  for (const auto& r : rects) {
+    Point o = r.first.getCenter();
+    int vertDist = std::min(p.getDist(o, DIR::Up),   p.getDist(o, DIR::Down));
+    int horzDist = std::min(p.getDist(o, DIR::Left), p.getDist(o, DIR::Right));
+    auto dist = sqrt((vertDist*vertDist) + (horzDist*horzDist));
+    if (dist < minDist) {
+      minDist = dist;
+      closest = r.second;
+    }
+  }
+  return closest;
+}
+
+size_t PairsInDir(DIR dir, const Point& c, const std::vector<std::pair<Point, size_t>>& points)
+{
+  size_t closest = GEOM_NPOS;
+  int minDist = INT_MAX;
+  for (auto& p : points) {
+    int plelDist = c.getDist(p.first, dir);
+    if (plelDist == INT_MAX || plelDist == 0)
+      continue;
+    int perpDist;
+    if (dir == DIR::Up || dir == DIR::Down)
+      perpDist = std::min(c.getDist(p.first, DIR::Left), c.getDist(p.first, DIR::Right));
+    else
+      perpDist = std::min(c.getDist(p.first, DIR::Up), c.getDist(p.first, DIR::Down));
+    int dist = (int) sqrt((plelDist*plelDist) + 4*(perpDist*perpDist));
+    if (dist < minDist) {
+      minDist = dist;
+      closest = p.second;
+    }
+  }
+  return closest;
+}
+
+void BenchPoint(const BenchOptions& opt, std::mt19937& rng)
+{
+  const size_t N = 4096; // Power of two, queries wrap with a mask
+  auto a = GenPoints(rng, N), b = GenPoints(rng, N);
+  auto rects = GenRects(rng, N);
+
+  RunBench(opt, "point_dist", "euclid", 1, [&] (uint64_t i) {
+    return a[i & (N - 1)].getDist(b[(i * 7) & (N - 1)]);
+  });
+  RunBench(opt, "point_dist_dir", "scalar", 1, [&] (uint64_t i) {
+    return a[i & (N - 1)].getDist(b[(i * 7) & (N - 1)], DIR(i & 3));
+  });
+  RunBench(opt, "rect_contains", "scalar", 1, [&] (uint64_t i) {
+    return rects[i & (N - 1)].contains(a[(i * 7) & (N - 1)]);
+  });
+}
+
+void BenchQueries(const BenchOptions& opt, std::mt19937& rng)
+{
+  const size_t Q = 1024;
+  for (size_t n : { 10, 100, 1000, 10000, 100000 }) {
+    auto rects = GenRects(rng, n);
+    auto queries = GenPoints(rng, Q);
+
+    // Raw SoA arrays so every kernel level can be measured on one machine
+    std::vector<int> x0, y0, x1, y1, cx, cy;
+    std::vector<std::pair<Rect, size_t>> pairRects;
+    std::vector<std::pair<Point, size_t>> pairPoints;
+    RectSet<size_t> set;
+    for (size_t i = 0; i < n; ++i) {
+      const Rect& r = rects[i];
+      x0.push_back(r.o.x);
+      y0.push_back(r.o.y);
+      x1.push_back(r.o.x + r.w);
+      y1.push_back(r.o.y + r.h);
+      cx.push_back(r.getCenter().x);
+      cy.push_back(r.getCenter().y);
+      pairRects.emplace_back(r, i);
+      pairPoints.emplace_back(r.getCenter(), i);
+      set.set(i, r);
+    }
+
+    RunBench(opt, "nearest", "pairs", n, [&] (uint64_t i) {
+      return PairsNearest(queries[i & (Q - 1)], pairRects);
+    });
+    RunBench(opt, "in_dir", "pairs", n, [&] (uint64_t i) {
+      return PairsInDir(DIR(i & 3), queries[i & (Q - 1)], pairPoints);
+    });
+
+    for (size_t l = 0; l < size_t(SimdLevel::LAST); ++l) {
+      auto level = SimdLevel(l);
+      if (level > BestSimdLevel())
+        break;
+      const auto& k = GetGeomKernels(level);
+      RunBench(opt, "nearest", ImplName(level), n, [&] (uint64_t i) {
+        const Point& p = queries[i & (Q - 1)];
+        return k.nearest(cx.data(), cy.data(), n, p.x, p.y, GEOM_NPOS);
+      });
+      RunBench(opt, "in_dir", ImplName(level), n, [&] (uint64_t i) {
+        const Point& p = queries[i & (Q - 1)];
+        return (i & 1) ? k.inDir(cx.data(), cy.data(), n, p.x, p.y, (i & 2) ? 1 : -1, GEOM_NPOS)
+                       : k.inDir(cy.data(), cx.data(), n, p.y, p.x, (i & 2) ? 1 : -1, GEOM_NPOS);
+      });
+      RunBench(opt, "containing", ImplName(level), n, [&] (uint64_t i) {
+        const Point& p = queries[i & (Q - 1)];
+        return k.containing(x0.data(), y0.data(), x1.data(), y1.data(), n, p.x, p.y);
+      });
+    }
+
+    // What Manager actually calls, dispatch and skip lookup included
+    RunBench(opt, "rectset_nearest", ImplName(BestSimdLevel()), n, [&] (uint64_t i) {
+      size_t skip = i % n;
+      const size_t* r = set.nearest(queries[i & (Q - 1)], &skip);
+      return r ? *r : GEOM_NPOS;
+    });
+  }
+}
+
+void BenchSnap(const BenchOptions& opt, std::mt19937& rng)
+{
+  const size_t Q = 1024;
+  const Rect mon(1920, 0, 2560, 1440);
+  std::uniform_int_distribution<int> x(mon.o.x, mon.o.x + mon.w), y(0, mon.h);
+  std::uniform_int_distribution<int> w(20, mon.w), h(20, mon.h);
+  std::vector<Rect> rects;
+  for (size_t i = 0; i < Q; ++i)
+    rects.emplace_back(x(rng), y(rng), w(rng), h(rng));
+
+  for (unsigned grid : { 1u, 2u, 4u, 8u, 16u, 32u, 64u }) {
+    std::string impl = std::to_string(grid) + "x" + std::to_string(grid);
+    RunBench(opt, "snap_grid", impl.c_str(), grid * grid, [&] (uint64_t i) {
+      GridSnap s = SnapToGrid(mon, grid, grid, rects[i & (Q - 1)]);
+      return s.center.x + s.center.y + s.w + s.h;
+    });
+  }
+}
+
+/// Largest free region on one monitor, windows scattered anywhere or lined up
+/// on a grid the way snapGrid leaves them
+void BenchFreeSpace(const BenchOptions& opt, std::mt19937& rng)
+{
+  const Rect mon(1920, 0, 2560, 1440);
+  std::uniform_int_distribution<int> x(mon.o.x, mon.o.x + mon.w), y(0, mon.h);
+  std::uniform_int_distribution<int> w(50, 800), h(50, 600);
+  std::uniform_int_distribution<int> cell(0, 7), span(1, 3);
+  FreeSpace space;
+  Rect out;
+
+  for (size_t n : { 10, 100, 300, 1000 }) {
+    std::vector<Rect> scattered, gridded;
+    for (size_t i = 0; i < n; ++i) {
+      scattered.emplace_back(x(rng), y(rng), w(rng), h(rng));
+      gridded.emplace_back(mon.o.x + cell(rng) * mon.w / 8, mon.o.y + cell(rng) * mon.h / 8,
+                           span(rng) * mon.w / 8, span(rng) * mon.h / 8);
+    }
+    RunBench(opt, "free_space", "scattered", n, [&] (uint64_t i) {
+      return space.largest(mon, scattered, 100 + int(i & 63), 100, out) ? out.w : 0;
+    });
+    RunBench(opt, "free_space", "grid", n, [&] (uint64_t i) {
+      return space.largest(mon, gridded, 100 + int(i & 63), 100, out) ? out.w : 0;
+    });
+  }
+}
+
+/// One motion sample's snap lookups, the sorted index against scanning every edge
+void BenchEdgeSnap(const BenchOptions& opt, std::mt19937& rng)
+{
+  const size_t Q = 1024;
+  const int DIST = 12;
+  for (size_t n : { 10, 100, 1000 }) {
+    auto rects = GenRects(rng, n);
+    auto queries = GenPoints(rng, Q);
+    EdgeIndex index;
+    for (const auto& r : rects)
+      index.add(r);
+    index.sort();
+
+    RunBench(opt, "edge_snap", "scan", n, [&] (uint64_t i) {
+      const Point& p = queries[i & (Q - 1)];
+      int best = INT_MAX;
+      for (const auto& r : rects)
+        for (int e : { r.o.x, r.o.x + r.w })
+          if (std::abs(e - p.x) <= DIST && std::abs(e - p.x) < std::abs(best))
+            best = e - p.x;
+      return best;
+    });
+    RunBench(opt, "edge_snap", "sorted", n, [&] (uint64_t i) {
+      int d = 0;
+      return index.snapX(queries[i & (Q - 1)].x, DIST, d) ? d : INT_MAX;
+    });
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  BenchOptions opt;
+  if (!ParseBenchOptions(argc, argv, opt))
+    return 1;
+
+  std::mt19937 rng(opt.seed);
+  BenchPoint(opt, rng);
+  BenchQueries(opt, rng);
+  BenchSnap(opt, rng);
+  BenchFreeSpace(opt, rng);
+  BenchEdgeSnap(opt, rng);
+
+  FinishBench();
+  return 0;
+}
@@ -0,0 +1,632 @@
+////////////////////////////////////////////////////////////////////////////////
+/// End-to-end Keybinding Latency
+///
+/// Starts Xvfb and mwm on a spare display, maps synthetic clients and injects
+/// the default bindings through XTEST. A sample is the time from the fake key
+/// press leaving the injector until an observer connection sees what the
+/// binding should cause: FocusIn for focus moves, a ConfigureNotify with new
+/// geometry for grid moves and maximize. Bindings that change nothing within
+/// the timeout (a grid move at the screen edge) count as timeouts.
+///
+/// "fullscreen" toggles the focused window through a _NET_WM_STATE message
+/// that names FULLSCREEN in both slots, which must count once. A sample ends
+/// when the window fills the screen or is back where it was. Every toggle
+/// also checks that the _NET_WM_STATE_ABOVE put there beforehand survived,
+/// and a toggle that fails either check fails the run.
+///
+/// Usage: mwm-bench-latency [--mwm <path>] [--xvfb <path>] [--display <:n>]
+///                          [--samples <n>] [--windows <n,n,...>] [--seed <n>]
+///                          [--alloc-check <rounds>]
+///
+/// mwm runs with MWM_ALLOC_STRICT set: a build configured with MWM_ALLOC_STATS
+/// aborts when a hot handler allocates, which fails the run.
+///
+/// --alloc-check measures nothing and only churns: each round closes the
+/// focused window, maps a replacement, drags a window and presses every
+/// binding once. It fails unless mwm is still running at the end. Against an
+/// MWM_ALLOC_STATS build this is the strict mode check, 'make alloc-check'.
+///
+/// One JSON object per scenario and window count:
+///   {"bench":"focus","windows":100,"samples":200,"timeouts":0,
+///    "p50_us":...,"p90_us":...,"p99_us":...,"max_us":...}
+/// and for fullscreen "state_errors" as well.
+
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/Xrandr.h>
+#include <X11/extensions/XTest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto TIMEOUT = std::chrono::milliseconds(250);
+constexpr auto SETTLE = std::chrono::milliseconds(5); // Trailing events of a sample
+constexpr int SCREEN_W = 1920;
+constexpr int SCREEN_H = 1080;
+constexpr int DRAG_STEPS = 16;
+
+struct Options
+{
+  std::string mwm = "./mwm";
+  std::string xvfb = "Xvfb";
+  std::string display = ":97";
+  size_t samples = 200;
+  std::vector<size_t> windows = { 10, 100, 1000 };
+  unsigned seed = 1;
+  size_t checkRounds = 0; // Non-zero runs the allocation check instead
+};
+
+struct Geom
+{
+  int x, y, w, h;
+  bool operator!=(const Geom& o) const { return x != o.x || y != o.y || w != o.w || h != o.h; }
+};
+
+/// What a sample waits for
+enum class Expect { Focus, Configure };
+
+struct Scenario
+{
+  const char* name;
+  unsigned mods;          // Besides Numlock, which stays locked
+  KeySym keys[2];         // Alternated, so moves go back and forth
+  Expect expect;
+};
+
+const Scenario SCENARIOS[] = {
+  { "focus",      0,           { XK_l, XK_h }, Expect::Focus },
+  { "focus_vert", 0,           { XK_j, XK_k }, Expect::Focus },
+  { "grid_move",  ShiftMask,   { XK_l, XK_h }, Expect::Configure },
+  { "grid_size",  ControlMask, { XK_l, XK_h }, Expect::Configure },
+  { "maximize",   0,           { XK_m, XK_n }, Expect::Configure },
+};
+
+pid_t Spawn(const std::vector<std::string>& args)
+{
+  pid_t pid = fork();
+  if (pid != 0)
+    return pid;
+
+  // Keep the report on stdout readable
+  int null = open("/dev/null", O_WRONLY);
+  dup2(null, STDOUT_FILENO);
+  dup2(null, STDERR_FILENO);
+  std::vector<char*> argv;
+  for (const auto& a : args)
+    argv.push_back(const_cast<char*>(a.c_str()));
+  argv.push_back(nullptr);
+  execvp(argv[0], argv.data());
+  _exit(127);
+}
+
+void Stop(pid_t pid)
+{
+  if (pid <= 0)
+    return;
+  kill(pid, SIGTERM);
+  waitpid(pid, nullptr, 0);
+}
+
+/// Retries until the server accepts connections
+Display* Connect(const std::string& display)
+{
+  for (int i = 0; i < 100; ++i) {
+    if (Display* d = XOpenDisplay(display.c_str()))
+      return d;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  return nullptr;
+}
+
+/// mwm is up once it has claimed the root with _NET_SUPPORTING_WM_CHECK
+bool WaitForWm(Display* d)
+{
+  Atom check = XInternAtom(d, "_NET_SUPPORTING_WM_CHECK", False);
+  for (int i = 0; i < 200; ++i) {
+    Atom type; int format;
+    unsigned long num, after;
+    unsigned char* data = nullptr;
+    XGetWindowProperty(d, DefaultRootWindow(d), check, 0, 1, False, AnyPropertyType,
+                       &type, &format, &num, &after, &data);
+    if (data != nullptr) {
+      XFree(data);
+      if (num == 1)
+        return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  return false;
+}
+
+/// mwm only manages monitors it has a config line for, so the config names
+/// every output Xvfb reports on screen 0. Bindings are left out and stay the
+/// defaults, which is what gets measured.
+bool WriteConfig(Display* d, std::string& path)
+{
+  XRRScreenResources* res = XRRGetScreenResourcesCurrent(d, RootWindow(d, 0));
+  if (res == nullptr)
+    return false;
+  std::string text;
+  for (int i = 0; i < res->noutput; ++i) {
+    XRROutputInfo* out = XRRGetOutputInfo(d, res, res->outputs[i]);
+    if (out == nullptr)
+      continue;
+    if (out->crtc != None)
+      text += "monitor bench" + std::to_string(i) + " 0 " + std::string(out->name, size_t(out->nameLen)) + "\n";
+    XRRFreeOutputInfo(out);
+  }
+  XRRFreeScreenResources(res);
+  if (text.empty())
+    return false;
+
+  char tmpl[] = "/tmp/mwm-bench-XXXXXX";
+  int fd = mkstemp(tmpl);
+  if (fd < 0)
+    return false;
+  bool ok = write(fd, text.data(), text.size()) == ssize_t(text.size());
+  close(fd);
+  path = tmpl;
+  return ok;
+}
+
+unsigned Modifiers(Display* d)
+{
+  Window r, c; int rx, ry, wx, wy; unsigned mask;
+  XQueryPointer(d, DefaultRootWindow(d), &r, &c, &rx, &ry, &wx, &wy, &mask);
+  return mask;
+}
+
+class Session
+{
+  public:
+
+    Session(Display* client, Display* observer, Display* injector)
+      : _client(client), _obs(observer), _inj(injector) {}
+
+    /// Maps windows until there are n, waits until mwm has mapped each
+    bool grow(size_t n, std::mt19937& rng)
+    {
+      std::uniform_int_distribution<int> w(200, 600), h(150, 450), x(0, SCREEN_W - 600), y(0, SCREEN_H - 450);
+      std::vector<Window> added;
+      while (_windows.size() < n) {
+        Geom g{ x(rng), y(rng), w(rng), h(rng) };
+        Window win = XCreateSimpleWindow(_client, DefaultRootWindow(_client), g.x, g.y,
+                                         unsigned(g.w), unsigned(g.h), 0, 0, 0xffffff);
+        XMapWindow(_client, win);
+        _windows.push_back(win);
+        added.push_back(win);
+      }
+      XSync(_client, False);
+
+      for (Window win : added)
+        XSelectInput(_obs, win, FocusChangeMask | StructureNotifyMask);
+      XSync(_obs, False);
+
+      size_t mapped = 0;
+      for (Window win : added) {
+        XWindowAttributes a;
+        if (XGetWindowAttributes(_obs, win, &a) && a.map_state == IsViewable) {
+          _geoms[win] = { a.x, a.y, a.width, a.height };
+          ++mapped;
+        }
+      }
+      auto deadline = Clock::now() + std::chrono::seconds(30);
+      while (mapped < added.size() && Clock::now() < deadline) {
+        XEvent e;
+        if (!next(e, deadline))
+          break;
+        if (e.type == MapNotify && !_geoms.count(e.xmap.window)) {
+          XWindowAttributes a;
+          XGetWindowAttributes(_obs, e.xmap.window, &a);
+          _geoms[e.xmap.window] = { a.x, a.y, a.width, a.height };
+          ++mapped;
+        }
+      }
+      if (mapped < added.size())
+        fprintf(stderr, "only %zu of %zu windows were mapped\n", mapped, added.size());
+
+      // Focus one near the middle so every direction has somewhere to go
+      Window mid = _windows[_windows.size() / 2];
+      XSetInputFocus(_client, mid, RevertToPointerRoot, CurrentTime);
+      XSync(_client, False);
+      _focus = mid;
+      settle();
+      return mapped == added.size();
+    }
+
+    /// Rounds of close, map, drag and every binding, returns how many finished
+    size_t churn(size_t rounds, std::mt19937& rng)
+    {
+      const size_t n = _windows.size();
+      size_t done = 0;
+      for (size_t r = 0; r < rounds; ++r) {
+        if (!close() || !grow(n, rng))
+          break;
+        drag(r);
+        for (const Scenario& s : SCENARIOS) {
+          double us;
+          sample(s.mods, s.keys[r & 1], s.expect, us);
+        }
+        ++done;
+      }
+      return done;
+    }
+
+    void run(const Scenario& s, size_t samples)
+    {
+      std::vector<double> us;
+      size_t timeouts = 0;
+      for (size_t i = 0; i < samples; ++i) {
+        double t;
+        if (sample(s.mods, s.keys[i & 1], s.expect, t))
+          us.push_back(t);
+        else
+          ++timeouts;
+      }
+      report(s.name, us, timeouts, "");
+    }
+
+    /// Fullscreen on and off by _NET_WM_STATE, false when any toggle timed out
+    /// or left the property wrong
+    bool fullscreen(size_t samples)
+    {
+      const Window w = _focus;
+      XWindowAttributes a;
+      if (w == None || !XGetWindowAttributes(_obs, w, &a))
+        return false;
+      const Geom normal{ a.x, a.y, a.width, a.height };
+
+      const Atom wmState = XInternAtom(_client, "_NET_WM_STATE", False);
+      const Atom full = XInternAtom(_client, "_NET_WM_STATE_FULLSCREEN", False);
+      const Atom above = XInternAtom(_client, "_NET_WM_STATE_ABOVE", False);
+      XChangeProperty(_client, w, wmState, XA_ATOM, 32, PropModeReplace, (unsigned char*) &above, 1);
+      XSync(_client, False);
+
+      std::vector<double> us;
+      size_t timeouts = 0, wrong = 0;
+      samples += samples & 1; // Ends where it started
+      for (size_t i = 0; i < samples; ++i) {
+        const bool on = (i & 1) == 0;
+
+        XEvent m;
+        memset(&m, 0, sizeof(m));
+        m.xclient.type = ClientMessage;
+        m.xclient.window = w;
+        m.xclient.message_type = wmState;
+        m.xclient.format = 32;
+        m.xclient.data.l[0] = 2; // Toggle
+        m.xclient.data.l[1] = long(full);
+        m.xclient.data.l[2] = long(full);
+        m.xclient.data.l[3] = 1; // Normal application
+        const auto start = Clock::now();
+        XSendEvent(_client, DefaultRootWindow(_client), False,
+                   SubstructureRedirectMask | SubstructureNotifyMask, &m);
+        XFlush(_client);
+
+        bool seen = false;
+        const auto deadline = start + TIMEOUT;
+        XEvent e;
+        while (!seen && next(e, deadline)) {
+          if (e.type != ConfigureNotify || e.xconfigure.window != w)
+            continue;
+          const Geom g{ e.xconfigure.x, e.xconfigure.y, e.xconfigure.width, e.xconfigure.height };
+          _geoms[w] = g;
+          seen = on ? (g.w == SCREEN_W && g.h == SCREEN_H) : !(g != normal);
+        }
+        if (seen)
+          us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+        else
+          ++timeouts;
+
+        settle();
+        const std::vector<Atom> states = atoms(w, wmState);
+        auto has = [&] (Atom x) { return std::find(states.begin(), states.end(), x) != states.end(); };
+        if (!has(above) || has(full) != on)
+          ++wrong;
+      }
+
+      char extra[48];
+      snprintf(extra, sizeof(extra), ",\"state_errors\":%zu", wrong);
+      report("fullscreen", us, timeouts, extra);
+      return timeouts == 0 && wrong == 0;
+    }
+
+  private:
+
+    void report(const char* name, std::vector<double>& us, size_t timeouts, const char* extra)
+    {
+      std::sort(us.begin(), us.end());
+      auto pct = [&] (double p) {
+        return us.empty() ? 0.0 : us[std::min(us.size() - 1, size_t(p * double(us.size())))];
+      };
+      printf("{\"bench\":\"%s\",\"windows\":%zu,\"samples\":%zu,\"timeouts\":%zu,"
+             "\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f%s}\n",
+             name, _windows.size(), us.size(), timeouts,
+             pct(0.50), pct(0.90), pct(0.99), us.empty() ? 0.0 : us.back(), extra);
+      fflush(stdout);
+    }
+
+    /// The atom list in prop, as the observer reads it
+    std::vector<Atom> atoms(Window w, Atom prop)
+    {
+      std::vector<Atom> out;
+      Atom type; int format;
+      unsigned long num, after;
+      unsigned char* data = nullptr;
+      if (XGetWindowProperty(_obs, w, prop, 0, 64, False, XA_ATOM,
+                             &type, &format, &num, &after, &data) == Success && data != nullptr) {
+        if (type == XA_ATOM && format == 32)
+          out.assign((Atom*) data, (Atom*) data + num);
+        XFree(data);
+      }
+      return out;
+    }
+
+    bool sample(unsigned mods, KeySym sym, Expect expect, double& us)
+    {
+      const KeyCode key = XKeysymToKeycode(_inj, sym);
+      const KeyCode shift = XKeysymToKeycode(_inj, XK_Shift_L);
+      const KeyCode ctrl = XKeysymToKeycode(_inj, XK_Control_L);
+
+      if (mods & ShiftMask)
+        XTestFakeKeyEvent(_inj, shift, True, CurrentTime);
+      if (mods & ControlMask)
+        XTestFakeKeyEvent(_inj, ctrl, True, CurrentTime);
+      XSync(_inj, False);
+
+      const Window before = _focus;
+      const auto start = Clock::now();
+      XTestFakeKeyEvent(_inj, key, True, CurrentTime);
+      XFlush(_inj);
+
+      bool seen = false;
+      const auto deadline = start + TIMEOUT;
+      XEvent e;
+      while (!seen && next(e, deadline)) {
+        if (e.type == FocusIn && e.xfocus.mode == NotifyNormal && e.xfocus.detail != NotifyPointer) {
+          _focus = e.xfocus.window;
+          seen = expect == Expect::Focus && _focus != before;
+        } else if (e.type == ConfigureNotify) {
+          const Geom g{ e.xconfigure.x, e.xconfigure.y, e.xconfigure.width, e.xconfigure.height };
+          // Restacking sends ConfigureNotify too, only new geometry counts
+          Geom& old = _geoms[e.xconfigure.window];
+          seen = expect == Expect::Configure && e.xconfigure.window == _focus && g != old;
+          old = g;
+        }
+      }
+      us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+      XTestFakeKeyEvent(_inj, key, False, CurrentTime);
+      if (mods & ControlMask)
+        XTestFakeKeyEvent(_inj, ctrl, False, CurrentTime);
+      if (mods & ShiftMask)
+        XTestFakeKeyEvent(_inj, shift, False, CurrentTime);
+      XSync(_inj, False);
+      settle();
+      return seen;
+    }
+
+    /// Presses the close binding and answers WM_DELETE_WINDOW like a client,
+    /// by destroying the window
+    bool close()
+    {
+      const KeyCode key = XKeysymToKeycode(_inj, XK_d);
+      XTestFakeKeyEvent(_inj, key, True, CurrentTime);
+      XTestFakeKeyEvent(_inj, key, False, CurrentTime);
+      XSync(_inj, False);
+
+      XEvent e;
+      const auto deadline = Clock::now() + TIMEOUT;
+      while (next(_client, e, deadline)) {
+        if (e.type != ClientMessage)
+          continue;
+        const Window w = e.xclient.window;
+        XDestroyWindow(_client, w);
+        XSync(_client, False);
+        _windows.erase(std::remove(_windows.begin(), _windows.end(), w), _windows.end());
+        _geoms.erase(w);
+        settle();
+        return true;
+      }
+      fprintf(stderr, "close binding sent no WM_DELETE_WINDOW\n");
+      return false;
+    }
+
+    /// Numlock drag of the focused window from its middle, so it moves rather
+    /// than resizes, back and forth on alternate rounds
+    void drag(size_t round)
+    {
+      auto it = _geoms.find(_focus);
+      if (it == _geoms.end())
+        return;
+      const int x = it->second.x + it->second.w / 2;
+      const int y = it->second.y + it->second.h / 2;
+      const int dir = (round & 1) ? -1 : 1;
+
+      XTestFakeMotionEvent(_inj, 0, x, y, CurrentTime);
+      XTestFakeButtonEvent(_inj, 1, True, CurrentTime);
+      for (int i = 1; i <= DRAG_STEPS; ++i)
+        XTestFakeMotionEvent(_inj, 0, x + dir * i * 8, y + dir * i * 4, CurrentTime);
+      XTestFakeButtonEvent(_inj, 1, False, CurrentTime);
+      XSync(_inj, False);
+      settle();
+    }
+
+    /// Next event on d, false once the deadline passes
+    bool next(Display* d, XEvent& e, Clock::time_point deadline)
+    {
+      while (!XPending(d)) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        if (left < 0)
+          return false;
+        pollfd fd = { ConnectionNumber(d), POLLIN, 0 };
+        poll(&fd, 1, int(left) + 1);
+      }
+      XNextEvent(d, &e);
+      return true;
+    }
+
+    bool next(XEvent& e, Clock::time_point deadline) { return next(_obs, e, deadline); }
+
+    /// Absorbs what the last sample left behind, keeping focus and geometry
+    /// current
+    void settle()
+    {
+      XEvent e;
+      while (next(e, Clock::now() + SETTLE)) {
+        if (e.type == FocusIn && e.xfocus.mode == NotifyNormal && e.xfocus.detail != NotifyPointer)
+          _focus = e.xfocus.window;
+        else if (e.type == ConfigureNotify)
+          _geoms[e.xconfigure.window] = { e.xconfigure.x, e.xconfigure.y, e.xconfigure.width, e.xconfigure.height };
+      }
+    }
+
+    Display* _client;
+    Display* _obs;
+    Display* _inj;
+    std::vector<Window> _windows;
+    std::map<Window, Geom> _geoms;
+    Window _focus = None;
+};
+
+bool ParseOptions(int argc, char** argv, Options& opt)
+{
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--mwm") == 0 && i + 1 < argc) {
+      opt.mwm = argv[++i];
+    } else if (strcmp(argv[i], "--xvfb") == 0 && i + 1 < argc) {
+      opt.xvfb = argv[++i];
+    } else if (strcmp(argv[i], "--display") == 0 && i + 1 < argc) {
+      opt.display = argv[++i];
+    } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+      opt.samples = size_t(atol(argv[++i]));
+    } else if (strcmp(argv[i], "--windows") == 0 && i + 1 < argc) {
+      opt.windows.clear();
+      for (char* tok = strtok(argv[++i], ","); tok != nullptr; tok = strtok(nullptr, ","))
+        opt.windows.push_back(size_t(atol(tok)));
+      std::sort(opt.windows.begin(), opt.windows.end());
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      opt.seed = unsigned(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--alloc-check") == 0 && i + 1 < argc) {
+      opt.checkRounds = size_t(atol(argv[++i]));
+    } else {
+      fprintf(stderr, "usage: %s [--mwm <path>] [--xvfb <path>] [--display <:n>] "
+                      "[--samples <n>] [--windows <n,n,...>] [--seed <n>] "
+                      "[--alloc-check <rounds>]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+int Bench(const Options& opt)
+{
+  Display* client = Connect(opt.display);
+  Display* obs = Connect(opt.display);
+  Display* inj = Connect(opt.display);
+  if (client == nullptr || obs == nullptr || inj == nullptr) {
+    fprintf(stderr, "unable to connect to %s\n", opt.display.c_str());
+    return 1;
+  }
+  int ev, err, major, minor;
+  if (!XTestQueryExtension(inj, &ev, &err, &major, &minor)) {
+    fprintf(stderr, "server has no XTEST\n");
+    return 1;
+  }
+
+  std::string config;
+  if (!WriteConfig(obs, config)) {
+    fprintf(stderr, "unable to write a monitor config for %s\n", opt.display.c_str());
+    if (!config.empty())
+      unlink(config.c_str());
+    return 1;
+  }
+
+  setenv("MWM_ALLOC_STRICT", "1", 1);
+  pid_t wm = Spawn({ opt.mwm, "--display", opt.display, "--screen", "0", "--config", config });
+  if (!WaitForWm(obs)) {
+    fprintf(stderr, "mwm didn't start\n");
+    Stop(wm);
+    unlink(config.c_str());
+    return 1;
+  }
+
+  // Every binding is under Numlock, lock it once
+  if (!(Modifiers(inj) & Mod2Mask)) {
+    KeyCode num = XKeysymToKeycode(inj, XK_Num_Lock);
+    XTestFakeKeyEvent(inj, num, True, CurrentTime);
+    XTestFakeKeyEvent(inj, num, False, CurrentTime);
+    XSync(inj, False);
+  }
+  if (!(Modifiers(inj) & Mod2Mask))
+    fprintf(stderr, "numlock is not on Mod2, bindings won't match\n");
+
+  std::mt19937 rng(opt.seed);
+  Session session(client, obs, inj);
+  int ret = 0;
+  for (size_t n : opt.windows) {
+    session.grow(n, rng);
+    if (opt.checkRounds > 0) {
+      const size_t done = session.churn(opt.checkRounds, rng);
+      printf("{\"check\":\"alloc_strict\",\"windows\":%zu,\"rounds\":%zu,\"completed\":%zu}\n",
+             n, opt.checkRounds, done);
+      fflush(stdout);
+      if (done < opt.checkRounds)
+        ret = 1;
+      continue;
+    }
+    for (const Scenario& s : SCENARIOS)
+      session.run(s, opt.samples);
+    if (!session.fullscreen(opt.samples))
+      ret = 1;
+  }
+
+  // Gone early means it crashed, or aborted on a hot path allocation
+  if (waitpid(wm, nullptr, WNOHANG) == wm) {
+    fprintf(stderr, "mwm exited during the run\n");
+    wm = 0;
+    ret = 1;
+  }
+
+  Stop(wm);
+  unlink(config.c_str());
+  XCloseDisplay(inj);
+  XCloseDisplay(obs);
+  XCloseDisplay(client);
+  return ret;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  Options opt;
+  if (!ParseOptions(argc, argv, opt))
+    return 1;
+
+  std::string screen = std::to_string(SCREEN_W) + "x" + std::to_string(SCREEN_H) + "x24";
+  pid_t server = Spawn({ opt.xvfb, opt.display, "-screen", "0", screen, "-nolisten", "tcp" });
+  int ret = Bench(opt);
+  Stop(server);
+  return ret;
+}
@@ -0,0 +1,119 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Client Registry Microbenchmarks
+///
+/// Standalone, no X server needed. Prints one JSON object per line, see
+/// Bench.hpp for the format.
+///
+/// Usage: mwm-bench-registry [--filter <substring>] [--min-ms <ms>] [--seed <n>]
+///
+/// The real Client record keyed the way X hands out ids: a resource base per
+/// client connection, sequential ids under it. Registries from 10 to 16k
+/// windows, the operations Manager does per event: find a window it manages,
+/// find one it doesn't (override-redirect, frames of other clients), walk all
+/// of them, and map/unmap churn.
+
+#include "Bench.hpp"
+
+#include "../FlatMap.hpp"
+#include "../Manager.hpp"
+
+#include <map>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using StdMap = std::map<Window, Client>;
+using HashMap = std::unordered_map<Window, Client>;
+using Flat = FlatMap<Window, Client>;
+
+const size_t SIZES[] = { 10, 100, 1000, 4096, 16384 };
+
+/// Distinct ids, a few windows per connection like real clients
+std::vector<Window> GenIds(std::mt19937& rng, size_t n)
+{
+  std::vector<Window> ids;
+  std::map<Window, bool> seen;
+  std::uniform_int_distribution<Window> conn(1, 0x1ff), res(1, 0x3f);
+  while (ids.size() < n) {
+    Window w = (conn(rng) << 21) | res(rng);
+    if (seen.emplace(w, true).second)
+      ids.push_back(w);
+  }
+  return ids;
+}
+
+Client MakeClient(Window w)
+{
+  Client c = {};
+  c.client = w;
+  c.geom = Rect(int(w & 0xff), int((w >> 8) & 0xff), 640, 480);
+  return c;
+}
+
+template<typename M>
+void Bench(const BenchOptions& opt, const char* impl, const std::vector<Window>& ids,
+           const std::vector<Window>& absent, const std::vector<uint32_t>& order)
+{
+  const size_t n = ids.size();
+  const size_t Q = order.size(); // Power of two
+
+  M m;
+  for (Window w : ids)
+    m.insert({ w, MakeClient(w) });
+
+  RunBench(opt, "find_hit", impl, n, 1, [&] (uint64_t i) {
+    auto it = m.find(ids[order[i & (Q - 1)]]);
+    return it->second.geom.w;
+  });
+  RunBench(opt, "find_miss", impl, n, 1, [&] (uint64_t i) {
+    return m.find(absent[i & (Q - 1)]) == m.end();
+  });
+  RunBench(opt, "iterate", impl, n, [&] (uint64_t) {
+    int64_t sum = 0;
+    for (auto& [w, c] : m)
+      sum += c.ign ? 0 : c.geom.o.x;
+    return sum;
+  });
+
+  // Unmap one window and map another, the registry stays at n
+  std::vector<Window> live(ids), spare(absent);
+  RunBench(opt, "churn", impl, n, 1, [&] (uint64_t i) {
+    size_t a = order[i & (Q - 1)];
+    size_t b = i & (Q - 1);
+    m.erase(live[a]);
+    std::swap(live[a], spare[b]);
+    return m.insert({ live[a], MakeClient(live[a]) }).second;
+  });
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  BenchOptions opt;
+  if (!ParseBenchOptions(argc, argv, opt))
+    return 1;
+
+  std::mt19937 rng(opt.seed);
+  const size_t Q = 4096;
+
+  for (size_t n : SIZES) {
+    auto all = GenIds(rng, n + Q);
+    std::vector<Window> ids(all.begin(), all.begin() + long(n));
+    std::vector<Window> absent(all.begin() + long(n), all.end());
+
+    std::vector<uint32_t> order(Q);
+    std::uniform_int_distribution<uint32_t> pick(0, uint32_t(n - 1));
+    for (auto& o : order)
+      o = pick(rng);
+
+    Bench<StdMap>(opt, "std_map", ids, absent, order);
+    Bench<HashMap>(opt, "unordered_map", ids, absent, order);
+    Bench<Flat>(opt, "flat", ids, absent, order);
+  }
+
+  FinishBench();
+  return 0;
+}
@@ -1,8 +1,15 @@
+#include "AllocStats.hpp"
+#include "ErrorLog.hpp"
 #include "Manager.hpp"
+#include "Recorder.hpp"
+#include "Trace.hpp"
 
 #include <u/log.hpp>
 
+#include <clocale>
+#include <cstring>
 #include <getopt.h>
+#include <unistd.h>
 
 int main(int argc, char* argv[])
 {
@@ -11,15 +18,26 @@ int main(int argc, char* argv[])
     {"display", required_argument, NULL, 'd'},
     {"screen", required_argument, NULL, 's'},
     {"screenshot-dir", required_argument, NULL, 'S'},
+    {"config", required_argument, NULL, 'c'},
+    {"restore", required_argument, NULL, 'r'},
+    {"trace", required_argument, NULL, 't'},
     {NULL, 0, NULL, 0}
   };
 
   std::string display;
   std::map<int,Point> screens;
   std::string screenshotDir = "${HOME}";
+  std::string configPath;
+  std::string restorePath;
+  std::string tracePath;
+
+  if (const char* xdg = getenv("XDG_CONFIG_HOME"); xdg != nullptr && *xdg != '\0')
+    configPath = std::string(xdg) + "/mwm/mwm.conf";
+  else if (const char* home = getenv("HOME"); home != nullptr)
+    configPath = std::string(home) + "/.config/mwm/mwm.conf";
 
   int ch;
-  while ((ch = getopt_long(argc, argv, "d:s:S:", long_options, NULL)) != -1) {
+  while ((ch = getopt_long(argc, argv, "d:s:S:c:r:t:", long_options, NULL)) != -1) {
     switch (ch) {
       case 'd':
         display = optarg;
@@ -35,16 +53,66 @@ int main(int argc, char* argv[])
       case 'S':
         screenshotDir = optarg;
         break;
+      case 'c':
+        configPath = optarg;
+        break;
+      case 'r':
+        restorePath = optarg;
+        break;
+      case 't':
+        tracePath = optarg;
+        break;
     }
   }
 
-  std::map<std::string,MonitorCfg> monitorCfg;
-
   LOG(INFO) << "starting mwm";
 
-  Manager m(display, screens, screenshotDir, monitorCfg);
-  if (!m.init())
+  // Font sets pick their charsets from LC_CTYPE, UTF-8 text needs a UTF-8 one
+  if (setlocale(LC_CTYPE, "") == nullptr || !XSupportsLocale())
+    LOG(WARN) << "locale unsupported by Xlib, non-ASCII text may not draw";
+  XSetLocaleModifiers(""); // XMODIFIERS picks the launcher's input method
+
+  // Chrome trace-event JSON of every event, handler and round trip. A restart
+  // starts the file over.
+  if (!tracePath.empty() && !Trace::start(tracePath))
     return EXIT_FAILURE;
-  m.run();
-  return EXIT_SUCCESS;
+
+  std::string snapshot;
+  {
+    Manager m(display, screens, screenshotDir, configPath, restorePath);
+    if (!m.init()) {
+      Trace::stop();
+      return EXIT_FAILURE;
+    }
+    m.run();
+    AllocScope::report();
+    ErrorLog::report();
+    snapshot = m.restartPath();
+  } // Closes the display before exec
+  Recorder::WaitForDumps();
+  Trace::stop();
+
+  if (snapshot.empty())
+    return EXIT_SUCCESS;
+
+  // Re-exec through PATH so an upgraded binary is picked up, dropping any
+  // previous --restore argument
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    if (strcmp(argv[i], "--restore") == 0 || strcmp(argv[i], "-r") == 0) {
+      ++i;
+      continue;
+    }
+    if (strncmp(argv[i], "--restore=", 10) == 0)
+      continue;
+    args.push_back(argv[i]);
+  }
+  std::string restoreArg = "--restore=" + snapshot;
+  args.push_back(restoreArg.data());
+  args.push_back(nullptr);
+
+  LOG(INFO) << "restarting mwm";
+  execvp(args[0], args.data());
+  LOG(ERROR) << "exec failed errno=" << errno;
+  return EXIT_FAILURE;
 }